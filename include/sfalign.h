@@ -0,0 +1,52 @@
+#ifndef SFALIGN_H
+#define SFALIGN_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "sfmm.h"
+
+/*
+ * Aligned and sized allocation.  sf_malloc() always returns 16-byte aligned payloads;
+ * sf_memalign() returns a payload aligned to any larger power of two.  The block is an
+ * ordinary allocated block, so it is freed with sf_free() and resized with sf_realloc()
+ * (which may move it to a block with only 16-byte alignment).
+ *
+ * sf_free_sized() is for callers that know the size of the block they free, such as
+ * C++ sized deallocation.
+ */
+
+/*
+ * Allocate a block whose payload is aligned to the given boundary.  A block large enough
+ * to hold an aligned payload is allocated, the unused space in front of the aligned
+ * payload is split off and freed, and so is the unused space behind it if it is at
+ * least a minimum block.
+ *
+ * @param align  The alignment: a power of two, at least 16.
+ * @param size  The number of bytes requested to be allocated.
+ *
+ * @return If size is 0, then NULL is returned without setting sf_errno.  If align is not
+ * a power of two or is smaller than 16, NULL is returned and sf_errno is set to EINVAL.
+ * If the request cannot be satisfied, NULL is returned and sf_errno is set to ENOMEM.
+ */
+void *sf_memalign(sf_size_t align, sf_size_t size);
+
+/*
+ * @return The payload size of an allocated block: the number of bytes of it the program
+ * may use.
+ */
+sf_size_t sf_usable_size(void *pp);
+
+/*
+ * Free a block whose payload size the caller knows.  The size is checked against the
+ * header before the block is freed, which catches a block being freed with the wrong
+ * size or through the wrong pointer.
+ *
+ * @param pp  Address of the memory being freed.
+ * @param size  The size the block was allocated (or last reallocated) with.
+ *
+ * @return If the size does not match the payload size in the header, then abort() is
+ * called.  Otherwise the block is freed exactly as by sf_free().
+ */
+void sf_free_sized(void *pp, sf_size_t size);
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef SFARENA_H
+#define SFARENA_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "sfmm.h"
+#include "sfstats.h"
+#include "sfheapmap.h"
+
+/*
+ * An arena is an independent heap with its own free lists, quick lists, statistics
+ * and pages.  Its pages come from a private address range reserved with mmap() when
+ * the arena is created, so blocks from different arenas never share a page, and the
+ * whole arena can be dropped at once with sf_arena_destroy().
+ *
+ * Blocks in an arena have the same format as blocks in the sfutil heap, and the
+ * arena-scoped calls behave exactly like sf_malloc(), sf_realloc() and sf_free().
+ * A block must be freed or reallocated through the arena it came from.
+ */
+typedef struct sf_arena sf_arena;
+
+/*
+ * Create an empty arena.
+ *
+ * @param capacity  The maximum heap size of the arena, in bytes.  It is rounded up
+ * to a multiple of PAGE_SZ.  Address space for the whole capacity is reserved up front,
+ * but memory is only committed as the arena's heap grows.  The heap starts on a
+ * SF_HUGE_PAGE_SZ boundary.
+ *
+ * @return The new arena.  If the address range cannot be reserved, NULL is returned
+ * and sf_errno is set to ENOMEM.
+ */
+sf_arena *sf_arena_create(size_t capacity);
+
+/*
+ * sf_malloc() on the heap of the given arena.
+ */
+void *sf_arena_malloc(sf_arena *arena, sf_size_t size);
+
+/*
+ * sf_realloc() on the heap of the given arena.  If a new block is needed, it is taken
+ * from the same arena.
+ */
+void *sf_arena_realloc(sf_arena *arena, void *ptr, sf_size_t size);
+
+/*
+ * sf_free() on the heap of the given arena.
+ */
+void sf_arena_free(sf_arena *arena, void *ptr);
+
+/*
+ * sf_free_sized() on the heap of the given arena.
+ */
+void sf_arena_free_sized(sf_arena *arena, void *ptr, sf_size_t size);
+
+/*
+ * sf_memalign() on the heap of the given arena.
+ */
+void *sf_arena_memalign(sf_arena *arena, sf_size_t align, sf_size_t size);
+
+/*
+ * @return true if ptr lies inside the address range reserved for the arena's heap.
+ */
+bool sf_arena_contains(sf_arena *arena, void *ptr);
+
+/*
+ * sf_malloc_hint() on the heap of the given arena (see sfhint.h).  The hint is ignored
+ * for a persistent heap, whose sub-heaps could not be saved with it.
+ */
+void *sf_arena_malloc_hint(sf_arena *arena, sf_size_t size, int hint);
+
+/*
+ * sf_hint_get_stats() on the heap of the given arena.
+ */
+int sf_arena_hint_get_stats(sf_arena *arena, int hint, struct sf_stats *stats);
+
+/*
+ * sf_malloc_tagged() on the heap of the given arena (see sftag.h).
+ */
+void *sf_arena_malloc_tagged(sf_arena *arena, sf_size_t size, unsigned int tag);
+
+/*
+ * sf_tag_get_stats() on the heap of the given arena.
+ */
+struct sf_tag_stats;
+int sf_arena_tag_get_stats(sf_arena *arena, unsigned int tag, struct sf_tag_stats *stats);
+
+/*
+ * sf_tag_pin() on the heap of the given arena.  A persistent heap cannot pin tags,
+ * as its sub-heaps could not be saved with it.
+ */
+int sf_arena_tag_pin(sf_arena *arena, unsigned int tag, bool pin);
+
+/*
+ * sf_get_stats() on the heap of the given arena.
+ */
+void sf_arena_get_stats(sf_arena *arena, struct sf_stats *stats);
+
+/*
+ * sf_heap_frag() on the heap of the given arena.
+ */
+int sf_arena_heap_frag(sf_arena *arena, struct sf_frag_report *report);
+
+/*
+ * sf_set_frlst_order() on the heap of the given arena.  Every arena starts in
+ * SF_ORDER_LIFO, and a persistent heap keeps its order across sf_heap_close().
+ */
+int sf_arena_set_frlst_order(sf_arena *arena, int order);
+
+/*
+ * sf_set_wilderness() on the heap of the given arena.
+ */
+int sf_arena_set_wilderness(sf_arena *arena, bool enable);
+
+/*
+ * sf_internal_fragmentation() on the heap of the given arena.
+ */
+double sf_arena_internal_fragmentation(sf_arena *arena);
+
+/*
+ * sf_peak_utilization() on the heap of the given arena.
+ */
+double sf_arena_peak_utilization(sf_arena *arena);
+
+/*
+ * Destroy an arena and every block in it, without visiting the blocks.  All pointers
+ * into the arena become invalid.
+ *
+ * @param arena  The arena to destroy.  If it is NULL, nothing happens.
+ */
+void sf_arena_destroy(sf_arena *arena);
+
+/*
+ * Set or get the root object of an arena: the one pointer a program needs to find
+ * its data again after reopening a persistent heap.
+ */
+void sf_arena_set_root(sf_arena *arena, void *root);
+void *sf_arena_get_root(sf_arena *arena);
+
+/*
+ * A persistent heap is an arena whose mapping is a shared mapping of a file.  The
+ * arena itself (free lists, quick lists, statistics and root) is stored at the start
+ * of the file, and the heap pages follow it, so reopening the file restores the heap
+ * exactly as it was, without rebuilding anything.
+ *
+ * The file records the MAGIC its headers were written with, and sf_heap_open()
+ * re-obfuscates them with the MAGIC of the opening process, so a heap can be reopened by
+ * another process.
+ *
+ * Block links are stored as addresses, so the file is always mapped back at the
+ * address it was created at (the map is placed with MAP_FIXED_NOREPLACE, never over
+ * another mapping).  If that address range is in use, the heap cannot be opened and
+ * sf_heap_open() fails with ENOMEM.  With address space layout randomization, this
+ * happens whenever the opening process has a library, stack or mapping where the
+ * creating process had the heap, so persistent heaps should be opened early, before
+ * other large mappings are made, and the caller must be prepared for ENOMEM.
+ *
+ * Crash consistency: the file is only guaranteed to be consistent after
+ * sf_heap_close().  Opening a heap marks the file dirty, and a file that is still
+ * dirty (because the process crashed or exited without closing it) is refused by
+ * sf_heap_open().  sf_heap_sync() writes the current state to the file, but does not
+ * make it openable after a crash.
+ */
+
+/*
+ * Open a persistent heap, creating it if the file is empty or does not exist.
+ *
+ * @param path  The file holding the heap.
+ * @param capacity  The capacity of a new heap, as for sf_arena_create().  It is
+ * ignored when an existing heap is opened.
+ *
+ * @return The heap, to be used with the arena-scoped calls.  If the file cannot be
+ * opened, is not a heap, or was not closed cleanly, NULL is returned and sf_errno is
+ * set to EINVAL.  If it cannot be mapped at its address, NULL is returned and sf_errno
+ * is set to ENOMEM.
+ */
+sf_arena *sf_heap_open(const char *path, size_t capacity);
+
+/*
+ * Write the contents of a persistent heap to its file.
+ *
+ * @return 0 on success, -1 if the arena is not a persistent heap or the write fails.
+ */
+int sf_heap_sync(sf_arena *arena);
+
+/*
+ * Write a persistent heap to its file, mark the file clean, and unmap the heap.
+ *
+ * @return 0 on success, -1 if the arena is not a persistent heap or the write fails.
+ */
+int sf_heap_close(sf_arena *arena);
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef SFHEAPMAP_H
+#define SFHEAPMAP_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include "sfmm.h"
+
+/*
+ * Machine-readable heap maps and fragmentation analysis.
+ *
+ * A heap map lists every block between the prologue and the epilogue, in address
+ * order.  Maps are built by walking block headers, without taking memory from the
+ * heap, so taking a map does not change what it describes.
+ *
+ * Map file format (all fields in host byte order): an sf_heap_map_header, followed
+ * by nblocks sf_heap_map_entry records.  bin/sfmm_mapdiff compares two map files.
+ */
+
+/* Identifies a heap map file ("sfmmhmap"). */
+#define SF_HEAP_MAP_MAGIC 0x70616d686d6d6673ULL
+#define SF_HEAP_MAP_VERSION 1
+
+/* Block states. */
+#define SF_BLOCK_ALLOC	0
+#define SF_BLOCK_FREE	1
+#define SF_BLOCK_QUICK	2
+
+typedef struct sf_heap_map_header {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t entry_size;		// sizeof(sf_heap_map_entry).
+	uint64_t heap_start;		// Address of the heap start.
+	uint64_t heap_size;		// Bytes from the heap start to the heap end.
+	uint64_t nblocks;
+} sf_heap_map_header;
+
+typedef struct sf_heap_map_entry {
+	uint64_t offset;		// Block address (its prev_footer field) minus the heap start.
+	uint32_t size;			// Block size.
+	uint32_t payload;		// Payload size, 0 unless allocated.
+	uint32_t state;			// SF_BLOCK_ALLOC, SF_BLOCK_FREE or SF_BLOCK_QUICK.
+	uint32_t unused;
+} sf_heap_map_entry;
+
+/* Number of buckets in the gap histogram: bucket i counts gaps of [2^i, 2^(i+1)) bytes. */
+#define SF_GAP_BUCKETS 32
+
+/*
+ * Fragmentation of the heap.  A gap is a maximal run of adjacent blocks that are not
+ * allocated (free blocks and quick list blocks) between two allocated blocks.
+ */
+struct sf_frag_report {
+	uint64_t heap_bytes;
+	uint64_t alloc_blocks;
+	uint64_t alloc_bytes;
+	uint64_t payload_bytes;
+	uint64_t quick_blocks;
+	uint64_t quick_bytes;
+	uint64_t free_blocks[NUM_FREE_LISTS];	// Free blocks by the class of sf_free_list_heads they belong in.
+	uint64_t free_bytes[NUM_FREE_LISTS];
+	uint64_t total_free_bytes;		// Free and quick list bytes.
+	uint64_t largest_free_block;		// Largest free or quick list block.
+	uint64_t largest_gap;
+	uint64_t gaps[SF_GAP_BUCKETS];		// Gap size histogram.
+	double external_fragmentation;		// 1 - largest_free_block / total_free_bytes, 0 if nothing is free.
+};
+
+/*
+ * Walk the heap and describe its blocks.
+ *
+ * @param entries  The array to fill in, in address order.  May be NULL if max_entries is 0.
+ * @param max_entries  The number of entries the array has room for.
+ *
+ * @return The number of blocks in the heap, which may be larger than max_entries; only
+ * the first max_entries are filled in.  0 is returned if the heap is not initialized.
+ * If a block header is corrupt, -1 is returned and sf_errno is set to EINVAL.
+ */
+ssize_t sf_heap_map(sf_heap_map_entry *entries, size_t max_entries);
+
+/*
+ * Write a heap map file.  The map is streamed, so no memory is needed for it.
+ *
+ * @param fd  A file descriptor open for writing.
+ *
+ * @return 0 on success.  If a block header is corrupt, -1 is returned and sf_errno is
+ * set to EINVAL.  If a write fails, -1 is returned and sf_errno is set to EIO.
+ */
+int sf_heap_map_write(int fd);
+
+/*
+ * Compute the fragmentation report of a heap map.
+ *
+ * @param entries  The map, in address order.
+ * @param nblocks  The number of entries.
+ * @param report  The report to fill in.
+ */
+void sf_heap_map_analyze(const sf_heap_map_entry *entries, size_t nblocks, struct sf_frag_report *report);
+
+/*
+ * Walk the heap and compute its fragmentation report.
+ *
+ * @return 0 on success.  If a block header is corrupt, -1 is returned and sf_errno is
+ * set to EINVAL.
+ */
+int sf_heap_frag(struct sf_frag_report *report);
+
+#endif
@@ -3,13 +3,47 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include "sfstats.h"
 
 #define SF_MIN_BLOCK_SIZE	32
 #define SF_ALIGN_SIZE		16
 
-double total_payload_size;
-double total_allocated_block_size;
-double max_aggregate_payload;
+/* Sub-heaps for lifetime-hinted blocks (see sfhint.h), one per hint other than none. */
+#define SF_NUM_HINT_HEAPS	2
+
+/* A quick list, laid out like the entries of sf_quick_lists. */
+typedef struct sf_quick_list {
+	int length;
+	struct sf_block *first;
+} sf_quick_list;
+
+/* Everything the allocator keeps for one heap.  The functions below always work on
+   sf_cur_heap, which is sf_main_heap (the sfutil heap) unless an arena call has
+   switched it for the duration of the call. */
+typedef struct sf_heap {
+	sf_block *free_list_heads;		// NUM_FREE_LISTS list headers.
+	sf_quick_list *quick_lists;		// NUM_QUICK_LISTS quick lists.
+	struct sf_stats stats;			// Event counters and payload totals.
+	char *base;				// Start of the heap's own pages, NULL for the sfutil heap.
+	char *top;				// End of the pages grown so far (own pages only).
+	char *limit;				// End of the reserved address range (own pages only).
+	size_t released_bytes;			// Bytes below the top given back by sf_trim().
+	int frlst_order;			// SF_ORDER_LIFO or SF_ORDER_ADDRESS.
+	struct sf_frlst_index *frlst_index;	// Ordered index of the free lists, or NULL.
+	bool wilderness;			// Keep the top block off the free lists.
+	size_t grow_pages;			// Size of the next SF_GROW_GEOMETRIC growth, 0 to start over.
+	uint64_t grow_mark;			// Bytes allocated up to the last SF_GROW_RATE growth.
+	struct sf_arena *hint_heaps[SF_NUM_HINT_HEAPS];	// Sub-heaps of SF_HINT_SHORT and SF_HINT_LONG.
+	bool sub_heaps;				// A sub-heap has been created; until then sf_free() and
+						// sf_realloc() do not look for one.
+	struct sf_tag_table *tags;		// Tags of the blocks (see sftag.h), or NULL.
+} sf_heap;
+
+extern sf_heap sf_main_heap;
+extern sf_heap *sf_cur_heap;
+
+/* The heap of an arena, for the modules that switch sf_cur_heap to it themselves. */
+sf_heap *sf_arena_heap(struct sf_arena *arena);
 
 sf_header *get_hdrp(sf_block *bp);
 sf_footer *get_ftrp(sf_block *bp);
@@ -38,13 +72,34 @@ int init_heap_and_lists();
 
 sf_block *sf_qklst_remove(sf_size_t payload_size, sf_size_t block_size);
 
+int sf_frlst_index(sf_size_t block_size);
 sf_block *sf_frlst_remove(sf_size_t payload_size, sf_size_t block_size);
 
 int sf_qklst_insert(sf_block *block_ptr);
 
+/* Link a block into free list findex (at the head, or in address order), and unlink it.
+   Every change to the free lists goes through these, so the ordered index stays valid. */
+void sf_frlst_link(sf_block *block_ptr, int findex);
+void sf_frlst_unlink(sf_block *block_ptr);
+
+/* Rebuild the free lists of the current heap in address order. */
+void sf_frlst_reorder();
+void sf_frlst_index_clear();
+void sf_frlst_index_drop();
+
+/* The free block in front of the epilogue when the heap keeps a wilderness, else NULL. */
+sf_block *sf_wilderness();
+/* Take the wilderness off its free list, after the lists were rebuilt with it. */
+void sf_wilderness_detach();
+
 int sf_frlst_insert(sf_block *block_ptr);
 
+/* Re-obfuscate every header, free block footer and the epilogue of the current heap,
+   written with old_magic, with the current MAGIC. */
+void sf_heap_remagic(sf_header old_magic);
+
 sf_block *split_block(sf_block *block_ptr, sf_size_t new_payload_size, sf_size_t new_block_size);
+sf_block *split_block_upper(sf_block *block_ptr, sf_size_t new_payload_size, sf_size_t new_block_size);
 
 sf_block *coalesce_block(sf_block *block_ptr);
 
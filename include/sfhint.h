@@ -0,0 +1,60 @@
+#ifndef SFHINT_H
+#define SFHINT_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "sfmm.h"
+#include "sfstats.h"
+#include "sfarena.h"
+
+/*
+ * Lifetime-hinted allocation.  A caller that knows whether a block will be short-lived
+ * or long-lived says so, and each lifetime group is placed in a sub-heap of its own,
+ * with its own pages and free lists.  Long-lived blocks then never end up between
+ * short-lived ones, where they would keep the holes the short-lived ones leave behind
+ * from coalescing.
+ *
+ * The sub-heaps belong to the heap the call is made on (the sfutil heap, or an arena
+ * for sf_arena_malloc_hint()), and are created on first use with the free-list order
+ * and wilderness mode of that heap.  sf_free() and sf_realloc() on the parent heap
+ * find the sub-heap of a hinted block by its address, so hinted blocks are freed and
+ * resized like any other; a realloc keeps the block in its group.
+ *
+ * Hinted blocks are not part of the parent heap: sf_get_stats(), sf_heap_snapshot() and
+ * the other whole-heap calls do not see them.  Hints are ignored on persistent heaps.
+ */
+#define SF_HINT_NONE	0
+#define SF_HINT_SHORT	1
+#define SF_HINT_LONG	2
+
+/* Reserved size of a sub-heap of the sfutil heap.  Sub-heaps of an arena get the
+   capacity of the arena. */
+#define SF_HINT_HEAP_CAPACITY ((size_t)1 << 30)
+
+/*
+ * Allocate a block in the sub-heap of a lifetime group.
+ *
+ * @param size  The number of bytes requested to be allocated.
+ * @param hint  SF_HINT_SHORT or SF_HINT_LONG.  SF_HINT_NONE is plain sf_malloc().
+ *
+ * @return As for sf_malloc().  If the hint is unknown, NULL is returned and sf_errno is
+ * set to EINVAL.
+ */
+void *sf_malloc_hint(sf_size_t size, int hint);
+
+/*
+ * Fill in the statistics of the sub-heap of a lifetime group, or of the heap itself
+ * for SF_HINT_NONE.  Every field is 0 if the sub-heap has not been used.
+ *
+ * @return 0 on success.  If the hint is unknown, -1 is returned and sf_errno is set to
+ * EINVAL.
+ */
+int sf_hint_get_stats(int hint, struct sf_stats *stats);
+
+/*
+ * @return The sub-heap of the current heap that ptr lies in, or NULL if ptr is not
+ * in any of them.
+ */
+sf_arena *sf_hint_owner(void *ptr);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef SFLATENCY_H
+#define SFLATENCY_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "sfmm.h"
+#include "sfstats.h"
+
+/*
+ * Instrumentation of the public calls: latency histograms, compiled in with
+ * -DSF_LATENCY, and the event tracer (sftrace.h), compiled in with -DSF_TRACE.
+ *
+ * When either is compiled in, sfmm.c defines the allocator as sf_malloc_untimed(),
+ * sf_free_untimed() and sf_realloc_untimed(), and sflatency.c defines sf_malloc(),
+ * sf_free() and sf_realloc() as wrappers that time and/or trace them.  sf_memalign()
+ * (sfalign.c) is wrapped the same way and recorded as a malloc of the aligned block.
+ * sf_realloc() and sf_memalign() call the untimed functions, so a call is only
+ * recorded once.  When both are
+ * compiled out, SF_UNTIMED() leaves the names alone and nothing is added to the
+ * allocator calls.
+ */
+
+#if defined(SF_LATENCY) || defined(SF_TRACE)
+#define SF_INSTRUMENTED
+#endif
+
+#ifdef SF_INSTRUMENTED
+#define SF_UNTIMED(name) name##_untimed
+void *sf_malloc_untimed(sf_size_t size);
+void sf_free_untimed(void *ptr);
+void *sf_realloc_untimed(void *ptr, sf_size_t size);
+void *sf_memalign_untimed(sf_size_t align, sf_size_t size);
+#else
+#define SF_UNTIMED(name) name
+#endif
+
+/* Histogram layout: 2^SF_LATENCY_SUB_BITS linear sub-buckets per power of two, up to
+   2^(SF_LATENCY_MAX_EXP+1) ns (about a minute).  Longer calls go in the last bucket. */
+#define SF_LATENCY_SUB_BITS	4
+#define SF_LATENCY_SUB_BUCKETS	(1 << SF_LATENCY_SUB_BITS)
+#define SF_LATENCY_MAX_EXP	35
+#define SF_LATENCY_BUCKETS	((SF_LATENCY_MAX_EXP - SF_LATENCY_SUB_BITS + 2) * SF_LATENCY_SUB_BUCKETS)
+
+#endif
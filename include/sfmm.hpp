@@ -0,0 +1,130 @@
+#ifndef SFMM_HPP
+#define SFMM_HPP
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <new>
+
+/*
+ * C++ adapters for sfmm: sfmm::memory_resource, a std::pmr::memory_resource, and
+ * sfmm::allocator<T>, a standard allocator on top of it.
+ *
+ * Allocations take sf_memalign() (which is sf_malloc() for alignments of 16 or less),
+ * and deallocations take sf_free_sized(), since both std::pmr and the standard allocator
+ * hand the size back.  A resource works on the sfutil heap, or on an arena it is given
+ * (and does not own).  Like the allocator itself, the adapters are not thread-safe.
+ *
+ * sfmm.h defines sf_errno and the list heads instead of declaring them, so it cannot be
+ * included from C++ code that is linked with sfutil.o.  The few functions needed here are
+ * declared below instead.
+ */
+
+extern "C" {
+typedef uint32_t sf_size_t;
+typedef struct sf_arena sf_arena;
+
+void *sf_memalign(sf_size_t align, sf_size_t size);
+void sf_free_sized(void *pp, sf_size_t size);
+sf_arena *sf_arena_create(size_t capacity);
+void *sf_arena_memalign(sf_arena *arena, sf_size_t align, sf_size_t size);
+void sf_arena_free_sized(sf_arena *arena, void *ptr, sf_size_t size);
+void sf_arena_destroy(sf_arena *arena);
+}
+
+namespace sfmm {
+
+class memory_resource : public std::pmr::memory_resource {
+public:
+	/* Allocate from the sfutil heap, or from the given arena. */
+	explicit memory_resource(sf_arena *arena = nullptr) noexcept : arena_(arena) {}
+
+	sf_arena *arena() const noexcept { return arena_; }
+
+protected:
+	/* Requests sfmm cannot express, or cannot satisfy, throw std::bad_alloc. */
+	void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+		bytes = request_size(bytes);
+		if(bytes > max_request || alignment > max_request)
+			throw std::bad_alloc();
+		if(alignment < min_alignment)
+			alignment = min_alignment;
+
+		void *pp;
+		if(arena_ != nullptr)
+			pp = sf_arena_memalign(arena_, (sf_size_t)alignment, (sf_size_t)bytes);
+		else
+			pp = sf_memalign((sf_size_t)alignment, (sf_size_t)bytes);
+		if(pp == nullptr)
+			throw std::bad_alloc();
+		return pp;
+	}
+
+	void do_deallocate(void *pp, std::size_t bytes, std::size_t) override {
+		bytes = request_size(bytes);
+		if(arena_ != nullptr)
+			sf_arena_free_sized(arena_, pp, (sf_size_t)bytes);
+		else
+			sf_free_sized(pp, (sf_size_t)bytes);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+		const memory_resource *sf_other = dynamic_cast<const memory_resource *>(&other);
+		return sf_other != nullptr && sf_other->arena_ == arena_;
+	}
+
+private:
+	static constexpr std::size_t min_alignment = 16;
+	static constexpr std::size_t max_request = std::numeric_limits<sf_size_t>::max();
+
+	/* sf_malloc(0) returns NULL, so empty requests take one byte. */
+	static std::size_t request_size(std::size_t bytes) noexcept { return (bytes == 0) ? 1 : bytes; }
+
+	sf_arena *arena_;
+};
+
+/* The resource for the sfutil heap. */
+inline memory_resource *heap_resource() noexcept {
+	static memory_resource resource;
+	return &resource;
+}
+
+template <class T>
+class allocator {
+public:
+	using value_type = T;
+
+	allocator() noexcept : resource_(heap_resource()) {}
+	explicit allocator(memory_resource *resource) noexcept : resource_(resource) {}
+	template <class U>
+	allocator(const allocator<U> &other) noexcept : resource_(other.resource()) {}
+
+	T *allocate(std::size_t n) {
+		if(n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+			throw std::bad_array_new_length();
+		return static_cast<T *>(resource_->allocate(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T *pp, std::size_t n) noexcept {
+		resource_->deallocate(pp, n * sizeof(T), alignof(T));
+	}
+
+	memory_resource *resource() const noexcept { return resource_; }
+
+private:
+	memory_resource *resource_;
+};
+
+template <class T, class U>
+bool operator==(const allocator<T> &a, const allocator<U> &b) noexcept {
+	return a.resource()->is_equal(*b.resource());
+}
+
+template <class T, class U>
+bool operator!=(const allocator<T> &a, const allocator<U> &b) noexcept {
+	return !(a == b);
+}
+
+}
+
+#endif
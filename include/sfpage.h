@@ -0,0 +1,182 @@
+#ifndef SFPAGE_H
+#define SFPAGE_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "sfmm.h"
+
+/*
+ * The page source sits between the allocator and sf_mem_grow().  The heap provided by
+ * sfutil can only ever move its end forward, so pages given back by sf_trim() are not
+ * returned to sfutil.  Instead, they are dropped from the heap (the epilogue is moved
+ * down in front of them), their physical memory is released with madvise(MADV_DONTNEED),
+ * and they are handed out again by sf_page_grow() before sf_mem_grow() is asked for more.
+ *
+ * NOTE: sf_mem_end() keeps reporting the end of the sfutil heap.  The end of the heap
+ * the allocator actually manages (the address just past the epilogue) is sf_heap_end().
+ */
+
+/* Default free tail size above which sf_free() trims the heap automatically.  It is a
+   third of the 24-page sfutil heap, so the default heap does get trimmed. */
+#define SF_DEFAULT_TRIM_THRESHOLD ((size_t)8 * PAGE_SZ)
+
+/* Number of bytes an automatic trim leaves in the free tail, to avoid growing right back. */
+#define SF_TRIM_PAD ((size_t)PAGE_SZ)
+
+/*
+ * @return The starting address of the heap the allocator is currently working on.
+ * This is sf_mem_start(), unless an arena call is in progress.
+ */
+void *sf_heap_start();
+
+/*
+ * @return The ending address of the heap the allocator is currently working on,
+ * which is the address just past the epilogue.
+ */
+void *sf_heap_end();
+
+/* Size of a transparent huge page, and the growth unit when huge pages are enabled. */
+#define SF_HUGE_PAGE_SZ ((size_t)2 * 1024 * 1024)
+
+/*
+ * Add one page of memory to the end of the heap.  Pages previously released by
+ * sf_trim() are reused first; otherwise the page is obtained from sf_mem_grow().
+ *
+ * @return On success, a pointer to the start of the additional page, which is the
+ * value sf_heap_end() returned before the call.  On error, NULL is returned.
+ */
+void *sf_page_grow();
+
+/*
+ * Give back the pages at the end of the heap, as sf_trim() does: they are counted as
+ * released, for sf_page_grow() to reuse, and their memory is returned to the system
+ * with madvise(MADV_DONTNEED).  The caller writes the new epilogue.
+ *
+ * @param bytes  The number of bytes to release, a multiple of PAGE_SZ.
+ */
+void sf_page_release(size_t bytes);
+
+/*
+ * Heap growth policies, deciding how many pages each growth of the heap adds.
+ *
+ *   SF_GROW_FIXED      pages pages every time (the default, with 1 page).
+ *   SF_GROW_GEOMETRIC  pages pages the first time, then twice as many as the previous
+ *                      growth of the same heap, up to max_pages.
+ *   SF_GROW_RATE       Enough pages for the bytes allocated since the previous growth of
+ *                      the same heap, at least pages and at most max_pages.  A program
+ *                      allocating quickly gets large growths, a steady one small ones.
+ *
+ * When huge pages are enabled, the number of pages is rounded up to whole huge pages.
+ */
+#define SF_GROW_FIXED		0
+#define SF_GROW_GEOMETRIC	1
+#define SF_GROW_RATE		2
+
+struct sf_grow_policy {
+	int kind;				// SF_GROW_FIXED, SF_GROW_GEOMETRIC or SF_GROW_RATE.
+	size_t pages;				// Pages per growth, or the smallest growth.
+	size_t max_pages;			// Largest growth (ignored by SF_GROW_FIXED).
+};
+
+/*
+ * Set the heap growth policy, for all heaps.
+ *
+ * @param policy  The new policy.
+ *
+ * @return 0 on success.  If the kind is unknown, pages is 0, or max_pages is less than
+ * pages for a policy that uses it, -1 is returned, sf_errno is set to EINVAL and the
+ * policy is left unchanged.
+ */
+int sf_set_grow_policy(const struct sf_grow_policy *policy);
+
+/*
+ * @param policy  Filled in with the current heap growth policy.
+ */
+void sf_get_grow_policy(struct sf_grow_policy *policy);
+
+/*
+ * Grow the heap by one growth unit, as set by the growth policy.  If the page source
+ * runs out part way, the pages obtained so far are kept.  When huge pages are enabled,
+ * every huge-page-aligned huge page lying entirely inside the heap is marked with
+ * madvise(MADV_HUGEPAGE).  The bytes added are counted in sf_stats.grow_bytes.
+ *
+ * @return On success, the value sf_heap_end() returned before the call.  If not even
+ * one page could be obtained, NULL is returned.
+ */
+void *sf_page_grow_chunk();
+
+/*
+ * Turn huge-page aware growth on or off.  It is off by default.
+ *
+ * The heap of an arena created by sf_arena_create() starts on a huge page, so with the
+ * option on it grows in whole, aligned huge pages, and all of it is covered.
+ *
+ * NOTE: The heap provided by sfutil and persistent heaps are not huge-page aligned, and
+ * the sfutil heap is much smaller than a huge page, so on these heaps the option mostly
+ * changes the growth unit.
+ *
+ * @param enable  true to grow in huge page multiples and apply MADV_HUGEPAGE.
+ */
+void sf_set_huge_pages(bool enable);
+
+/*
+ * Shrink the heap by releasing the free block adjacent to the epilogue back to the
+ * page source, in whole pages.  The epilogue is rewritten at the new end of the heap,
+ * and whatever remains of the free block (if anything) is put back on a free list.
+ *
+ * @param keep_bytes  The number of bytes of the free tail to keep in the heap.
+ *
+ * @return The number of bytes released.  If the last block of the heap is allocated,
+ * or the free tail is not larger than keep_bytes by at least one page, 0 is returned
+ * and the heap is left unchanged.
+ */
+size_t sf_trim(size_t keep_bytes);
+
+/*
+ * Set the size of the free tail above which sf_free() calls sf_trim() automatically,
+ * keeping SF_TRIM_PAD bytes.  Setting the threshold to 0 disables automatic trimming.
+ *
+ * @param threshold  The new trim threshold in bytes.
+ */
+void sf_set_trim_threshold(size_t threshold);
+
+/*
+ * Called by sf_free() once a block has been returned to the free lists.  Trims the
+ * heap if the free tail has grown above the trim threshold.
+ */
+void sf_trim_if_needed();
+
+/*
+ * Release the physical memory behind the interior of large free blocks with
+ * madvise(MADV_DONTNEED).  Only the system pages lying entirely between the free
+ * list links and the footer of a block are released, so the header, the links and
+ * the footer stay intact.  The released memory reads as zero when next touched.
+ *
+ * @param min_block_size  Only free blocks of at least this size are scavenged.
+ *
+ * @return The number of bytes released, counting only pages that were resident.
+ */
+size_t sf_scavenge(size_t min_block_size);
+
+/*
+ * Make sf_free() run sf_scavenge() on its own.  The allocator is not thread-safe,
+ * so the scavenger runs from allocator calls rather than from a background thread.
+ *
+ * @param min_block_size  The block size passed to sf_scavenge().
+ * @param interval  Scavenge once every interval calls to sf_free().  Setting the
+ * interval to 0 (the default) disables automatic scavenging.
+ */
+void sf_set_scavenge(size_t min_block_size, unsigned int interval);
+
+/*
+ * Called by sf_free() after sf_trim_if_needed().  Scavenges the free lists once
+ * every scavenge interval.
+ */
+void sf_scavenge_if_needed();
+
+/*
+ * @return The total number of bytes released by sf_scavenge() so far.
+ */
+size_t sf_scavenged_bytes();
+
+#endif
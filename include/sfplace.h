@@ -0,0 +1,111 @@
+#ifndef SFPLACE_H
+#define SFPLACE_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "sfmm.h"
+
+/*
+ * Placement policy: how sf_malloc() picks a block from the free lists.  The search always
+ * starts at the size class of the request and moves to larger classes until a class holds
+ * a block that fits; the policy decides which fitting block of that class is taken.
+ *
+ *   SF_FIT_FIRST  The first block that fits (the default).
+ *   SF_FIT_BEST   The smallest block that fits.  The whole class is scanned unless an
+ *                 exact fit turns up.  Every block in a larger class is larger, so this
+ *                 is the best fit over all the free lists.
+ *   SF_FIT_GOOD   The smallest of the first K blocks that fit, where K is the probe limit.
+ *
+ * Every block looked at counts as a probe in sf_stats.probes.
+ */
+#define SF_FIT_FIRST	0
+#define SF_FIT_BEST	1
+#define SF_FIT_GOOD	2
+
+/* Default number of fitting blocks SF_FIT_GOOD compares. */
+#define SF_DEFAULT_GOOD_FIT_PROBES 8
+
+/*
+ * Set the placement policy.
+ *
+ * @param policy  SF_FIT_FIRST, SF_FIT_BEST or SF_FIT_GOOD.
+ * @param max_fits  For SF_FIT_GOOD, the number of fitting blocks to compare (K).  0
+ * selects SF_DEFAULT_GOOD_FIT_PROBES.  Ignored by the other policies.
+ *
+ * @return 0 on success.  If the policy is unknown, -1 is returned, sf_errno is set to
+ * EINVAL and the policy is left unchanged.
+ */
+int sf_set_fit_policy(int policy, unsigned int max_fits);
+
+/*
+ * @return The current placement policy.
+ */
+int sf_get_fit_policy();
+
+/*
+ * Split direction.  When sf_malloc() takes a free block larger than it needs, the block
+ * is split and the request normally gets the lower part.  With a split threshold set,
+ * requests whose block size is at least the threshold get the upper part instead, so
+ * small blocks gather at the low end of free space and large ones at the high end, and
+ * small long-lived blocks are less likely to pin the hole a large block leaves behind.
+ * The wilderness is always split from the bottom.
+ *
+ * @param threshold  Block size from which requests take the upper part; 0 (the
+ * default) turns the rule off.
+ */
+void sf_set_split_threshold(sf_size_t threshold);
+
+/*
+ * @return The current split threshold.
+ */
+sf_size_t sf_get_split_threshold();
+
+/*
+ * Free-list order: where a block freed into a free list goes.
+ *
+ *   SF_ORDER_LIFO     At the head of its list (the default).
+ *   SF_ORDER_ADDRESS  In address order.  Every list is kept sorted by address, so first
+ *                     fit takes the lowest block that fits, and the end of the heap tends
+ *                     to stay free for sf_trim().  Each heap in this mode keeps an index
+ *                     of its lists, so an insertion only walks the few blocks of its
+ *                     class near the block instead of the whole list.
+ */
+#define SF_ORDER_LIFO		0
+#define SF_ORDER_ADDRESS	1
+
+/*
+ * Set the free-list order of the current heap.  Switching to SF_ORDER_ADDRESS sorts the
+ * free lists of the heap as it is.
+ *
+ * @param order  SF_ORDER_LIFO or SF_ORDER_ADDRESS.
+ *
+ * @return 0 on success.  If the order is unknown, -1 is returned and sf_errno is set to
+ * EINVAL; if the index cannot be created, -1 is returned and sf_errno is set to ENOMEM.
+ * The order is left unchanged in both cases.
+ */
+int sf_set_frlst_order(int order);
+
+/*
+ * @return The free-list order of the current heap.
+ */
+int sf_get_frlst_order();
+
+/*
+ * Wilderness mode: keep the free block at the end of the heap (the top block) off the
+ * free lists.  sf_malloc() carves from it only when no other free block fits, and
+ * growing the heap extends it in place.  That keeps the end of the heap in one piece,
+ * to be extended or given back by sf_trim().  The mode is off by default.
+ *
+ * @param enable  true to turn wilderness mode on for the current heap, false to turn it
+ * off.  The top block leaves its free list or goes back on it right away.
+ *
+ * @return 0.
+ */
+int sf_set_wilderness(bool enable);
+
+/*
+ * @return true if the current heap is in wilderness mode.
+ */
+bool sf_get_wilderness();
+
+#endif
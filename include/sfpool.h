@@ -0,0 +1,97 @@
+#ifndef SFPOOL_H
+#define SFPOOL_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "sfmm.h"
+
+/*
+ * A pool hands out objects of one fixed size.  It takes large chunks from the heap
+ * with sf_malloc() and cuts them into equal slots with no per-object header.  Free
+ * slots are kept on an intrusive singly linked list (the link is stored in the slot
+ * itself), so sf_pool_alloc() and sf_pool_free() are a single pop or push.
+ *
+ * Like the rest of the allocator, a pool is not thread-safe, unless it has per-thread
+ * caches (see sf_pool_set_thread_cache()).
+ */
+typedef struct sf_pool sf_pool;
+
+/* Payload size of the chunks a pool takes from the heap (a 4-page block). */
+#define SF_POOL_CHUNK_SIZE ((sf_size_t)(4 * PAGE_SZ - 2 * sizeof(sf_header)))
+
+/*
+ * Create an empty pool.
+ *
+ * @param object_size  The size of every object in the pool.
+ * @param alignment  The alignment of every object, a power of two.  If it is 0, objects
+ * are aligned like blocks from sf_malloc().
+ *
+ * @return The new pool.  If object_size is 0 or alignment is not a power of two, NULL
+ * is returned and sf_errno is set to EINVAL.  If the pool cannot be allocated, NULL is
+ * returned and sf_errno is set to ENOMEM.
+ */
+sf_pool *sf_pool_create(size_t object_size, size_t alignment);
+
+/*
+ * Take one object from the pool, growing it by one chunk if it has no free slot.
+ *
+ * @return The object, or NULL with sf_errno set to ENOMEM if a chunk cannot be allocated.
+ */
+void *sf_pool_alloc(sf_pool *pool);
+
+/*
+ * Return one object to the pool.
+ *
+ * @param ptr  An object returned by sf_pool_alloc() on the same pool.  If it is NULL,
+ * the function calls abort() to exit the program.
+ */
+void sf_pool_free(sf_pool *pool, void *ptr);
+
+/* Largest number of threads with a cache in one pool.  Further threads go to the
+   shared free list directly, under the pool lock. */
+#define SF_POOL_MAX_THREADS 64
+
+/*
+ * Give every thread using the pool a cache (a magazine) of up to magazine_size free
+ * slots in front of the shared free list, and make the pool safe to share between
+ * threads.  sf_pool_alloc() and sf_pool_free() then pop and push the calling thread's
+ * magazine without locking.  Only when the magazine is empty or full does the thread
+ * take the pool lock, to move half a magazine from or to the shared free list.
+ *
+ * New chunks are still taken from the heap with sf_malloc(), under the pool lock.  As the
+ * heap is not thread-safe, no other thread may use the heap while a pool might grow;
+ * sf_pool_reserve() grows the pool up front to avoid that.
+ *
+ * Must be called while no other thread is using the pool.  Setting the size to 0 puts
+ * every cached slot back on the shared free list and makes the pool single-threaded again.
+ *
+ * @param magazine_size  The largest number of slots a thread keeps, or 0.
+ *
+ * @return 0 on success.  If magazine_size is 1, -1 is returned and sf_errno is set to
+ * EINVAL, as a magazine must hold at least two slots.  If the magazines cannot be
+ * allocated, -1 is returned and sf_errno is set to ENOMEM.
+ */
+int sf_pool_set_thread_cache(sf_pool *pool, unsigned int magazine_size);
+
+/*
+ * Return the calling thread's cached slots to the shared free list.  A thread that is
+ * about to exit calls it, so its slots can be used by other threads.
+ */
+void sf_pool_flush_thread_cache(sf_pool *pool);
+
+/*
+ * Grow the pool until its shared free list holds at least count slots.
+ *
+ * @return 0 on success, or -1 with sf_errno set to ENOMEM if a chunk cannot be allocated.
+ */
+int sf_pool_reserve(sf_pool *pool, size_t count);
+
+/*
+ * Destroy a pool, returning every chunk to the heap with sf_free() without visiting
+ * the objects.  All objects from the pool become invalid.
+ *
+ * @param pool  The pool to destroy.  If it is NULL, nothing happens.
+ */
+void sf_pool_destroy(sf_pool *pool);
+
+#endif
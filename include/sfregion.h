@@ -0,0 +1,49 @@
+#ifndef SFREGION_H
+#define SFREGION_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "sfmm.h"
+
+/*
+ * The region is a bump allocator for objects that all die at the same time.  It hands
+ * out memory by moving a pointer forward over pages grown inside its own address range,
+ * with no headers, no lists and no splitting.  Individual blocks are never freed:
+ * sf_free() on a region pointer does nothing, and sf_region_reset() takes the whole
+ * region back in one step.  The region does not use the heap, so both can be used side
+ * by side.
+ */
+
+/* Size of the address range reserved for the region on first use. */
+#define SF_REGION_CAPACITY ((size_t)64 * 1024 * 1024)
+
+/*
+ * Allocate memory from the region.  The returned pointer is aligned to a two-row
+ * (16-byte) boundary.
+ *
+ * @param size The number of bytes requested to be allocated.
+ *
+ * @return If size is 0, then NULL is returned without setting sf_errno.  If the region
+ * is full, NULL is returned and sf_errno is set to ENOMEM.
+ */
+void *sf_region_malloc(sf_size_t size);
+
+/*
+ * Resize a region block.  A new block is always taken from the region, and as much of
+ * the old block as fits is copied into it.
+ *
+ * @return The new block, or NULL with sf_errno set to ENOMEM if the region is full.
+ */
+void *sf_region_realloc(void *ptr, sf_size_t size);
+
+/*
+ * Free every block in the region at once.  Pages already grown are kept for reuse.
+ */
+void sf_region_reset();
+
+/*
+ * @return true if ptr points into memory handed out by the region since the last reset.
+ */
+bool sf_region_owns(void *ptr);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef SFSNAP_H
+#define SFSNAP_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "sfmm.h"
+
+/*
+ * A snapshot is a compact, streaming copy of the heap: its pages, the order of every
+ * free list and quick list, and the payload/utilization statistics.  The interior of
+ * each free block (its links and unused space) is not written; the links are rebuilt
+ * from the list order on restore.
+ *
+ * Format (all fields in host byte order):
+ *   - a header with the heap size, heap address, magic number and statistics;
+ *   - runs of heap bytes, each an {offset, length} pair followed by the bytes,
+ *     ended by a run of length 0;
+ *   - for each free list, then each quick list: a block count and the offsets of the
+ *     blocks from the heap start, in list order.
+ *
+ * The heap may be restored at a different address and with a different MAGIC; block
+ * headers and links are fixed up on restore.  Pointers stored by the program inside
+ * its payloads are not.
+ */
+
+/*
+ * Write a snapshot of the heap to a file descriptor.
+ *
+ * @param fd  A file descriptor open for writing.
+ *
+ * @return 0 on success.  If the heap is not initialized, -1 is returned and sf_errno
+ * is set to EINVAL.  If a write fails, -1 is returned and sf_errno is set to EIO.
+ */
+int sf_heap_snapshot(int fd);
+
+/*
+ * Replace the whole heap with a snapshot read from a file descriptor.  The heap grows
+ * as needed to the size of the snapshot; if it is larger, the pages above the snapshot
+ * are released as by sf_trim().  Every block in the current heap is lost.
+ *
+ * @param fd  A file descriptor open for reading, positioned at the snapshot.
+ *
+ * @return 0 on success.  If the data is not a snapshot, -1 is returned and sf_errno is
+ * set to EINVAL.  If the heap cannot grow to the snapshot size, -1 is returned and
+ * sf_errno is set to ENOMEM.  If a read fails, -1 is returned and sf_errno is set to
+ * EIO; the heap is then left in an unusable state.
+ */
+int sf_heap_restore(int fd);
+
+#endif
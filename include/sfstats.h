@@ -0,0 +1,109 @@
+#ifndef SFSTATS_H
+#define SFSTATS_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "sfmm.h"
+
+/*
+ * Allocator statistics.  All counts are exact 64-bit integers.  The event counters
+ * are updated on every call, at the cost of an increment, and count from the time
+ * the heap was initialized.  The fields under "current state" are computed when
+ * sf_get_stats() is called, by walking the free lists and quick lists.
+ *
+ * Quick list counters are indexed like sf_quick_lists, and free list counters like
+ * sf_free_list_heads.
+ */
+struct sf_stats {
+	/* Calls. */
+	uint64_t mallocs;			// Successful sf_malloc() calls.
+	uint64_t frees;				// sf_free() calls.
+	uint64_t reallocs;			// Successful sf_realloc() calls.
+
+	/* Quick lists.  A request whose block size has a quick list is a hit if that
+	   list has a block, and a miss otherwise. */
+	uint64_t quick_hits[NUM_QUICK_LISTS];
+	uint64_t quick_misses[NUM_QUICK_LISTS];
+
+	/* Free lists.  A search is counted in the class it starts from; a probe is
+	   counted in the class of the block examined. */
+	uint64_t searches[NUM_FREE_LISTS];
+	uint64_t probes[NUM_FREE_LISTS];
+
+	/* Block operations. */
+	uint64_t splits;			// Blocks split in two.
+	uint64_t high_splits;			// Splits that allocated the upper part.
+	uint64_t coalesces;			// Free neighbours merged into a freed block.
+	uint64_t flushes;			// Quick lists flushed to the free lists.
+	uint64_t grows;				// Heap growths by sf_create_new_page().
+	uint64_t grow_bytes;			// Bytes added to the heap by those growths.
+
+	/* Current state. */
+	uint64_t payload_bytes;			// Total payload of allocated blocks.
+	uint64_t allocated_bytes;		// Total size of allocated blocks.
+	uint64_t peak_payload_bytes;		// Largest payload_bytes so far.
+	uint64_t heap_bytes;			// Current heap size.
+	uint64_t quick_bytes[NUM_QUICK_LISTS];	// Total size of blocks in each quick list.
+	uint64_t free_blocks[NUM_FREE_LISTS];	// Number of blocks in each free list.
+	uint64_t free_bytes[NUM_FREE_LISTS];	// Total size of blocks in each free list.
+	uint64_t largest_free_block;		// Size of the largest block in any free list.
+};
+
+/*
+ * Fill in the statistics of the heap.  If the heap has not been initialized, every
+ * field is 0.
+ *
+ * @param stats  The structure to fill in.
+ */
+void sf_get_stats(struct sf_stats *stats);
+
+/* Operations timed by the latency histograms. */
+#define SF_LATENCY_MALLOC	0
+#define SF_LATENCY_FREE		1
+#define SF_LATENCY_REALLOC	2
+#define SF_LATENCY_NUM_OPS	3
+
+/* Size class meaning "every size class" in sf_get_latency(). */
+#define SF_LATENCY_ALL_CLASSES	(-1)
+
+/*
+ * Latency summary of one operation, in nanoseconds.  Percentiles are read from a
+ * log-linear histogram, so they are exact below 16ns and within 1/16 (6.25%) of
+ * the true value above.
+ */
+struct sf_latency_stats {
+	uint64_t count;
+	uint64_t min_ns;
+	uint64_t max_ns;
+	uint64_t mean_ns;
+	uint64_t p50_ns;
+	uint64_t p90_ns;
+	uint64_t p99_ns;
+	uint64_t p999_ns;
+};
+
+/*
+ * Summarize the latency histogram of a public allocator call.  Calls are timed only
+ * when the allocator is built with -DSF_LATENCY (make latency); otherwise every
+ * histogram is empty and count is 0.
+ *
+ * A call is put in the size class of the free list that holds its block size: the
+ * requested block size for sf_malloc() and sf_realloc(), and the size of the block
+ * being freed for sf_free().  Calls whose size class is unknown, such as sf_free()
+ * on a region pointer, only appear under SF_LATENCY_ALL_CLASSES.
+ *
+ * @param op  One of SF_LATENCY_MALLOC, SF_LATENCY_FREE or SF_LATENCY_REALLOC.
+ * @param size_class  A free list index, or SF_LATENCY_ALL_CLASSES.
+ * @param lat  The structure to fill in.
+ *
+ * @return 0 on success.  If op or size_class is out of range, sf_errno is set to
+ * EINVAL and -1 is returned.
+ */
+int sf_get_latency(int op, int size_class, struct sf_latency_stats *lat);
+
+/*
+ * Empty every latency histogram.
+ */
+void sf_reset_latency();
+
+#endif
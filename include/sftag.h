@@ -0,0 +1,126 @@
+#ifndef SFTAG_H
+#define SFTAG_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "sfmm.h"
+#include "sfarena.h"
+
+/*
+ * Tagged allocation.  A caller gives each block one of SF_NUM_TAGS tags (a subsystem, a
+ * request type, ...) and the allocator keeps statistics per tag: live bytes, how fast the
+ * tag allocates and how much of its blocks is lost to headers and padding.
+ *
+ * The tag is not stored in the block, so tagging does not make blocks any larger.  Each
+ * heap gets a side table on first use, with an entry for every 16 bytes of heap address
+ * space, indexed by block address.  The table lives in an anonymous mapping reserved with
+ * MAP_NORESERVE, so only the entries covering the heap in use take memory.  sf_free() and
+ * sf_realloc() look the block up in the table, so tagged blocks are freed and resized like
+ * any other; a realloc keeps the tag.
+ *
+ * A tag can also be pinned: its blocks are then placed in a sub-heap of their own, with
+ * its own pages and size-class lists, so they end up next to each other rather than
+ * spread over the heap.  Pinned blocks are not part of the parent heap, as for the
+ * lifetime groups of sfhint.h.  Pinning is refused on persistent heaps.
+ */
+#define SF_NUM_TAGS	256
+
+/* Reserved size of the side table span and of the pinned sub-heaps of the sfutil heap.
+   Those of an arena cover the capacity of the arena. */
+#define SF_TAG_HEAP_CAPACITY ((size_t)1 << 30)
+
+struct sf_tag_stats {
+	/* Calls, counted from the first use of the tag. */
+	uint64_t mallocs;			// Successful sf_malloc_tagged() calls.
+	uint64_t frees;				// Tagged blocks freed.
+	uint64_t reallocs;			// Tagged blocks resized.
+	uint64_t total_bytes;			// Payload bytes requested by those calls.
+
+	/* Current state. */
+	uint64_t payload_bytes;			// Total payload of live tagged blocks.
+	uint64_t allocated_bytes;		// Total size of live tagged blocks.
+	uint64_t peak_payload_bytes;		// Largest payload_bytes so far.
+	bool pinned;				// New blocks go to the tag's own sub-heap.
+
+	/* Derived. */
+	double alloc_rate;			// total_bytes per second since the first allocation.
+	double internal_fragmentation;		// 1 - payload_bytes / allocated_bytes, 0 if nothing is live.
+	double external_fragmentation;		// Of the tag's sub-heap (see sf_frag_report), 0 without one.
+};
+
+/*
+ * Allocate a block and give it a tag.
+ *
+ * @param size  The number of bytes requested to be allocated.
+ * @param tag  The tag, less than SF_NUM_TAGS.
+ *
+ * @return As for sf_malloc().  If the tag is out of range, NULL is returned and sf_errno
+ * is set to EINVAL.  If the side table cannot be mapped, NULL is returned and sf_errno is
+ * set to ENOMEM.
+ */
+void *sf_malloc_tagged(sf_size_t size, unsigned int tag);
+
+/*
+ * @return The tag of an allocated block, or -1 if the block was not allocated by
+ * sf_malloc_tagged().
+ */
+int sf_tag_of(void *ptr);
+
+/*
+ * Fill in the statistics of a tag, including the blocks in its sub-heap.  Every field
+ * is 0 if the tag has not been used.
+ *
+ * @return 0 on success.  If the tag is out of range, -1 is returned and sf_errno is set
+ * to EINVAL.
+ */
+int sf_tag_get_stats(unsigned int tag, struct sf_tag_stats *stats);
+
+/*
+ * Pin a tag to a sub-heap of its own, or unpin it.  Only blocks allocated afterwards
+ * move; blocks already allocated are freed where they are.  An unpinned tag keeps its
+ * sub-heap until the blocks in it are freed and the parent heap is destroyed.
+ *
+ * @param tag  The tag, less than SF_NUM_TAGS.
+ * @param pin  true to pin the tag, false to unpin it.
+ *
+ * @return 0 on success.  If the tag is out of range or the heap is persistent, -1 is
+ * returned and sf_errno is set to EINVAL.  If the sub-heap cannot be created, -1 is
+ * returned and sf_errno is set to ENOMEM.
+ */
+int sf_tag_pin(unsigned int tag, bool pin);
+
+/*
+ * @return The pinned sub-heap of the current heap that ptr lies in, or NULL if ptr is
+ * not in any of them.
+ */
+sf_arena *sf_tag_owner(void *ptr);
+
+/*
+ * Called by sf_free() before a block goes back to the lists.  If the block is tagged,
+ * its tag is removed and the statistics of the tag are updated.
+ */
+void sf_tag_free_block(sf_block *blkp);
+
+/*
+ * Called by sf_realloc() once a block has been resized.  new_blkp is the block now
+ * holding the payload; if it is not old_blkp, the tag moves to it, and old_blkp is then
+ * freed as an untagged block.
+ *
+ * @param old_payload  The payload size of old_blkp before the call.
+ * @param old_bsize  The block size of old_blkp before the call.
+ */
+void sf_tag_realloc_block(sf_block *old_blkp, sf_block *new_blkp, sf_size_t old_payload, sf_size_t old_bsize);
+
+/*
+ * Called by sf_heap_restore() before the contents of the current heap are replaced.
+ * Every block is untagged and taken out of the live bytes of its tag; the counters of
+ * past calls are kept.
+ */
+void sf_tag_forget();
+
+/*
+ * Unmap the side table of the current heap and destroy its pinned sub-heaps.
+ */
+void sf_tag_drop();
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef SFTRACE_H
+#define SFTRACE_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "sfmm.h"
+
+/*
+ * Allocation event tracer, compiled in with -DSF_TRACE (make trace).
+ *
+ * Every sf_malloc(), sf_free() and sf_realloc() call appends an event to a fixed-size
+ * ring buffer shared by all threads.  Appending takes one compare-and-swap and never
+ * blocks: if the ring is full, the event is dropped and counted.  A background thread
+ * drains the ring to the trace file.
+ *
+ * File format (all fields in host byte order): an sf_trace_header, followed by
+ * sf_trace_event records until the end of the file.  Events from one thread are in
+ * call order; events from different threads are ordered by when they were appended,
+ * which can differ slightly from their timestamps.
+ */
+
+/* Identifies a trace file ("sfmmtrce"). */
+#define SF_TRACE_MAGIC 0x656372746d6d6673ULL
+#define SF_TRACE_VERSION 1
+
+/* Event operations. */
+#define SF_TRACE_MALLOC		0
+#define SF_TRACE_FREE		1
+#define SF_TRACE_REALLOC	2
+
+typedef struct sf_trace_header {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t event_size;		// sizeof(sf_trace_event).
+	uint64_t ticks_per_sec;		// Timestamp frequency.
+	uint64_t start_ticks;		// Timestamp when tracing started.
+} sf_trace_header;
+
+typedef struct sf_trace_event {
+	uint64_t ticks;			// Timestamp taken when the event was recorded.
+	uint64_t ptr;			// Pointer returned (malloc, realloc) or freed (free).
+	uint64_t old_ptr;		// Pointer passed to realloc, 0 otherwise.
+	uint32_t size;			// Requested size, 0 for free.
+	uint32_t tid;			// Kernel thread id of the caller.
+	uint32_t op;			// SF_TRACE_MALLOC, SF_TRACE_FREE or SF_TRACE_REALLOC.
+	uint32_t unused;
+} sf_trace_event;
+
+/* Default ring capacity in events, used when sf_trace_start() is given 0. */
+#define SF_TRACE_DEFAULT_EVENTS ((size_t)1 << 16)
+
+/*
+ * Start tracing to a new file.  The file is created (or truncated) and the header is
+ * written; the ring buffer is mapped with mmap(), so tracing never calls the allocator.
+ *
+ * @param path  The trace file.
+ * @param ring_events  The ring capacity in events, rounded up to a power of two.
+ * 0 selects SF_TRACE_DEFAULT_EVENTS.
+ *
+ * @return 0 on success.  If tracing is already on, -1 is returned and sf_errno is set
+ * to EINVAL.  If the allocator was built without SF_TRACE, -1 is returned and sf_errno
+ * is set to ENOSYS.  If the file or ring cannot be set up, -1 is returned and sf_errno
+ * is set to EIO or ENOMEM.
+ */
+int sf_trace_start(const char *path, size_t ring_events);
+
+/*
+ * Stop tracing: the background thread writes what is left in the ring and the file
+ * is closed.  No allocator call may be in progress on another thread.
+ *
+ * @return 0 on success.  If a write to the trace file failed at any point, -1 is
+ * returned and sf_errno is set to EIO.  If tracing is off, -1 is returned and sf_errno
+ * is set to EINVAL.
+ */
+int sf_trace_stop();
+
+/*
+ * Hold the background thread, or let it go again.  While it is held, events stay in
+ * the ring (and are dropped once it is full), so the cost of recording an event can be
+ * measured without the writer competing for the CPU.  sf_trace_stop() drains the ring
+ * whether the thread is held or not.
+ *
+ * @param pause  true to hold the background thread, false to let it go.
+ */
+void sf_trace_pause(bool pause);
+
+/*
+ * @return The number of events dropped because the ring was full, since tracing
+ * was last started.
+ */
+uint64_t sf_trace_dropped();
+
+/*
+ * Append an event to the ring.  Called by the instrumented entry points; does
+ * nothing when tracing is off.
+ */
+void sf_trace_record(uint32_t op, void *ptr, void *old_ptr, sf_size_t size);
+
+#endif
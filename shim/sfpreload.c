@@ -0,0 +1,360 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "sfmm.h"
+#include "sfarena.h"
+#include "sfhelper.h"
+#include "sfalign.h"
+
+/*
+ * libsfmm.so: run unmodified programs on sfmm with LD_PRELOAD=bin/libsfmm.so.
+ *
+ * The library exports the standard allocation functions and serves them from sfmm
+ * arenas.  lib/sfutil.o is not position independent and cannot go into a shared
+ * library, so the few sfutil functions the allocator calls are provided here, and every
+ * block comes from an arena instead of the sfutil heap.
+ *
+ * - Every arena is kept under 4 GB, so no block, however much coalescing happens, can
+ *   outgrow the 32-bit block size of a header.  When an arena is full another one is
+ *   created, up to SF_PRELOAD_MAX_ARENAS.
+ * - Requests of SF_PRELOAD_MMAP_THRESHOLD bytes or more, which includes every request
+ *   above the range of sf_size_t, get a mapping of their own with a small header in front
+ *   of the payload.  A pointer that is in no arena is one of these.
+ * - One mutex serializes the allocator.  It is taken in pthread_atfork() handlers, so a
+ *   child process never inherits it locked.
+ * - A thread that calls back into the allocator while already inside it (from a signal
+ *   handler, or from libc during the first call) is served from a small static buffer
+ *   whose blocks are never reused.  Each of these blocks records its size in a small
+ *   header, so malloc_usable_size() and realloc() see the size that was asked for.
+ *
+ * Only the allocator's internal symbols are hidden; the exported functions are marked
+ * SF_EXPORT.
+ */
+
+#define SF_EXPORT __attribute__((visibility("default")))
+
+#define SF_PRELOAD_ARENA_CAPACITY ((size_t)3 << 30)
+#define SF_PRELOAD_MAX_ARENAS 64
+#define SF_PRELOAD_MMAP_THRESHOLD ((size_t)64 * 1024 * 1024)
+#define SF_PRELOAD_BOOTSTRAP_SIZE ((size_t)64 * 1024)
+
+/* Header in front of the payload of a block with a mapping of its own. */
+typedef struct sf_map_chunk {
+	void *map_base;
+	size_t map_size;
+} sf_map_chunk;
+
+/* Header in front of the payload of a block from the bootstrap buffer.  It keeps the
+   payload aligned to SF_ALIGN_SIZE. */
+typedef struct sf_bootstrap_chunk {
+	size_t size;
+	size_t unused;
+} sf_bootstrap_chunk;
+
+static pthread_mutex_t sf_preload_lock = PTHREAD_MUTEX_INITIALIZER;
+static sf_arena *sf_preload_arenas[SF_PRELOAD_MAX_ARENAS];
+static int sf_preload_narenas = 0;
+static int sf_preload_forking = 0;
+
+/* Set while this thread holds sf_preload_lock. */
+static __thread int sf_preload_busy __attribute__((tls_model("initial-exec")));
+
+static char sf_preload_bootstrap[SF_PRELOAD_BOOTSTRAP_SIZE] __attribute__((aligned(64)));
+static size_t sf_preload_bootstrap_used = 0;
+
+
+/* The part of sfutil the allocator needs.  There is no sfutil heap here, and headers are
+   stored as they are. */
+sf_header sf_magic(){
+	return 0;
+}
+
+void *sf_mem_start(){
+	return NULL;
+}
+
+void *sf_mem_end(){
+	return NULL;
+}
+
+void *sf_mem_grow(){
+	return NULL;
+}
+
+
+static void sf_preload_prepare(){
+	pthread_mutex_lock(&sf_preload_lock);
+	return;
+}
+
+static void sf_preload_parent(){
+	pthread_mutex_unlock(&sf_preload_lock);
+	return;
+}
+
+static void sf_preload_child(){
+	pthread_mutex_init(&sf_preload_lock, NULL);
+	return;
+}
+
+/* Take the lock.  Returns -1 if this thread is already inside the allocator. */
+static int sf_preload_enter(){
+	if(sf_preload_busy)
+		return -1;
+	pthread_mutex_lock(&sf_preload_lock);
+	sf_preload_busy = 1;
+	return 0;
+}
+
+static void sf_preload_leave(){
+	sf_preload_busy = 0;
+	pthread_mutex_unlock(&sf_preload_lock);
+	return;
+}
+
+/* Register the fork handlers once, outside the lock: pthread_atfork() may allocate. */
+static void sf_preload_register_fork(){
+	if(__atomic_exchange_n(&sf_preload_forking, 1, __ATOMIC_ACQ_REL) == 0)
+		pthread_atfork(sf_preload_prepare, sf_preload_parent, sf_preload_child);
+	return;
+}
+
+static void *sf_bootstrap_alloc(size_t size){
+	if(size > SF_PRELOAD_BOOTSTRAP_SIZE)
+		return NULL;
+	size_t total = sizeof(sf_bootstrap_chunk) + ((size + SF_ALIGN_SIZE - 1) & ~(size_t)(SF_ALIGN_SIZE - 1));
+	size_t offset = __atomic_fetch_add(&sf_preload_bootstrap_used, total, __ATOMIC_RELAXED);
+	if(offset + total > SF_PRELOAD_BOOTSTRAP_SIZE)
+		return NULL;
+	sf_bootstrap_chunk *chunk = (sf_bootstrap_chunk *)(sf_preload_bootstrap + offset);
+	chunk->size = size;
+	return chunk + 1;
+}
+
+static int sf_bootstrap_owns(void *ptr){
+	return (char *)ptr >= sf_preload_bootstrap && (char *)ptr < sf_preload_bootstrap + SF_PRELOAD_BOOTSTRAP_SIZE;
+}
+
+/* The arena holding ptr, or NULL if ptr has a mapping of its own.  Arenas are only ever
+   appended, so this is safe without the lock. */
+static sf_arena *sf_preload_owner(void *ptr){
+	int i, narenas = __atomic_load_n(&sf_preload_narenas, __ATOMIC_ACQUIRE);
+	for(i = 0; i < narenas; i++)
+		if(sf_arena_contains(sf_preload_arenas[i], ptr))
+			return sf_preload_arenas[i];
+	return NULL;
+}
+
+/* Allocate from the arenas, newest first, adding an arena when they are all full.
+   Called with the lock held. */
+static void *sf_preload_arena_alloc(size_t align, size_t size){
+	int i;
+	for(i = sf_preload_narenas - 1; i >= -1; i--)
+	{
+		sf_arena *arena;
+		if(i >= 0)
+			arena = sf_preload_arenas[i];
+		else
+		{
+			if(sf_preload_narenas == SF_PRELOAD_MAX_ARENAS)
+				return NULL;
+			arena = sf_arena_create(SF_PRELOAD_ARENA_CAPACITY);
+			if(arena == NULL)
+				return NULL;
+			sf_preload_arenas[sf_preload_narenas] = arena;
+			__atomic_store_n(&sf_preload_narenas, sf_preload_narenas + 1, __ATOMIC_RELEASE);
+		}
+		void *pp = sf_arena_memalign(arena, (sf_size_t)align, (sf_size_t)size);
+		if(pp != NULL)
+			return pp;
+	}
+	return NULL;
+}
+
+static void *sf_chunk_alloc(size_t align, size_t size){
+	if(size > SIZE_MAX - align - sizeof(sf_map_chunk) - (size_t)PAGE_SZ)
+		return NULL;
+	size_t map_size = size + align + sizeof(sf_map_chunk);
+	char *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(map == MAP_FAILED)
+		return NULL;
+
+	uintptr_t pp = ((uintptr_t)map + sizeof(sf_map_chunk) + align - 1) & ~((uintptr_t)align - 1);
+	sf_map_chunk *chunk = (sf_map_chunk *)pp - 1;
+	chunk->map_base = map;
+	chunk->map_size = map_size;
+	return (void *)pp;
+}
+
+static size_t sf_chunk_usable_size(void *ptr){
+	sf_map_chunk *chunk = (sf_map_chunk *)ptr - 1;
+	return chunk->map_size - (size_t)((char *)ptr - (char *)chunk->map_base);
+}
+
+static void sf_chunk_free(void *ptr){
+	sf_map_chunk *chunk = (sf_map_chunk *)ptr - 1;
+	munmap(chunk->map_base, chunk->map_size);
+	return;
+}
+
+static void *sf_preload_alloc(size_t align, size_t size){
+	if(size == 0)
+		size = 1;
+
+	if(sf_preload_enter() == -1)
+	{
+		void *pp = (align <= SF_ALIGN_SIZE) ? sf_bootstrap_alloc(size) : NULL;
+		if(pp == NULL)
+			errno = ENOMEM;
+		return pp;
+	}
+
+	void *pp = NULL;
+	int first = (sf_preload_narenas == 0);
+	if(size < SF_PRELOAD_MMAP_THRESHOLD && align < SF_PRELOAD_MMAP_THRESHOLD)
+		pp = sf_preload_arena_alloc(align, size);
+	if(pp == NULL)
+		pp = sf_chunk_alloc(align, size);
+	sf_preload_leave();
+
+	if(first)
+		sf_preload_register_fork();
+	if(pp == NULL)
+		errno = ENOMEM;
+	return pp;
+}
+
+static size_t sf_preload_usable_size(void *ptr){
+	if(sf_bootstrap_owns(ptr))
+		return ((sf_bootstrap_chunk *)ptr - 1)->size;
+	sf_arena *arena = sf_preload_owner(ptr);
+	if(arena == NULL)
+		return sf_chunk_usable_size(ptr);
+	return sf_usable_size(ptr);
+}
+
+
+SF_EXPORT void *malloc(size_t size){
+	return sf_preload_alloc(SF_ALIGN_SIZE, size);
+}
+
+SF_EXPORT void free(void *ptr){
+	if(ptr == NULL || sf_bootstrap_owns(ptr))
+		return;
+	if(sf_preload_enter() == -1)
+		return;
+
+	sf_arena *arena = sf_preload_owner(ptr);
+	if(arena != NULL)
+		sf_arena_free(arena, ptr);
+	else
+		sf_chunk_free(ptr);
+	sf_preload_leave();
+	return;
+}
+
+SF_EXPORT void *calloc(size_t nmemb, size_t size){
+	size_t total;
+	if(__builtin_mul_overflow(nmemb, size, &total))
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	void *pp = malloc(total);
+	if(pp != NULL)
+		memset(pp, 0, total);
+	return pp;
+}
+
+SF_EXPORT void *realloc(void *ptr, size_t size){
+	if(ptr == NULL)
+		return malloc(size);
+	if(size == 0)
+	{
+		free(ptr);
+		return NULL;
+	}
+
+	/* Resize in place inside the arena when the block stays there. */
+	if(!sf_bootstrap_owns(ptr) && size < SF_PRELOAD_MMAP_THRESHOLD && sf_preload_enter() == 0)
+	{
+		sf_arena *arena = sf_preload_owner(ptr);
+		void *pp = NULL;
+		if(arena != NULL)
+			pp = sf_arena_realloc(arena, ptr, (sf_size_t)size);
+		sf_preload_leave();
+		if(pp != NULL)
+			return pp;
+	}
+
+	/* Otherwise move the block. */
+	size_t old_size = sf_preload_usable_size(ptr);
+	void *pp = malloc(size);
+	if(pp == NULL)
+		return NULL;
+	memcpy(pp, ptr, (old_size < size) ? old_size : size);
+	free(ptr);
+	return pp;
+}
+
+SF_EXPORT void *reallocarray(void *ptr, size_t nmemb, size_t size){
+	size_t total;
+	if(__builtin_mul_overflow(nmemb, size, &total))
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	return realloc(ptr, total);
+}
+
+SF_EXPORT int posix_memalign(void **memptr, size_t alignment, size_t size){
+	if(alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0)
+		return EINVAL;
+	if(alignment < SF_ALIGN_SIZE)
+		alignment = SF_ALIGN_SIZE;
+	void *pp = sf_preload_alloc(alignment, size);
+	if(pp == NULL)
+		return ENOMEM;
+	*memptr = pp;
+	return 0;
+}
+
+SF_EXPORT void *aligned_alloc(size_t alignment, size_t size){
+	if(alignment == 0 || (alignment & (alignment - 1)) != 0)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	if(alignment < SF_ALIGN_SIZE)
+		alignment = SF_ALIGN_SIZE;
+	return sf_preload_alloc(alignment, size);
+}
+
+SF_EXPORT void *memalign(size_t alignment, size_t size){
+	return aligned_alloc(alignment, size);
+}
+
+SF_EXPORT void *valloc(size_t size){
+	return sf_preload_alloc((size_t)sysconf(_SC_PAGESIZE), size);
+}
+
+SF_EXPORT void *pvalloc(size_t size){
+	size_t os_page = (size_t)sysconf(_SC_PAGESIZE);
+	if(size > SIZE_MAX - os_page)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	return sf_preload_alloc(os_page, (size + os_page - 1) & ~(os_page - 1));
+}
+
+SF_EXPORT size_t malloc_usable_size(void *ptr){
+	if(ptr == NULL)
+		return 0;
+	return sf_preload_usable_size(ptr);
+}
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfhelper.h"
+#include "sfregion.h"
+#include "sfalign.h"
+#include "sflatency.h"
+
+
+void *SF_UNTIMED(sf_memalign)(sf_size_t align, sf_size_t size){
+	if(align < SF_ALIGN_SIZE || (align & (align - 1)) != 0)
+	{
+		sf_errno = EINVAL;
+		return NULL;
+	}
+	if(size == 0)
+		return NULL;
+	if(align == SF_ALIGN_SIZE)
+		return SF_UNTIMED(sf_malloc)(size);
+
+	/* Leave room for an aligned payload with at least a minimum block in front of it. */
+	sf_size_t slack = align + SF_MIN_BLOCK_SIZE;
+	if(size > (sf_size_t)-1 - slack - SF_ALIGN_SIZE - sizeof(sf_header))
+	{
+		sf_errno = ENOMEM;
+		return NULL;
+	}
+
+	uint64_t saved_peak = sf_cur_heap->stats.peak_payload_bytes;
+	char *pp = SF_UNTIMED(sf_malloc)(size + slack);
+	if(pp == NULL)
+		return NULL;
+
+	sf_block *blkp = (sf_block *)(pp - sizeof(sf_header) - sizeof(sf_footer));
+	sf_size_t bsize = get_block_size(get_hdrp(blkp));
+	sf_size_t payload = get_payload_size(get_hdrp(blkp));
+
+	/* Free the space in front of the aligned payload as a block of its own. */
+	char *ap = (char *)(((uintptr_t)pp + align - 1) & ~((uintptr_t)align - 1));
+	if(ap != pp)
+	{
+		if(ap - pp < SF_MIN_BLOCK_SIZE)
+			ap = ap + align;
+		sf_size_t lead = (sf_size_t)(ap - pp);
+		unsigned int prev_alloc = get_prev_alloc(get_hdrp(blkp));
+
+		sf_block *ablkp = (sf_block *)((char *)blkp + lead);
+		set_header(get_hdrp(ablkp), pack_header(bsize - lead - sizeof(sf_header), bsize - lead, 1, 0, 0));
+		set_header(get_hdrp(blkp), pack_header(0, lead, 0, prev_alloc, 0));
+		if(sf_frlst_insert(blkp) == -1)
+			abort();
+		blkp = ablkp;
+	}
+
+	/* Free the space behind the payload, as a shrinking sf_realloc() would. */
+	sf_size_t new_bsize = size + sizeof(sf_header);
+	if(new_bsize < SF_MIN_BLOCK_SIZE)
+		new_bsize = SF_MIN_BLOCK_SIZE;
+	else if((new_bsize % SF_ALIGN_SIZE) != 0)
+		new_bsize = new_bsize + (SF_ALIGN_SIZE - (new_bsize % SF_ALIGN_SIZE));
+	blkp = split_block(blkp, size, new_bsize);
+	sf_header *hdrp = get_hdrp(blkp);
+	set_header(hdrp, pack_header(size, get_block_size(hdrp), 1, get_prev_alloc(hdrp), 0));
+
+	/* Account for the block as if it had been allocated at its final size. */
+	sf_cur_heap->stats.payload_bytes = sf_cur_heap->stats.payload_bytes - payload + size;
+	sf_cur_heap->stats.allocated_bytes = sf_cur_heap->stats.allocated_bytes - bsize + get_block_size(hdrp);
+	sf_cur_heap->stats.peak_payload_bytes = saved_peak;
+	if(sf_cur_heap->stats.payload_bytes > sf_cur_heap->stats.peak_payload_bytes)
+		sf_cur_heap->stats.peak_payload_bytes = sf_cur_heap->stats.payload_bytes;
+
+	return (void *)(&(blkp->body.payload));
+}
+
+sf_size_t sf_usable_size(void *pp){
+	sf_block *blkp = (sf_block *)((char *)pp - sizeof(sf_header) - sizeof(sf_footer));
+	return get_payload_size(get_hdrp(blkp));
+}
+
+void sf_free_sized(void *pp, sf_size_t size){
+	/* Region blocks have no header to check. */
+	if(sf_region_owns(pp))
+		return;
+	if(pp == NULL || ((uintptr_t)pp & 0xF) != 0)
+		abort();
+	if(sf_usable_size(pp) != size)
+		abort();
+	sf_free(pp);
+	return;
+}
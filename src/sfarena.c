@@ -0,0 +1,410 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfhelper.h"
+#include "sfarena.h"
+#include "sfalign.h"
+#include "sfpage.h"
+#include "sfplace.h"
+#include "sfhint.h"
+#include "sftag.h"
+
+/* Identifies a file holding a persistent heap ("sfmmheap"). */
+#define SF_HEAP_FILE_MAGIC 0x7061656868666d73ULL
+
+/* An arena lives at the start of its own mapping, followed by the pages of its heap.
+   For a persistent heap, the mapping is the file, so everything here is saved with it. */
+struct sf_arena {
+	uint64_t magic;				// SF_HEAP_FILE_MAGIC for a persistent heap, else 0.
+	uint64_t clean;				// 1 once sf_heap_close() has synced the file.
+	uint64_t header_magic;			// MAGIC the headers in the file are obfuscated with.
+	void *map_base;				// Address the file must be mapped at.
+	size_t map_size;
+	void *root;				// Root object of a persistent heap.
+	int fd;					// Open file of a persistent heap, else -1.
+	sf_heap heap;
+	sf_block free_list_heads[NUM_FREE_LISTS];
+	sf_quick_list quick_lists[NUM_QUICK_LISTS];
+};
+
+
+/* Round an arena capacity up to whole pages, with at least one page. */
+static size_t sf_arena_capacity(size_t capacity){
+	if(capacity < PAGE_SZ)
+		capacity = PAGE_SZ;
+	return (capacity + PAGE_SZ - 1) / PAGE_SZ * PAGE_SZ;
+}
+
+/* Size of the arena itself, rounded so that the heap starts on a system page. */
+static size_t sf_arena_header_size(){
+	size_t os_page = (size_t)sysconf(_SC_PAGESIZE);
+	return (sizeof(struct sf_arena) + os_page - 1) / os_page * os_page;
+}
+
+/* Set up an empty arena at the start of a fresh mapping. */
+static sf_arena *sf_arena_init(void *map, size_t arena_size, size_t capacity){
+	/* The lists are initialized by the first sf_arena_malloc(), as for the sfutil heap. */
+	sf_arena *arena = (sf_arena *)map;
+	arena->magic = 0;
+	arena->clean = 0;
+	arena->header_magic = 0;
+	arena->map_base = map;
+	arena->root = NULL;
+	arena->fd = -1;
+	arena->heap.free_list_heads = arena->free_list_heads;
+	arena->heap.quick_lists = arena->quick_lists;
+	memset(&arena->heap.stats, 0, sizeof(arena->heap.stats));
+	arena->heap.base = (char *)map + arena_size;
+	arena->heap.top = arena->heap.base;
+	arena->heap.limit = arena->heap.base + capacity;
+	arena->heap.released_bytes = 0;
+	arena->heap.frlst_order = SF_ORDER_LIFO;
+	arena->heap.frlst_index = NULL;
+	arena->heap.wilderness = false;
+	arena->heap.grow_pages = 0;
+	arena->heap.grow_mark = 0;
+	memset(arena->heap.hint_heaps, 0, sizeof(arena->heap.hint_heaps));
+	arena->heap.sub_heaps = false;
+	arena->heap.tags = NULL;
+	arena->map_size = arena_size + capacity;
+
+	return arena;
+}
+
+/* Reserve an arena followed by its heap, with the heap starting on a huge page, so that
+   huge-page growth hands out whole, aligned huge pages.  One huge page too many is
+   reserved, and what lies outside the aligned range is unmapped again. */
+static void *sf_arena_map(size_t arena_size, size_t capacity){
+	size_t map_size = arena_size + capacity;
+	char *raw = mmap(NULL, map_size + SF_HUGE_PAGE_SZ, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(raw == MAP_FAILED)
+		return NULL;
+
+	uintptr_t heap = ((uintptr_t)raw + arena_size + SF_HUGE_PAGE_SZ - 1) & ~((uintptr_t)SF_HUGE_PAGE_SZ - 1);
+	char *map = (char *)heap - arena_size;
+	char *raw_end = raw + map_size + SF_HUGE_PAGE_SZ;
+	if(map > raw)
+		munmap(raw, (size_t)(map - raw));
+	if(map + map_size < raw_end)
+		munmap(map + map_size, (size_t)(raw_end - (map + map_size)));
+	return map;
+}
+
+sf_arena *sf_arena_create(size_t capacity){
+	capacity = sf_arena_capacity(capacity);
+	size_t arena_size = sf_arena_header_size();
+
+	void *map = sf_arena_map(arena_size, capacity);
+	if(map == NULL)
+	{
+		sf_errno = ENOMEM;
+		return NULL;
+	}
+
+	return sf_arena_init(map, arena_size, capacity);
+}
+
+void *sf_arena_malloc(sf_arena *arena, sf_size_t size){
+	sf_heap *saved_heap = sf_cur_heap;
+	sf_cur_heap = &arena->heap;
+	void *pp = sf_malloc(size);
+	sf_cur_heap = saved_heap;
+	return pp;
+}
+
+void *sf_arena_realloc(sf_arena *arena, void *ptr, sf_size_t size){
+	sf_heap *saved_heap = sf_cur_heap;
+	sf_cur_heap = &arena->heap;
+	void *pp = sf_realloc(ptr, size);
+	sf_cur_heap = saved_heap;
+	return pp;
+}
+
+void sf_arena_free(sf_arena *arena, void *ptr){
+	sf_heap *saved_heap = sf_cur_heap;
+	sf_cur_heap = &arena->heap;
+	sf_free(ptr);
+	sf_cur_heap = saved_heap;
+	return;
+}
+
+void sf_arena_free_sized(sf_arena *arena, void *ptr, sf_size_t size){
+	sf_heap *saved_heap = sf_cur_heap;
+	sf_cur_heap = &arena->heap;
+	sf_free_sized(ptr, size);
+	sf_cur_heap = saved_heap;
+	return;
+}
+
+void *sf_arena_memalign(sf_arena *arena, sf_size_t align, sf_size_t size){
+	sf_heap *saved_heap = sf_cur_heap;
+	sf_cur_heap = &arena->heap;
+	void *pp = sf_memalign(align, size);
+	sf_cur_heap = saved_heap;
+	return pp;
+}
+
+bool sf_arena_contains(sf_arena *arena, void *ptr){
+	return (char *)ptr >= arena->heap.base && (char *)ptr < arena->heap.limit;
+}
+
+void *sf_arena_malloc_hint(sf_arena *arena, sf_size_t size, int hint){
+	if(arena->fd != -1 && (hint == SF_HINT_SHORT || hint == SF_HINT_LONG))
+		hint = SF_HINT_NONE;
+
+	sf_heap *saved_heap = sf_cur_heap;
+	sf_cur_heap = &arena->heap;
+	void *pp = sf_malloc_hint(size, hint);
+	sf_cur_heap = saved_heap;
+	return pp;
+}
+
+int sf_arena_hint_get_stats(sf_arena *arena, int hint, struct sf_stats *stats){
+	sf_heap *saved_heap = sf_cur_heap;
+	sf_cur_heap = &arena->heap;
+	int ret = sf_hint_get_stats(hint, stats);
+	sf_cur_heap = saved_heap;
+	return ret;
+}
+
+void *sf_arena_malloc_tagged(sf_arena *arena, sf_size_t size, unsigned int tag){
+	sf_heap *saved_heap = sf_cur_heap;
+	sf_cur_heap = &arena->heap;
+	void *pp = sf_malloc_tagged(size, tag);
+	sf_cur_heap = saved_heap;
+	return pp;
+}
+
+int sf_arena_tag_get_stats(sf_arena *arena, unsigned int tag, struct sf_tag_stats *stats){
+	sf_heap *saved_heap = sf_cur_heap;
+	sf_cur_heap = &arena->heap;
+	int ret = sf_tag_get_stats(tag, stats);
+	sf_cur_heap = saved_heap;
+	return ret;
+}
+
+int sf_arena_tag_pin(sf_arena *arena, unsigned int tag, bool pin){
+	/* The sub-heap would not be saved with the file. */
+	if(arena->fd != -1)
+	{
+		sf_errno = EINVAL;
+		return -1;
+	}
+
+	sf_heap *saved_heap = sf_cur_heap;
+	sf_cur_heap = &arena->heap;
+	int ret = sf_tag_pin(tag, pin);
+	sf_cur_heap = saved_heap;
+	return ret;
+}
+
+sf_heap *sf_arena_heap(sf_arena *arena){
+	return &arena->heap;
+}
+
+void sf_arena_get_stats(sf_arena *arena, struct sf_stats *stats){
+	sf_heap *saved_heap = sf_cur_heap;
+	sf_cur_heap = &arena->heap;
+	sf_get_stats(stats);
+	sf_cur_heap = saved_heap;
+	return;
+}
+
+int sf_arena_heap_frag(sf_arena *arena, struct sf_frag_report *report){
+	sf_heap *saved_heap = sf_cur_heap;
+	sf_cur_heap = &arena->heap;
+	int ret = sf_heap_frag(report);
+	sf_cur_heap = saved_heap;
+	return ret;
+}
+
+int sf_arena_set_frlst_order(sf_arena *arena, int order){
+	sf_heap *saved_heap = sf_cur_heap;
+	sf_cur_heap = &arena->heap;
+	int ret = sf_set_frlst_order(order);
+	sf_cur_heap = saved_heap;
+	return ret;
+}
+
+int sf_arena_set_wilderness(sf_arena *arena, bool enable){
+	sf_heap *saved_heap = sf_cur_heap;
+	sf_cur_heap = &arena->heap;
+	int ret = sf_set_wilderness(enable);
+	sf_cur_heap = saved_heap;
+	return ret;
+}
+
+double sf_arena_internal_fragmentation(sf_arena *arena){
+	sf_heap *saved_heap = sf_cur_heap;
+	sf_cur_heap = &arena->heap;
+	double inter_frag = sf_internal_fragmentation();
+	sf_cur_heap = saved_heap;
+	return inter_frag;
+}
+
+double sf_arena_peak_utilization(sf_arena *arena){
+	sf_heap *saved_heap = sf_cur_heap;
+	sf_cur_heap = &arena->heap;
+	double peak_util = sf_peak_utilization();
+	sf_cur_heap = saved_heap;
+	return peak_util;
+}
+
+void sf_arena_destroy(sf_arena *arena){
+	if(arena == NULL)
+		return;
+
+	/* The ordered index, the tag table and the sub-heaps have mappings of their own. */
+	sf_heap *saved_heap = sf_cur_heap;
+	sf_cur_heap = &arena->heap;
+	sf_frlst_index_drop();
+	sf_tag_drop();
+	sf_cur_heap = saved_heap;
+	int i;
+	for(i = 0; i < SF_NUM_HINT_HEAPS; i++)
+		sf_arena_destroy(arena->heap.hint_heaps[i]);
+
+	/* The arena and its heap share one mapping, everything else goes with it. */
+	int fd = arena->fd;
+	munmap((void *)arena, arena->map_size);
+	if(fd != -1)
+		close(fd);
+	return;
+}
+
+sf_arena *sf_heap_open(const char *path, size_t capacity){
+	int fd = open(path, O_RDWR | O_CREAT, 0600);
+	if(fd == -1)
+	{
+		sf_errno = EINVAL;
+		return NULL;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) == -1)
+	{
+		close(fd);
+		sf_errno = EINVAL;
+		return NULL;
+	}
+
+	/* A new file gets an empty heap, mapped wherever the system likes. */
+	if(st.st_size == 0)
+	{
+		capacity = sf_arena_capacity(capacity);
+		size_t arena_size = sf_arena_header_size();
+		if(ftruncate(fd, (off_t)(arena_size + capacity)) == -1)
+		{
+			close(fd);
+			sf_errno = ENOMEM;
+			return NULL;
+		}
+		void *map = mmap(NULL, arena_size + capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if(map == MAP_FAILED)
+		{
+			close(fd);
+			sf_errno = ENOMEM;
+			return NULL;
+		}
+		sf_arena *arena = sf_arena_init(map, arena_size, capacity);
+		arena->magic = SF_HEAP_FILE_MAGIC;
+		arena->header_magic = MAGIC;
+		arena->fd = fd;
+		return arena;
+	}
+
+	/* An existing file must hold a heap that was closed cleanly. */
+	struct sf_arena saved;
+	if(pread(fd, &saved, sizeof(saved), 0) != (ssize_t)sizeof(saved)
+		|| saved.magic != SF_HEAP_FILE_MAGIC || saved.clean != 1
+		|| (off_t)saved.map_size != st.st_size)
+	{
+		close(fd);
+		sf_errno = EINVAL;
+		return NULL;
+	}
+
+	/* All links in the heap are addresses, so the file goes back where it was. */
+	int flags = MAP_SHARED;
+#ifdef MAP_FIXED_NOREPLACE
+	flags = flags | MAP_FIXED_NOREPLACE;
+#endif
+	void *map = mmap(saved.map_base, saved.map_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+	if(map == MAP_FAILED)
+	{
+		close(fd);
+		sf_errno = ENOMEM;
+		return NULL;
+	}
+	if(map != saved.map_base)
+	{
+		munmap(map, saved.map_size);
+		close(fd);
+		sf_errno = ENOMEM;
+		return NULL;
+	}
+
+	/* The file is dirty until the next sf_heap_close(). */
+	sf_arena *arena = (sf_arena *)map;
+	arena->fd = fd;
+	arena->clean = 0;
+
+	/* MAGIC is chosen per process, so the headers are most likely obfuscated with that of
+	   another process. */
+	sf_heap *saved_heap = sf_cur_heap;
+	sf_cur_heap = &arena->heap;
+	sf_heap_remagic((sf_header)arena->header_magic);
+	sf_cur_heap = saved_heap;
+	arena->header_magic = MAGIC;
+
+	/* The ordered index was not saved with the file; build a new one.  Without it the
+	   lists stay in address order, only insertions walk them. */
+	arena->heap.frlst_index = NULL;
+	memset(arena->heap.hint_heaps, 0, sizeof(arena->heap.hint_heaps));
+	arena->heap.sub_heaps = false;
+	arena->heap.tags = NULL;
+	if(arena->heap.frlst_order == SF_ORDER_ADDRESS)
+		sf_arena_set_frlst_order(arena, SF_ORDER_ADDRESS);
+	return arena;
+}
+
+int sf_heap_sync(sf_arena *arena){
+	if(arena->fd == -1)
+		return -1;
+	if(msync((void *)arena, arena->map_size, MS_SYNC) == -1)
+		return -1;
+	return 0;
+}
+
+int sf_heap_close(sf_arena *arena){
+	if(arena->fd == -1)
+		return -1;
+
+	/* Write the heap out first, and only then mark the file clean. */
+	if(sf_heap_sync(arena) == -1)
+		return -1;
+	arena->clean = 1;
+	if(sf_heap_sync(arena) == -1)
+		return -1;
+
+	sf_arena_destroy(arena);
+	return 0;
+}
+
+void sf_arena_set_root(sf_arena *arena, void *root){
+	arena->root = root;
+	return;
+}
+
+void *sf_arena_get_root(sf_arena *arena){
+	return arena->root;
+}
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfhelper.h"
+#include "sfpage.h"
+#include "sfheapmap.h"
+
+/* Gap being built while the map is analyzed. */
+typedef struct sf_frag_state {
+	struct sf_frag_report *report;
+	uint64_t gap;
+} sf_frag_state;
+
+
+/* Call visit on every block of the heap, in address order.  Stop at the first
+   visit that returns -1.  Return 0, or -1 with sf_errno set to EINVAL if a header is
+   corrupt. */
+static int sf_heap_walk(int (*visit)(sf_heap_map_entry *entry, void *ctx), void *ctx){
+	char *heap_start = sf_heap_start();
+	char *heap_end = sf_heap_end();
+	if(heap_start == heap_end)
+		return 0;
+
+	/* Blocks run from just past the prologue up to the epilogue header. */
+	sf_header *epilogue = (sf_header *)(heap_end - sizeof(sf_header));
+	sf_block *blkp = (sf_block *)(heap_start + sizeof(sf_block));
+	while(get_hdrp(blkp) < epilogue)
+	{
+		sf_header *hdrp = get_hdrp(blkp);
+		sf_size_t bsize = get_block_size(hdrp);
+		if(bsize < SF_MIN_BLOCK_SIZE || bsize % SF_ALIGN_SIZE != 0
+			|| (char *)hdrp + bsize > (char *)epilogue)
+		{
+			sf_errno = EINVAL;
+			return -1;
+		}
+
+		sf_heap_map_entry entry;
+		entry.offset = (uint64_t)((char *)blkp - heap_start);
+		entry.size = bsize;
+		entry.payload = 0;
+		entry.unused = 0;
+		if(get_in_qklst(hdrp))
+			entry.state = SF_BLOCK_QUICK;
+		else if(get_alloc(hdrp))
+		{
+			entry.state = SF_BLOCK_ALLOC;
+			entry.payload = get_payload_size(hdrp);
+		}
+		else
+			entry.state = SF_BLOCK_FREE;
+
+		if(visit(&entry, ctx) == -1)
+			return -1;
+		blkp = get_next_blkp(blkp);
+	}
+	return 0;
+}
+
+/* Histogram bucket of a gap: floor(log2(size)). */
+static int sf_gap_bucket(uint64_t size){
+	int bucket = 63 - __builtin_clzll(size);
+	if(bucket >= SF_GAP_BUCKETS)
+		bucket = SF_GAP_BUCKETS - 1;
+	return bucket;
+}
+
+static void sf_frag_end_gap(sf_frag_state *state){
+	if(state->gap == 0)
+		return;
+	state->report->gaps[sf_gap_bucket(state->gap)]++;
+	if(state->gap > state->report->largest_gap)
+		state->report->largest_gap = state->gap;
+	state->gap = 0;
+	return;
+}
+
+static int sf_frag_add(sf_heap_map_entry *entry, void *ctx){
+	sf_frag_state *state = ctx;
+	struct sf_frag_report *report = state->report;
+
+	report->heap_bytes = report->heap_bytes + entry->size;
+	if(entry->state == SF_BLOCK_ALLOC)
+	{
+		sf_frag_end_gap(state);
+		report->alloc_blocks++;
+		report->alloc_bytes = report->alloc_bytes + entry->size;
+		report->payload_bytes = report->payload_bytes + entry->payload;
+		return 0;
+	}
+
+	if(entry->state == SF_BLOCK_QUICK)
+	{
+		report->quick_blocks++;
+		report->quick_bytes = report->quick_bytes + entry->size;
+	}
+	else
+	{
+		int findex = sf_frlst_index(entry->size);
+		report->free_blocks[findex]++;
+		report->free_bytes[findex] = report->free_bytes[findex] + entry->size;
+	}
+	report->total_free_bytes = report->total_free_bytes + entry->size;
+	if(entry->size > report->largest_free_block)
+		report->largest_free_block = entry->size;
+	state->gap = state->gap + entry->size;
+	return 0;
+}
+
+static void sf_frag_finish(sf_frag_state *state){
+	struct sf_frag_report *report = state->report;
+	sf_frag_end_gap(state);
+	if(report->total_free_bytes != 0)
+		report->external_fragmentation = 1.0 - (double)report->largest_free_block / (double)report->total_free_bytes;
+	return;
+}
+
+void sf_heap_map_analyze(const sf_heap_map_entry *entries, size_t nblocks, struct sf_frag_report *report){
+	sf_frag_state state = {report, 0};
+	size_t i;
+
+	memset(report, 0, sizeof(*report));
+	for(i = 0; i < nblocks; i++)
+	{
+		sf_heap_map_entry entry = entries[i];
+		sf_frag_add(&entry, &state);
+	}
+	sf_frag_finish(&state);
+	return;
+}
+
+int sf_heap_frag(struct sf_frag_report *report){
+	sf_frag_state state = {report, 0};
+
+	memset(report, 0, sizeof(*report));
+	if(sf_heap_walk(sf_frag_add, &state) == -1)
+		return -1;
+	sf_frag_finish(&state);
+	return 0;
+}
+
+/* Collect entries into a caller-provided array. */
+typedef struct sf_map_fill {
+	sf_heap_map_entry *entries;
+	size_t max_entries;
+	size_t nblocks;
+} sf_map_fill;
+
+static int sf_map_fill_entry(sf_heap_map_entry *entry, void *ctx){
+	sf_map_fill *fill = ctx;
+	if(fill->nblocks < fill->max_entries)
+		fill->entries[fill->nblocks] = *entry;
+	fill->nblocks++;
+	return 0;
+}
+
+ssize_t sf_heap_map(sf_heap_map_entry *entries, size_t max_entries){
+	sf_map_fill fill = {entries, max_entries, 0};
+	if(sf_heap_walk(sf_map_fill_entry, &fill) == -1)
+		return -1;
+	return (ssize_t)fill.nblocks;
+}
+
+/* Write exactly n bytes, retrying on short writes. */
+static int sf_map_write_full(int fd, const void *buf, size_t n){
+	const char *p = buf;
+	while(n > 0)
+	{
+		ssize_t w = write(fd, p, n);
+		if(w < 0 && errno == EINTR)
+			continue;
+		if(w <= 0)
+			return -1;
+		p = p + w;
+		n = n - (size_t)w;
+	}
+	return 0;
+}
+
+/* Buffer entries and write them out in batches. */
+#define SF_MAP_BATCH 256
+
+typedef struct sf_map_writer {
+	int fd;
+	size_t count;
+	sf_heap_map_entry batch[SF_MAP_BATCH];
+} sf_map_writer;
+
+static int sf_map_flush(sf_map_writer *writer){
+	if(writer->count == 0)
+		return 0;
+	if(sf_map_write_full(writer->fd, writer->batch, writer->count * sizeof(sf_heap_map_entry)) == -1)
+	{
+		sf_errno = EIO;
+		return -1;
+	}
+	writer->count = 0;
+	return 0;
+}
+
+static int sf_map_write_entry(sf_heap_map_entry *entry, void *ctx){
+	sf_map_writer *writer = ctx;
+	writer->batch[writer->count] = *entry;
+	writer->count++;
+	if(writer->count == SF_MAP_BATCH)
+		return sf_map_flush(writer);
+	return 0;
+}
+
+int sf_heap_map_write(int fd){
+	/* Count the blocks first, so the header can go in front of them. */
+	ssize_t nblocks = sf_heap_map(NULL, 0);
+	if(nblocks == -1)
+		return -1;
+
+	sf_heap_map_header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = SF_HEAP_MAP_MAGIC;
+	header.version = SF_HEAP_MAP_VERSION;
+	header.entry_size = sizeof(sf_heap_map_entry);
+	header.heap_start = (uint64_t)(uintptr_t)sf_heap_start();
+	header.heap_size = (uint64_t)((char *)sf_heap_end() - (char *)sf_heap_start());
+	header.nblocks = (uint64_t)nblocks;
+	if(sf_map_write_full(fd, &header, sizeof(header)) == -1)
+	{
+		sf_errno = EIO;
+		return -1;
+	}
+
+	sf_map_writer writer;
+	writer.fd = fd;
+	writer.count = 0;
+	if(sf_heap_walk(sf_map_write_entry, &writer) == -1)
+		return -1;
+	return sf_map_flush(&writer);
+}
@@ -1,10 +1,26 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include "debug.h"
 #include "sfmm.h"
 #include "sfhelper.h"
+#include "sfpage.h"
+#include "sfplace.h"
 
+/* The sfutil heap, using the list headers declared in sfmm.h. */
+sf_heap sf_main_heap = {
+	.free_list_heads = sf_free_list_heads,
+	.quick_lists = (sf_quick_list *)sf_quick_lists
+};
+sf_heap *sf_cur_heap = &sf_main_heap;
+
+/* Placement policy, and the number of fits SF_FIT_GOOD compares. */
+static int fit_policy = SF_FIT_FIRST;
+static unsigned int fit_max_fits = SF_DEFAULT_GOOD_FIT_PROBES;
+
+/* Block size from which requests are split off the top of a free block, 0 if never. */
+static sf_size_t split_threshold = 0;
 
 /* -------------------------------------------------------------------- */
 /* Functions to get and set block header and footer. */
@@ -109,23 +125,29 @@ int init_heap_and_lists(){
 	int i;
 	/*Initialize free lists. */
     for(i = 0; i < NUM_FREE_LISTS; i++){
-        sf_free_list_heads[i].prev_footer = 0;
-        sf_free_list_heads[i].header = 0;
-        sf_free_list_heads[i].body.links.next = &(sf_free_list_heads[i]);
-        sf_free_list_heads[i].body.links.prev = &(sf_free_list_heads[i]);
+        sf_cur_heap->free_list_heads[i].prev_footer = 0;
+        sf_cur_heap->free_list_heads[i].header = 0;
+        sf_cur_heap->free_list_heads[i].body.links.next = &(sf_cur_heap->free_list_heads[i]);
+        sf_cur_heap->free_list_heads[i].body.links.prev = &(sf_cur_heap->free_list_heads[i]);
     }
     /* Initialize quick lists. */
     for(i = 0; i < NUM_QUICK_LISTS; i++){
-        sf_quick_lists[i].length = 0;
-        sf_quick_lists[i].first = NULL;
+        sf_cur_heap->quick_lists[i].length = 0;
+        sf_cur_heap->quick_lists[i].first = NULL;
     }
+    /* The ordered index, if any, covers the new heap. */
+    sf_frlst_index_clear();
+    /* Growth starts over. */
+    sf_cur_heap->grow_pages = 0;
+    sf_cur_heap->grow_mark = 0;
 
 	/* Initialize heap. */
-	if(sf_mem_grow() == NULL)
+	if(sf_page_grow_chunk() == NULL)
 		return -1;
+	sf_cur_heap->stats.grows++;
 
-	void *start_ptr = sf_mem_start();
-	void *end_ptr = sf_mem_end();
+	void *start_ptr = sf_heap_start();
+	void *end_ptr = sf_heap_end();
 
 	/* Add Prologue Block. */
 	sf_block *prologue_ptr = (sf_block *)start_ptr;
@@ -183,19 +205,21 @@ sf_block *sf_qklst_remove(sf_size_t payload_size, sf_size_t block_size){
     	return NULL;
 
     /* If quick list at qindex is empty or too large, return NULL */
-    if(sf_quick_lists[qindex].length <= 0
-    	|| sf_quick_lists[qindex].length > QUICK_LIST_MAX
-    	|| sf_quick_lists[qindex].first == NULL)
+    if(sf_cur_heap->quick_lists[qindex].length <= 0
+    	|| sf_cur_heap->quick_lists[qindex].length > QUICK_LIST_MAX
+    	|| sf_cur_heap->quick_lists[qindex].first == NULL)
     {
+    	sf_cur_heap->stats.quick_misses[qindex]++;
     	return NULL;
     }
+    sf_cur_heap->stats.quick_hits[qindex]++;
 
     /* Remove and return the first block in the quick list at qindex*/
-	sf_block *blkp = sf_quick_lists[qindex].first;
-	sf_quick_lists[qindex].first = blkp->body.links.next;
+	sf_block *blkp = sf_cur_heap->quick_lists[qindex].first;
+	sf_cur_heap->quick_lists[qindex].first = blkp->body.links.next;
 	blkp->body.links.next = NULL;
 	/* Decrease the length of this quick list by 1. */
-	sf_quick_lists[qindex].length--;
+	sf_cur_heap->quick_lists[qindex].length--;
 
 
 	/* Update its header with payload size, block size,
@@ -212,6 +236,129 @@ sf_block *sf_qklst_remove(sf_size_t payload_size, sf_size_t block_size){
 }
 
 
+/* Return the index of the free list that holds blocks of the given size. */
+int sf_frlst_index(sf_size_t block_size){
+	int i=0, pow_2=1;
+	for(i=0; i<NUM_FREE_LISTS-1; i++)
+	{
+		if(block_size <= pow_2*SF_MIN_BLOCK_SIZE)
+			return i;
+		pow_2 = pow_2*2;
+	}
+
+	/* Larger blocks all go to the last index. */
+	return NUM_FREE_LISTS-1;
+}
+
+int sf_set_fit_policy(int policy, unsigned int max_fits){
+	if(policy != SF_FIT_FIRST && policy != SF_FIT_BEST && policy != SF_FIT_GOOD)
+	{
+		sf_errno = EINVAL;
+		return -1;
+	}
+	fit_policy = policy;
+	fit_max_fits = (max_fits == 0) ? SF_DEFAULT_GOOD_FIT_PROBES : max_fits;
+	return 0;
+}
+
+int sf_get_fit_policy(){
+	return fit_policy;
+}
+
+void sf_set_split_threshold(sf_size_t threshold){
+	split_threshold = threshold;
+	return;
+}
+
+sf_size_t sf_get_split_threshold(){
+	return split_threshold;
+}
+
+/* The free block in front of the epilogue, or NULL if the last block is allocated. */
+static sf_block *sf_tail_block(){
+	if(sf_heap_start() == sf_heap_end())
+		return NULL;
+	sf_header *epilogue = (sf_header *)((char *)sf_heap_end() - sizeof(sf_header));
+	if(get_prev_alloc(epilogue) != 0)
+		return NULL;
+	sf_footer *tail_ftrp = (sf_footer *)((char *)epilogue - sizeof(sf_footer));
+	return (sf_block *)((char *)tail_ftrp - get_block_size((sf_header *)tail_ftrp));
+}
+
+sf_block *sf_wilderness(){
+	if(!sf_cur_heap->wilderness)
+		return NULL;
+	return sf_tail_block();
+}
+
+void sf_wilderness_detach(){
+	sf_block *top = sf_wilderness();
+	if(top == NULL)
+		return;
+	/* sf_frlst_unlink() leaves the wilderness alone while the mode is on. */
+	sf_cur_heap->wilderness = false;
+	sf_frlst_unlink(top);
+	sf_cur_heap->wilderness = true;
+	return;
+}
+
+int sf_set_wilderness(bool enable){
+	if(enable == sf_cur_heap->wilderness)
+		return 0;
+
+	/* The top block leaves its free list, or goes back on it. */
+	if(enable)
+	{
+		sf_cur_heap->wilderness = true;
+		sf_wilderness_detach();
+	}
+	else
+	{
+		sf_block *top = sf_wilderness();
+		sf_cur_heap->wilderness = false;
+		if(top != NULL)
+			sf_frlst_link(top, sf_frlst_index(get_block_size(get_hdrp(top))));
+	}
+	return 0;
+}
+
+bool sf_get_wilderness(){
+	return sf_cur_heap->wilderness;
+}
+
+/* Pick a block of at least block_size from free list i according to the placement
+   policy, or return NULL if the list has none. */
+static sf_block *sf_frlst_fit(int i, sf_size_t block_size){
+	sf_block *dummy_ptr = &sf_cur_heap->free_list_heads[i];
+	sf_block *blkp = dummy_ptr->body.links.next;
+	sf_block *fit_blkp = NULL;
+	sf_size_t fit_size = 0;
+	unsigned int fits = 0;
+
+	while(blkp != dummy_ptr)
+	{
+		sf_size_t bsize = get_block_size(get_hdrp(blkp));
+		sf_cur_heap->stats.probes[i]++;
+		if(bsize >= block_size)
+		{
+			if(fit_blkp == NULL || bsize < fit_size)
+			{
+				fit_blkp = blkp;
+				fit_size = bsize;
+			}
+			fits++;
+
+			/* Stop at the first fit, at an exact fit, or after enough good fits. */
+			if(fit_policy == SF_FIT_FIRST || bsize == block_size)
+				break;
+			if(fit_policy == SF_FIT_GOOD && fits >= fit_max_fits)
+				break;
+		}
+		blkp = blkp->body.links.next;
+	}
+	return fit_blkp;
+}
+
 /* Try to find a block with given size from free lists, remove and return it.
    If not found, then return NULL. Update the header and pre alloc of next block. */
 sf_block *sf_frlst_remove(sf_size_t payload_size, sf_size_t block_size){
@@ -220,66 +367,63 @@ sf_block *sf_frlst_remove(sf_size_t payload_size, sf_size_t block_size){
 		return NULL;
 
 	/* Determine the findex to start searching.*/
-	int findex=-1, i=0, pow_2=1;
-	for(i=0; i<NUM_FREE_LISTS-1; i++)
-	{
-		if(block_size <= pow_2*SF_MIN_BLOCK_SIZE)
-		{
-			findex = i;
-			break;
-		}
-		pow_2 = pow_2*2;
-	}
-
-	/* If not found findex, go search last index */
-	if(findex == -1)
-		findex = NUM_FREE_LISTS-1;
+	int findex = sf_frlst_index(block_size), i=0;
 
 	/* In case wrong findex, return NULL. */
 	if(findex < 0 || findex >= NUM_FREE_LISTS)
 		return NULL;
 
-	/* Searching start from findex. */
-	sf_block *blkp;
+	/* Searching start from findex, up to and including the last list, which holds
+	   every block larger than 256M. */
+	sf_block *blkp = NULL;
 	sf_header *hdrp, header;
-	for(i=findex; i<NUM_FREE_LISTS-1; i++)
+	sf_cur_heap->stats.searches[findex]++;
+	for(i=findex; i<NUM_FREE_LISTS; i++)
 	{
-		/* Iterate each free list.*/
-		blkp = &sf_free_list_heads[i];
-		while(blkp->body.links.next != &sf_free_list_heads[i])
+		/* If found suitable block, then remove it from list. */
+		blkp = sf_frlst_fit(i, block_size);
+		if(blkp != NULL)
 		{
-			blkp = blkp->body.links.next;
-			/* If found suitable block, then remove it from list and return */
-			if( get_block_size(get_hdrp(blkp)) >= block_size)
-			{
-				/* Remove and set links.*/
-				(blkp->body.links.prev)->body.links.next = blkp->body.links.next;
-				(blkp->body.links.next)->body.links.prev = blkp->body.links.prev;
-				blkp->body.links.prev = NULL;
-				blkp->body.links.next = NULL;
-
-				/* Split block if needed. Function split_block will split the block if possible,
-				   return the lower block pointer and insert upper block back to free list. */
-				blkp = split_block(blkp, payload_size, block_size);
-
-				/* Update its header with payload size, block size,
-			       alloc = 1, keep prev_alloc the same, and in_qklst = 0. */
-			    /* Ignore footer. */
-			    hdrp = get_hdrp(blkp);
-			    header = pack_header(payload_size, block_size, 1, get_prev_alloc(hdrp), 0);
-			    set_header(hdrp, header);
-
-			    /* Set the prev alloc of next block to 1 and keep the rest the same. */
-    			set_next_prev_alloc(blkp, 1);
-
-				/* Return the block found. */
-				return blkp;
-			}
+			/* Remove and set links.*/
+			sf_frlst_unlink(blkp);
+			break;
 		}
 	}
 
+	/* Carve from the wilderness only when no other free block fits. */
+	bool top = false;
+	if(blkp == NULL)
+	{
+		blkp = sf_wilderness();
+		if(blkp != NULL && get_block_size(get_hdrp(blkp)) < block_size)
+			blkp = NULL;
+		top = true;
+	}
+
 	/* If not found any block, return NULL. */
-	return NULL;
+	if(blkp == NULL)
+		return NULL;
+
+	/* Split block if needed. Function split_block will split the block if possible,
+	   return the lower block pointer and insert upper block back to free list.
+	   Requests at or above the split threshold take the upper part instead. */
+	if(split_threshold != 0 && block_size >= split_threshold && !top)
+		blkp = split_block_upper(blkp, payload_size, block_size);
+	else
+		blkp = split_block(blkp, payload_size, block_size);
+
+	/* Update its header with payload size, block size,
+	   alloc = 1, keep prev_alloc the same, and in_qklst = 0. */
+	/* Ignore footer.  If the block was not split, it keeps its whole size. */
+	hdrp = get_hdrp(blkp);
+	header = pack_header(payload_size, get_block_size(hdrp), 1, get_prev_alloc(hdrp), 0);
+	set_header(hdrp, header);
+
+	/* Set the prev alloc of next block to 1 and keep the rest the same. */
+	set_next_prev_alloc(blkp, 1);
+
+	/* Return the block found. */
+	return blkp;
 }
 
 
@@ -309,7 +453,7 @@ int sf_qklst_insert(sf_block *block_ptr){
 		return -1;
 
 	/* If quick list at qindex is full, flush it */
-    if(sf_quick_lists[qindex].length >= QUICK_LIST_MAX)
+    if(sf_cur_heap->quick_lists[qindex].length >= QUICK_LIST_MAX)
     {
     	if(sf_flush_qklst(qindex) == -1)
     	{
@@ -325,9 +469,9 @@ int sf_qklst_insert(sf_block *block_ptr){
 	set_next_prev_alloc(block_ptr, 1);
 
 	/* Insert into the front of quick list at qindex. */
-	block_ptr->body.links.next = sf_quick_lists[qindex].first;
-	sf_quick_lists[qindex].first = block_ptr;
-	sf_quick_lists[qindex].length ++;
+	block_ptr->body.links.next = sf_cur_heap->quick_lists[qindex].first;
+	sf_cur_heap->quick_lists[qindex].first = block_ptr;
+	sf_cur_heap->quick_lists[qindex].length ++;
 
 	return 0;
 }
@@ -357,30 +501,16 @@ int sf_frlst_insert(sf_block *block_ptr){
 	sf_size_t csize = get_block_size(chdrp);
 
 	/* Determine the index of free lists to insert. */
-	int findex=-1, i=0, pow_2=1;
-	for(i=0; i<NUM_FREE_LISTS-1; i++)
-	{
-		if(csize <= pow_2*SF_MIN_BLOCK_SIZE)
-		{
-			findex = i;
-			break;
-		}
-		pow_2 = pow_2*2;
-	}
-	/* If not found findex, goto last index. */
-	if(findex == -1)
-		findex = NUM_FREE_LISTS-1;
+	int findex = sf_frlst_index(csize);
 
 	/* In case wrong findex, return -1. */
 	if(findex < 0 || findex >= NUM_FREE_LISTS)
 		return -1;
 
-	/* Insert coalesce block into free list at findex. */
-	sf_block *dummy_ptr = &sf_free_list_heads[findex];
-	(dummy_ptr->body.links.next)->body.links.prev = cblkp;
-	cblkp->body.links.next = dummy_ptr->body.links.next;
-	dummy_ptr->body.links.next = cblkp;
-	cblkp->body.links.prev = dummy_ptr;
+	/* Insert coalesce block into free list at findex: at the head, or in address order.
+	   The wilderness stays off the lists. */
+	if(cblkp != sf_wilderness())
+		sf_frlst_link(cblkp, findex);
 
 	/* Set the prev alloc bit of next block to 0. */
 	set_next_prev_alloc(cblkp, 0);
@@ -409,6 +539,7 @@ sf_block *split_block(sf_block *block_ptr, sf_size_t new_payload_size, sf_size_t
 
 	/* Split the block into lower block and upper block. */
 	sf_block *lower_blkp = block_ptr;
+	sf_cur_heap->stats.splits++;
 
 	/* Update only header for lower block. The alloc bit is becomes 1.*/
 	set_header(get_hdrp(lower_blkp), pack_header(new_payload_size, new_block_size, 1, get_prev_alloc(get_hdrp(lower_blkp)), 0));
@@ -431,6 +562,41 @@ sf_block *split_block(sf_block *block_ptr, sf_size_t new_payload_size, sf_size_t
 }
 
 
+/* Like split_block, but the upper block is the one to be allocated: update the header
+   and footer for both blocks, insert the lower block back into free list, and return
+   the upper block pointer.  If cannot split, return the original block pointer. */
+sf_block *split_block_upper(sf_block *block_ptr, sf_size_t new_payload_size, sf_size_t new_block_size){
+	/* Get header address and original size. */
+	sf_header *hdrp = get_hdrp(block_ptr);
+	sf_size_t original_size = get_block_size(hdrp);
+
+	/* Cannot split smaller block, or split would cause splinter. */
+	if(original_size < new_block_size || (original_size - new_block_size) < SF_MIN_BLOCK_SIZE)
+		return block_ptr;
+
+	sf_block *lower_blkp = block_ptr;
+	sf_size_t lower_size = original_size - new_block_size;
+	sf_cur_heap->stats.splits++;
+	sf_cur_heap->stats.high_splits++;
+
+	/* Lower block keeps the pre alloc bit of the original block and stays free. */
+	sf_header lower_header = pack_header(0, lower_size, 0, get_prev_alloc(hdrp), 0);
+	set_header(get_hdrp(lower_blkp), lower_header);
+	set_footer(get_ftrp(lower_blkp), (sf_footer)lower_header);
+
+	/* Upper block is soon going to be allocated, so its alloc bit is 1 and it has no footer. */
+	sf_block *upper_blkp = get_next_blkp(lower_blkp);
+	set_header(get_hdrp(upper_blkp), pack_header(new_payload_size, new_block_size, 1, 0, 0));
+
+	/* Insert lower block back into free lists.  Its neighbours are both allocated,
+	   so it does not coalesce. */
+	if(sf_frlst_insert(lower_blkp) == -1)
+		return block_ptr;
+
+	/* Return upper block as the block to be allocate. */
+	return upper_blkp;
+}
+
 /* Coalesce previous and next block if possible.
    If cannot coalesce, then return the original block pointer without any change.
    If coalescing made, update the new header and footer,
@@ -452,12 +618,10 @@ sf_block *coalesce_block(sf_block *block_ptr){
 	{
 		/* Get previous block address. */
 		sf_block *prev_blkp = get_prev_blkp(current_blkp);
+		sf_cur_heap->stats.coalesces++;
 
 		/* Remove previous block out of free lists. */
-		(prev_blkp->body.links.prev)->body.links.next = prev_blkp->body.links.next;
-		(prev_blkp->body.links.next)->body.links.prev = prev_blkp->body.links.prev;
-		prev_blkp->body.links.prev = NULL;
-		prev_blkp->body.links.next = NULL;
+		sf_frlst_unlink(prev_blkp);
 
 		/* Get previous header address. */
 		sf_header *prev_hdrp = get_hdrp(prev_blkp);
@@ -483,11 +647,10 @@ sf_block *coalesce_block(sf_block *block_ptr){
 	/* If next is free too, then coalesce the next block. */
 	if(get_alloc(next_hdrp) == 0)
 	{
+		sf_cur_heap->stats.coalesces++;
+
 		/* Remove next block out of free lists. */
-		(next_blkp->body.links.prev)->body.links.next = next_blkp->body.links.next;
-		(next_blkp->body.links.next)->body.links.prev = next_blkp->body.links.prev;
-		next_blkp->body.links.prev = NULL;
-		next_blkp->body.links.next = NULL;
+		sf_frlst_unlink(next_blkp);
 
 		/* Get next block size. */
 		sf_size_t next_size = get_block_size(next_hdrp);
@@ -510,7 +673,7 @@ sf_block *coalesce_block(sf_block *block_ptr){
 int sf_create_new_page(){
 
 	/* Increase heap size. */
-	void *previous_heap_end = sf_mem_grow();
+	void *previous_heap_end = sf_page_grow_chunk();
 	if(previous_heap_end == NULL)
 		return -1;
 
@@ -518,14 +681,35 @@ int sf_create_new_page(){
 	sf_header *old_epilogue = (sf_header *) ((char *)previous_heap_end - sizeof(sf_header));
 	unsigned int old_pre_alloc = get_prev_alloc(old_epilogue);
 
+	sf_cur_heap->stats.grows++;
+
 	/* Update new Epilogue. */
-	void *new_heap_end = sf_mem_end();
+	void *new_heap_end = sf_heap_end();
 	sf_header *new_epilogue = (sf_header *) ((char *)new_heap_end - sizeof(sf_header));
 
 	/* New Epilogue Header: 0 payload, 0 block size, 1 alloca bit, 0 pre alloc bit, 0 qklst bit. */
 	sf_header epilogue_header = pack_header(0, 0, 1, 0, 0);
 	set_header(new_epilogue, epilogue_header);
 
+	/* The wilderness grows in place: the new pages are added to the top block,
+	   or become the top block if the last block is allocated. */
+	if(sf_cur_heap->wilderness)
+	{
+		sf_block *top_blkp = (sf_block *)((char *)previous_heap_end - sizeof(sf_header) - sizeof(sf_footer));
+		sf_size_t top_size = 0;
+		if(old_pre_alloc == 0)
+		{
+			top_size = get_block_size((sf_header *)((char *)old_epilogue - sizeof(sf_footer)));
+			top_blkp = (sf_block *)((char *)top_blkp - top_size);
+			old_pre_alloc = get_prev_alloc(get_hdrp(top_blkp));
+		}
+		top_size = top_size + (sf_size_t)((char *)new_heap_end - (char *)previous_heap_end);
+		sf_header top_header = pack_header(0, top_size, 0, old_pre_alloc, 0);
+		set_header(get_hdrp(top_blkp), top_header);
+		set_footer(get_ftrp(top_blkp), (sf_footer)top_header);
+		return 0;
+	}
+
 	/* Update the new block created. */
 	sf_block *new_blkp = (sf_block *)((char *)previous_heap_end - sizeof(sf_header) - sizeof(sf_footer));
 
@@ -544,18 +728,46 @@ int sf_create_new_page(){
 	return 0;
 }
 
+/* Rewrite the headers, and the footers of free blocks, of the current heap from an old
+   MAGIC to the current one. */
+void sf_heap_remagic(sf_header old_magic){
+	sf_header delta = old_magic ^ MAGIC;
+	char *heap_start = sf_heap_start();
+	if(delta == 0 || heap_start == (char *)sf_heap_end())
+		return;
+
+	sf_block *blkp = (sf_block *)heap_start;
+	blkp->header = blkp->header ^ delta;
+	blkp = (sf_block *)(heap_start + sizeof(sf_block));
+	while(1)
+	{
+		blkp->header = blkp->header ^ delta;
+		if(get_block_size(get_hdrp(blkp)) == 0)
+			break;
+		if(get_alloc(get_hdrp(blkp)) == 0)
+		{
+			sf_footer *ftrp = get_ftrp(blkp);
+			*ftrp = *ftrp ^ delta;
+		}
+		blkp = get_next_blkp(blkp);
+	}
+	return;
+}
+
 /* When try to insert a block into a quick list, but the quick list is full (reached QUICK_LIST_MAX).
    This function removes all the block in that quick list and insert them into free lists. */
 int sf_flush_qklst(int index){
 
+	sf_cur_heap->stats.flushes++;
+
 	/* Iterate each block in the quick list at index. */
 	sf_block *blkp;
-	while(sf_quick_lists[index].first != NULL){
-		blkp = sf_quick_lists[index].first;
+	while(sf_cur_heap->quick_lists[index].first != NULL){
+		blkp = sf_cur_heap->quick_lists[index].first;
 
 		/* Remove block from quick list. */
-		sf_quick_lists[index].first = blkp->body.links.next;
-		sf_quick_lists[index].length--;
+		sf_cur_heap->quick_lists[index].first = blkp->body.links.next;
+		sf_cur_heap->quick_lists[index].length--;
 
 		/* Insert the removed block into free list. */
 		if(sf_frlst_insert(blkp) == -1)
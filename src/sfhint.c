@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfhelper.h"
+#include "sfplace.h"
+#include "sfhint.h"
+
+/* The sub-heap of a lifetime group, created on first use. */
+static sf_arena *sf_hint_heap(int hint){
+	sf_arena **heapp = &sf_cur_heap->hint_heaps[hint - 1];
+	if(*heapp != NULL)
+		return *heapp;
+
+	size_t capacity = SF_HINT_HEAP_CAPACITY;
+	if(sf_cur_heap->base != NULL)
+		capacity = (size_t)(sf_cur_heap->limit - sf_cur_heap->base);
+	sf_arena *arena = sf_arena_create(capacity);
+	if(arena == NULL)
+		return NULL;
+
+	/* Place blocks the way the parent heap does. */
+	if(sf_cur_heap->frlst_order != SF_ORDER_LIFO)
+		sf_arena_set_frlst_order(arena, sf_cur_heap->frlst_order);
+	sf_arena_set_wilderness(arena, sf_cur_heap->wilderness);
+
+	*heapp = arena;
+	sf_cur_heap->sub_heaps = true;
+	return arena;
+}
+
+void *sf_malloc_hint(sf_size_t size, int hint){
+	if(hint == SF_HINT_NONE)
+		return sf_malloc(size);
+	if(hint != SF_HINT_SHORT && hint != SF_HINT_LONG)
+	{
+		sf_errno = EINVAL;
+		return NULL;
+	}
+
+	/* If the request size is 0, then return NULL without setting sf_errno. */
+	if(size == 0)
+		return NULL;
+
+	sf_arena *arena = sf_hint_heap(hint);
+	if(arena == NULL)
+		return NULL;
+	return sf_arena_malloc(arena, size);
+}
+
+int sf_hint_get_stats(int hint, struct sf_stats *stats){
+	if(hint == SF_HINT_NONE)
+	{
+		sf_get_stats(stats);
+		return 0;
+	}
+	if(hint != SF_HINT_SHORT && hint != SF_HINT_LONG)
+	{
+		sf_errno = EINVAL;
+		return -1;
+	}
+
+	sf_arena *arena = sf_cur_heap->hint_heaps[hint - 1];
+	if(arena == NULL)
+		memset(stats, 0, sizeof(*stats));
+	else
+		sf_arena_get_stats(arena, stats);
+	return 0;
+}
+
+sf_arena *sf_hint_owner(void *ptr){
+	int i;
+	for(i = 0; i < SF_NUM_HINT_HEAPS; i++)
+	{
+		sf_arena *arena = sf_cur_heap->hint_heaps[i];
+		if(arena != NULL && sf_arena_contains(arena, ptr))
+			return arena;
+	}
+	return NULL;
+}
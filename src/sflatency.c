@@ -0,0 +1,228 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfhelper.h"
+#include "sfpage.h"
+#include "sfalign.h"
+#include "sflatency.h"
+#include "sftrace.h"
+
+typedef struct sf_latency_hist {
+	uint64_t count;
+	uint64_t sum_ns;
+	uint64_t min_ns;
+	uint64_t max_ns;
+	uint64_t buckets[SF_LATENCY_BUCKETS];
+} sf_latency_hist;
+
+#ifdef SF_LATENCY
+
+/* One histogram per operation and size class, plus one per operation for all classes. */
+static sf_latency_hist latency_hists[SF_LATENCY_NUM_OPS][NUM_FREE_LISTS + 1];
+
+static uint64_t sf_latency_now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/* Values below SF_LATENCY_SUB_BUCKETS get a bucket each.  Above that, each power of
+   two is split into SF_LATENCY_SUB_BUCKETS buckets of equal width. */
+static int sf_latency_bucket(uint64_t ns){
+	if(ns < SF_LATENCY_SUB_BUCKETS)
+		return (int)ns;
+
+	int exp = 63 - __builtin_clzll(ns);
+	if(exp > SF_LATENCY_MAX_EXP)
+		return SF_LATENCY_BUCKETS - 1;
+
+	int sub = (int)(ns >> (exp - SF_LATENCY_SUB_BITS)) & (SF_LATENCY_SUB_BUCKETS - 1);
+	return (exp - SF_LATENCY_SUB_BITS + 1) * SF_LATENCY_SUB_BUCKETS + sub;
+}
+
+/* Largest value that falls in the given bucket. */
+static uint64_t sf_latency_bucket_high(int bucket){
+	if(bucket < SF_LATENCY_SUB_BUCKETS)
+		return (uint64_t)bucket;
+
+	int exp = bucket / SF_LATENCY_SUB_BUCKETS + SF_LATENCY_SUB_BITS - 1;
+	uint64_t sub = (uint64_t)(bucket % SF_LATENCY_SUB_BUCKETS);
+	uint64_t width = (uint64_t)1 << (exp - SF_LATENCY_SUB_BITS);
+	return (SF_LATENCY_SUB_BUCKETS + sub + 1) * width - 1;
+}
+
+static void sf_latency_add(sf_latency_hist *hist, uint64_t ns){
+	if(hist->count == 0 || ns < hist->min_ns)
+		hist->min_ns = ns;
+	if(ns > hist->max_ns)
+		hist->max_ns = ns;
+	hist->count++;
+	hist->sum_ns = hist->sum_ns + ns;
+	hist->buckets[sf_latency_bucket(ns)]++;
+	return;
+}
+
+static void sf_latency_record(int op, int size_class, uint64_t ns){
+	if(size_class >= 0)
+		sf_latency_add(&latency_hists[op][size_class], ns);
+	sf_latency_add(&latency_hists[op][NUM_FREE_LISTS], ns);
+	return;
+}
+
+/* Size class of a request, with the block size computed as in sf_malloc(). */
+static int sf_latency_request_class(sf_size_t size){
+	size_t bsize = (size_t)size + sizeof(sf_header);
+	if(bsize < SF_MIN_BLOCK_SIZE)
+		bsize = SF_MIN_BLOCK_SIZE;
+	bsize = (bsize + SF_ALIGN_SIZE - 1) & ~((size_t)SF_ALIGN_SIZE - 1);
+	if(bsize > UINT32_MAX)
+		return NUM_FREE_LISTS - 1;
+	return sf_frlst_index((sf_size_t)bsize);
+}
+
+/* Size class of the block being freed, or -1 if ptr does not point into the heap. */
+static int sf_latency_block_class(void *ptr){
+	if(ptr == NULL || ((uintptr_t)ptr % SF_ALIGN_SIZE) != 0)
+		return -1;
+	if((char *)ptr < (char *)sf_heap_start() + sizeof(sf_block) || (char *)ptr >= (char *)sf_heap_end())
+		return -1;
+
+	sf_block *blkp = (sf_block *)((char *)ptr - sizeof(sf_header) - sizeof(sf_footer));
+	return sf_frlst_index(get_block_size(get_hdrp(blkp)));
+}
+
+/* Value at the given percentile, in millionths (990000 is p99). */
+static uint64_t sf_latency_percentile(sf_latency_hist *hist, uint64_t millionths){
+	uint64_t rank = (hist->count * millionths + 999999) / 1000000;
+	if(rank == 0)
+		rank = 1;
+
+	uint64_t seen = 0;
+	int i;
+	for(i = 0; i < SF_LATENCY_BUCKETS; i++)
+	{
+		seen = seen + hist->buckets[i];
+		if(seen >= rank)
+			break;
+	}
+
+	/* The bucket bound can lie outside what was actually recorded. */
+	uint64_t ns = sf_latency_bucket_high(i);
+	if(ns > hist->max_ns)
+		ns = hist->max_ns;
+	if(ns < hist->min_ns)
+		ns = hist->min_ns;
+	return ns;
+}
+
+#endif
+
+#ifdef SF_INSTRUMENTED
+
+void *sf_malloc(sf_size_t size){
+#ifdef SF_LATENCY
+	uint64_t start_ns = sf_latency_now();
+	void *pp = sf_malloc_untimed(size);
+	uint64_t ns = sf_latency_now() - start_ns;
+	sf_latency_record(SF_LATENCY_MALLOC, sf_latency_request_class(size), ns);
+#else
+	void *pp = sf_malloc_untimed(size);
+#endif
+
+#ifdef SF_TRACE
+	sf_trace_record(SF_TRACE_MALLOC, pp, NULL, size);
+#endif
+	return pp;
+}
+
+void sf_free(void *ptr){
+	/* Trace the free before the block can be handed out again. */
+#ifdef SF_TRACE
+	sf_trace_record(SF_TRACE_FREE, ptr, NULL, 0);
+#endif
+
+#ifdef SF_LATENCY
+	int size_class = sf_latency_block_class(ptr);
+	uint64_t start_ns = sf_latency_now();
+	sf_free_untimed(ptr);
+	uint64_t ns = sf_latency_now() - start_ns;
+	sf_latency_record(SF_LATENCY_FREE, size_class, ns);
+#else
+	sf_free_untimed(ptr);
+#endif
+	return;
+}
+
+void *sf_realloc(void *ptr, sf_size_t size){
+#ifdef SF_LATENCY
+	uint64_t start_ns = sf_latency_now();
+	void *pp = sf_realloc_untimed(ptr, size);
+	uint64_t ns = sf_latency_now() - start_ns;
+	sf_latency_record(SF_LATENCY_REALLOC, sf_latency_request_class(size), ns);
+#else
+	void *pp = sf_realloc_untimed(ptr, size);
+#endif
+
+#ifdef SF_TRACE
+	sf_trace_record(SF_TRACE_REALLOC, pp, ptr, size);
+#endif
+	return pp;
+}
+
+/* Recorded as a malloc of the aligned block, not of the larger block carved up for it. */
+void *sf_memalign(sf_size_t align, sf_size_t size){
+#ifdef SF_LATENCY
+	uint64_t start_ns = sf_latency_now();
+	void *pp = sf_memalign_untimed(align, size);
+	uint64_t ns = sf_latency_now() - start_ns;
+	sf_latency_record(SF_LATENCY_MALLOC, sf_latency_request_class(size), ns);
+#else
+	void *pp = sf_memalign_untimed(align, size);
+#endif
+
+#ifdef SF_TRACE
+	sf_trace_record(SF_TRACE_MALLOC, pp, NULL, size);
+#endif
+	return pp;
+}
+
+#endif
+
+int sf_get_latency(int op, int size_class, struct sf_latency_stats *lat){
+	if(op < 0 || op >= SF_LATENCY_NUM_OPS || size_class < SF_LATENCY_ALL_CLASSES || size_class >= NUM_FREE_LISTS)
+	{
+		sf_errno = EINVAL;
+		return -1;
+	}
+
+	memset(lat, 0, sizeof(*lat));
+
+#ifdef SF_LATENCY
+	sf_latency_hist *hist = &latency_hists[op][(size_class == SF_LATENCY_ALL_CLASSES) ? NUM_FREE_LISTS : size_class];
+	if(hist->count == 0)
+		return 0;
+
+	lat->count = hist->count;
+	lat->min_ns = hist->min_ns;
+	lat->max_ns = hist->max_ns;
+	lat->mean_ns = hist->sum_ns / hist->count;
+	lat->p50_ns = sf_latency_percentile(hist, 500000);
+	lat->p90_ns = sf_latency_percentile(hist, 900000);
+	lat->p99_ns = sf_latency_percentile(hist, 990000);
+	lat->p999_ns = sf_latency_percentile(hist, 999000);
+#endif
+
+	return 0;
+}
+
+void sf_reset_latency(){
+#ifdef SF_LATENCY
+	memset(latency_hists, 0, sizeof(latency_hists));
+#endif
+	return;
+}
@@ -9,9 +9,15 @@
 #include "debug.h"
 #include "sfmm.h"
 #include "sfhelper.h"
+#include "sfpage.h"
+#include "sfregion.h"
+#include "sfarena.h"
+#include "sfhint.h"
+#include "sftag.h"
+#include "sflatency.h"
 
 
-void *sf_malloc(sf_size_t size) {
+void *SF_UNTIMED(sf_malloc)(sf_size_t size) {
     sf_block *target_block_ptr = NULL;
 
     /* If the request size is 0, then return NULL without setting sf_errno. */
@@ -21,14 +27,12 @@ void *sf_malloc(sf_size_t size) {
     }
 
     /* If the heap size is 0, then initialize heap, quick lists, and free lists. */
-    void *heap_start = sf_mem_start();
-    void *heap_end = sf_mem_end();
+    void *heap_start = sf_heap_start();
+    void *heap_end = sf_heap_end();
     if(heap_start == heap_end)
     {
-        /* Set global variables to 0. */
-        total_payload_size = 0;
-        total_allocated_block_size = 0;
-        max_aggregate_payload = 0;
+        /* Set statistics to 0. */
+        memset(&sf_cur_heap->stats, 0, sizeof(sf_cur_heap->stats));
         if(init_heap_and_lists() == -1)
         {
             sf_errno = ENOMEM;
@@ -47,17 +51,15 @@ void *sf_malloc(sf_size_t size) {
         bsize = bsize + (SF_ALIGN_SIZE - (bsize % SF_ALIGN_SIZE));      // add padding.
     }
 
+    /* Check the quick lists.  Growing the heap never adds blocks to them,
+       so they only need to be checked once. */
+    target_block_ptr = sf_qklst_remove(size, bsize);
+
     /* Run while loop until a target block is found. */
     while(target_block_ptr == NULL)
     {
-        /* Check the quick lists. */
-        target_block_ptr = sf_qklst_remove(size, bsize);
-
         /* If target block not found in quick list, then go check free lists. */
-        if(target_block_ptr == NULL)
-        {
-            target_block_ptr = sf_frlst_remove(size, bsize);
-        }
+        target_block_ptr = sf_frlst_remove(size, bsize);
 
         /* If target block not found in free list, then call sf_mem_grow(). */
         if(target_block_ptr == NULL)
@@ -71,11 +73,12 @@ void *sf_malloc(sf_size_t size) {
 
     }
 
-    /* Update global variable. */
-    total_payload_size = total_payload_size + size;
-    total_allocated_block_size = total_allocated_block_size + bsize;
-    if(total_payload_size  > max_aggregate_payload)
-        max_aggregate_payload = total_payload_size;
+    /* Update statistics. */
+    sf_cur_heap->stats.mallocs++;
+    sf_cur_heap->stats.payload_bytes = sf_cur_heap->stats.payload_bytes + size;
+    sf_cur_heap->stats.allocated_bytes = sf_cur_heap->stats.allocated_bytes + get_block_size(get_hdrp(target_block_ptr));
+    if(sf_cur_heap->stats.payload_bytes > sf_cur_heap->stats.peak_payload_bytes)
+        sf_cur_heap->stats.peak_payload_bytes = sf_cur_heap->stats.payload_bytes;
 
     // /* Once got the target block point to be allocate.*/
     // /* Update its header with payload size, block size,
@@ -97,7 +100,7 @@ void *sf_malloc(sf_size_t size) {
     return payload_ptr;
 }
 
-void sf_free(void *pp) {
+void SF_UNTIMED(sf_free)(void *pp) {
 
     /* Verify that the pointer being passed to your function belongs to an allocated block. */
 
@@ -106,6 +109,28 @@ void sf_free(void *pp) {
     {
         abort();
     }
+
+    /* Blocks from the region are only freed by sf_region_reset(). */
+    if(sf_region_owns(pp))
+    {
+        return;
+    }
+    /* Hinted blocks and blocks of a pinned tag are freed in their sub-heap.  The call
+       stays in the untimed layer, so it is only traced and timed once. */
+    if(sf_cur_heap->sub_heaps)
+    {
+        sf_arena *sub_heap = sf_hint_owner(pp);
+        if(sub_heap == NULL)
+            sub_heap = sf_tag_owner(pp);
+        if(sub_heap != NULL)
+        {
+            sf_heap *saved_heap = sf_cur_heap;
+            sf_cur_heap = sf_arena_heap(sub_heap);
+            SF_UNTIMED(sf_free)(pp);
+            sf_cur_heap = saved_heap;
+            return;
+        }
+    }
     /* The pointer is not 16-byte aligned. */
     if( ((unsigned long)pp & 0xF) != 0)
     {
@@ -141,7 +166,7 @@ void sf_free(void *pp) {
 
     /* The header of the block is before the start of the first block of the heap,
        or the footer of the block is after the end of the last block in the heap. */
-    if( ((void *)get_hdrp(pp_blkp) <= sf_mem_start()) || ((void *)get_ftrp(pp_blkp) >= sf_mem_end()))
+    if( ((void *)get_hdrp(pp_blkp) <= sf_heap_start()) || ((void *)get_ftrp(pp_blkp) >= sf_heap_end()))
     {
         abort();
     }
@@ -168,6 +193,9 @@ void sf_free(void *pp) {
         }
     }
 
+    /* A tagged block leaves its tag behind. */
+    sf_tag_free_block(pp_blkp);
+
     if(sf_qklst_insert(pp_blkp) == -1)
     {
         if(sf_frlst_insert(pp_blkp) == -1)
@@ -176,16 +204,20 @@ void sf_free(void *pp) {
         }
     }
 
-    /* Update global variable. */
-    total_payload_size = total_payload_size - pp_payload_size;
-    total_allocated_block_size = total_allocated_block_size - pp_block_size;
-    if(total_payload_size  >  max_aggregate_payload)
-        max_aggregate_payload = total_payload_size;
+    /* Give the free tail back to the page source if it has grown too large,
+       and release the interior of large free blocks if the scavenger is on. */
+    sf_trim_if_needed();
+    sf_scavenge_if_needed();
+
+    /* Update statistics. */
+    sf_cur_heap->stats.frees++;
+    sf_cur_heap->stats.payload_bytes = sf_cur_heap->stats.payload_bytes - pp_payload_size;
+    sf_cur_heap->stats.allocated_bytes = sf_cur_heap->stats.allocated_bytes - pp_block_size;
 
     return;
 }
 
-void *sf_realloc(void *pp, sf_size_t rsize) {
+void *SF_UNTIMED(sf_realloc)(void *pp, sf_size_t rsize) {
     /* Verify that the pointer being passed to your function belongs to an allocated block. */
 
     /* The pointer is NULL. */
@@ -194,6 +226,28 @@ void *sf_realloc(void *pp, sf_size_t rsize) {
         sf_errno = EINVAL;
         return NULL;
     }
+
+    /* Blocks from the region are resized inside the region. */
+    if(sf_region_owns(pp))
+    {
+        return sf_region_realloc(pp, rsize);
+    }
+    /* Hinted blocks and blocks of a pinned tag are resized inside their sub-heap,
+       without going through the instrumented sf_realloc() again. */
+    if(sf_cur_heap->sub_heaps)
+    {
+        sf_arena *sub_heap = sf_hint_owner(pp);
+        if(sub_heap == NULL)
+            sub_heap = sf_tag_owner(pp);
+        if(sub_heap != NULL)
+        {
+            sf_heap *saved_heap = sf_cur_heap;
+            sf_cur_heap = sf_arena_heap(sub_heap);
+            void *new_ptr = SF_UNTIMED(sf_realloc)(pp, rsize);
+            sf_cur_heap = saved_heap;
+            return new_ptr;
+        }
+    }
     /* The pointer is not 16-byte aligned. */
     if( ((unsigned long)pp & 0xF) != 0)
     {
@@ -233,7 +287,7 @@ void *sf_realloc(void *pp, sf_size_t rsize) {
 
     /* The header of the block is before the start of the first block of the heap,
        or the footer of the block is after the end of the last block in the heap. */
-    if(((void *)get_hdrp(pp_blkp) <= sf_mem_start()) || ((void *)get_ftrp(pp_blkp) >= sf_mem_end()))
+    if(((void *)get_hdrp(pp_blkp) <= sf_heap_start()) || ((void *)get_ftrp(pp_blkp) >= sf_heap_end()))
     {
         sf_errno = EINVAL;
         return NULL;
@@ -257,7 +311,7 @@ void *sf_realloc(void *pp, sf_size_t rsize) {
        the allocated block and return NULL without setting sf_errno. */
     if(rsize == 0)
     {
-        sf_free(pp);
+        SF_UNTIMED(sf_free)(pp);
         return NULL;
     }
 
@@ -285,7 +339,7 @@ void *sf_realloc(void *pp, sf_size_t rsize) {
         if(pp_block_size < new_bsize)
         {
             /* 1. Call sf_malloc to obtain a larger block. */
-            void *new_ptr = sf_malloc(rsize);
+            void *new_ptr = SF_UNTIMED(sf_malloc)(rsize);
 
             /* If sf_malloc returns NULL, sf_realloc must also return NULL. */
             if(new_ptr == NULL)
@@ -297,12 +351,15 @@ void *sf_realloc(void *pp, sf_size_t rsize) {
                to the block returned by sf_malloc.  Be sure to copy the entire
                payload area, but no more. */
             memcpy(new_ptr, pp, (size_t)pp_payload_size);
+            sf_tag_realloc_block(pp_blkp, (sf_block *)((char *)new_ptr - sizeof(sf_header) - sizeof(sf_footer)),
+                pp_payload_size, pp_block_size);
 
             /* 3. Call sf_free on the block given by the client (inserting into a quick list
                or main freelist and coalescing if required). */
-            sf_free(pp);
+            SF_UNTIMED(sf_free)(pp);
 
             /* 4. Return the block given to you by sf_malloc to the client. */
+            sf_cur_heap->stats.reallocs++;
             return new_ptr;
         }
 
@@ -313,11 +370,13 @@ void *sf_realloc(void *pp, sf_size_t rsize) {
             set_header(pp_hdrp, pack_header(rsize,
                 get_block_size(pp_hdrp), get_alloc(pp_hdrp), get_prev_alloc(pp_hdrp), get_in_qklst(pp_hdrp)));
 
-            /* Update global variable. */
-            total_payload_size = total_payload_size - pp_payload_size + rsize;
-            total_allocated_block_size = total_allocated_block_size - pp_block_size + get_block_size(pp_hdrp);
-            if(total_payload_size  >  max_aggregate_payload)
-                max_aggregate_payload = total_payload_size;
+            /* Update statistics. */
+            sf_cur_heap->stats.reallocs++;
+            sf_cur_heap->stats.payload_bytes = sf_cur_heap->stats.payload_bytes - pp_payload_size + rsize;
+            sf_cur_heap->stats.allocated_bytes = sf_cur_heap->stats.allocated_bytes - pp_block_size + get_block_size(pp_hdrp);
+            if(sf_cur_heap->stats.payload_bytes > sf_cur_heap->stats.peak_payload_bytes)
+                sf_cur_heap->stats.peak_payload_bytes = sf_cur_heap->stats.payload_bytes;
+            sf_tag_realloc_block(pp_blkp, pp_blkp, pp_payload_size, pp_block_size);
 
             /* Return original pp */
             return pp;
@@ -335,11 +394,11 @@ void *sf_realloc(void *pp, sf_size_t rsize) {
         set_header(shdrp, pack_header(rsize,
             get_block_size(shdrp), get_alloc(shdrp), get_prev_alloc(shdrp), get_in_qklst(shdrp)));
 
-        /* Update global variable. */
-        total_payload_size = total_payload_size - pp_payload_size + rsize;
-        total_allocated_block_size = total_allocated_block_size - pp_block_size + get_block_size(shdrp);
-        if(total_payload_size  >  max_aggregate_payload)
-            max_aggregate_payload = total_payload_size;
+        /* Update statistics. */
+        sf_cur_heap->stats.reallocs++;
+        sf_cur_heap->stats.payload_bytes = sf_cur_heap->stats.payload_bytes - pp_payload_size + rsize;
+        sf_cur_heap->stats.allocated_bytes = sf_cur_heap->stats.allocated_bytes - pp_block_size + get_block_size(shdrp);
+        sf_tag_realloc_block(pp_blkp, sblkp, pp_payload_size, pp_block_size);
 
         void *sptr = (void *)(&(sblkp->body.payload));
         return sptr;
@@ -350,11 +409,11 @@ void *sf_realloc(void *pp, sf_size_t rsize) {
 
 double sf_internal_fragmentation() {
     double inter_frag;
-    if(total_allocated_block_size <= 0){
+    if(sf_cur_heap->stats.allocated_bytes == 0){
         inter_frag = 0;
     }
     else{
-        inter_frag = total_payload_size/total_allocated_block_size;
+        inter_frag = (double)sf_cur_heap->stats.payload_bytes / (double)sf_cur_heap->stats.allocated_bytes;
     }
 
     return inter_frag;
@@ -362,12 +421,12 @@ double sf_internal_fragmentation() {
 
 double sf_peak_utilization() {
     double peak_util;
-    unsigned long heap_size = (unsigned long)sf_mem_end() - (unsigned long)sf_mem_start();
+    unsigned long heap_size = (unsigned long)sf_heap_end() - (unsigned long)sf_heap_start();
     if(heap_size <= 0){
         peak_util = 0;
     }
     else{
-        peak_util = max_aggregate_payload / heap_size;
+        peak_util = (double)sf_cur_heap->stats.peak_payload_bytes / heap_size;
     }
     return peak_util;
 }
@@ -0,0 +1,307 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfhelper.h"
+#include "sfpage.h"
+#include "sfplace.h"
+
+/*
+ * The ordered index of a heap in SF_ORDER_ADDRESS mode.  The address range of the heap is
+ * cut into granules, separately for every size class: class i uses granules of
+ * (SF_ORDER_GRANULE << i) bytes, so no granule can hold more than a few dozen blocks of
+ * its class.  For every granule, heads[] points to the lowest free block of the class
+ * starting in it, and bits[] has the granule's bit set if there is one.  summary[] has a
+ * bit per word of bits[], set if the word is not 0, so the nearest non-empty granule
+ * below a block is found in a few word operations.
+ *
+ * An insertion finds the nearest non-empty granule at or below the block and walks
+ * forward from its head, so it only ever walks over blocks of one or two granules.
+ *
+ * Everything lives in one anonymous mapping reserved with MAP_NORESERVE, so only the
+ * parts of the index covering the heap actually in use take memory.
+ */
+#define SF_ORDER_GRANULE_SHIFT 10
+
+/* Index span for the sfutil heap, which has no reserved address range. */
+#define SF_ORDER_SFUTIL_SPAN ((size_t)1 << 30)
+
+struct sf_frlst_index {
+	size_t map_size;
+	char *base;				// Start of the indexed address range.
+	size_t span;				// Length of the indexed address range.
+	size_t ngranules[NUM_FREE_LISTS];
+	sf_block **heads[NUM_FREE_LISTS];
+	uint64_t *bits[NUM_FREE_LISTS];
+	uint64_t *summary[NUM_FREE_LISTS];
+};
+
+static size_t sf_words(size_t nbits){
+	return (nbits + 63) / 64;
+}
+
+/* Create an index covering [base, base + span). */
+static struct sf_frlst_index *sf_index_create(char *base, size_t span){
+	size_t ngranules[NUM_FREE_LISTS];
+	size_t map_size = sizeof(struct sf_frlst_index);
+	int i;
+
+	for(i = 0; i < NUM_FREE_LISTS; i++)
+	{
+		size_t granule = (size_t)1 << (SF_ORDER_GRANULE_SHIFT + i);
+		ngranules[i] = (span + granule - 1) / granule;
+		map_size = map_size + ngranules[i] * sizeof(sf_block *)
+			+ (sf_words(ngranules[i]) + sf_words(sf_words(ngranules[i]))) * sizeof(uint64_t);
+	}
+
+	char *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(map == MAP_FAILED)
+		return NULL;
+
+	struct sf_frlst_index *index = (struct sf_frlst_index *)map;
+	char *p = map + sizeof(struct sf_frlst_index);
+	index->map_size = map_size;
+	index->base = base;
+	index->span = span;
+	for(i = 0; i < NUM_FREE_LISTS; i++)
+	{
+		index->ngranules[i] = ngranules[i];
+		index->heads[i] = (sf_block **)p;
+		p = p + ngranules[i] * sizeof(sf_block *);
+		index->bits[i] = (uint64_t *)p;
+		p = p + sf_words(ngranules[i]) * sizeof(uint64_t);
+		index->summary[i] = (uint64_t *)p;
+		p = p + sf_words(sf_words(ngranules[i])) * sizeof(uint64_t);
+	}
+	return index;
+}
+
+/* Empty the index, giving its memory back. */
+static void sf_index_clear(struct sf_frlst_index *index){
+	size_t os_page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t header_size = (sizeof(struct sf_frlst_index) + os_page - 1) / os_page * os_page;
+	char *map = (char *)index;
+	char *p = map + sizeof(struct sf_frlst_index);
+
+	/* Zero the arrays sharing the page of the header by hand, and drop the rest. */
+	size_t head_bytes = ((header_size < index->map_size) ? header_size : index->map_size) - sizeof(struct sf_frlst_index);
+	memset(p, 0, head_bytes);
+	if(header_size < index->map_size)
+		madvise(map + header_size, index->map_size - header_size, MADV_DONTNEED);
+	return;
+}
+
+/* Granule of blkp in class i, or -1 if blkp is outside the index. */
+static long sf_index_granule(struct sf_frlst_index *index, int i, sf_block *blkp){
+	char *p = (char *)blkp;
+	if(p < index->base || p >= index->base + index->span)
+		return -1;
+	return (long)((size_t)(p - index->base) >> (SF_ORDER_GRANULE_SHIFT + i));
+}
+
+static void sf_index_set(struct sf_frlst_index *index, int i, long g){
+	size_t w = (size_t)g / 64;
+	index->bits[i][w] |= (uint64_t)1 << (g % 64);
+	index->summary[i][w / 64] |= (uint64_t)1 << (w % 64);
+	return;
+}
+
+static void sf_index_reset(struct sf_frlst_index *index, int i, long g){
+	size_t w = (size_t)g / 64;
+	index->bits[i][w] &= ~((uint64_t)1 << (g % 64));
+	if(index->bits[i][w] == 0)
+		index->summary[i][w / 64] &= ~((uint64_t)1 << (w % 64));
+	return;
+}
+
+/* The greatest non-empty granule below g in class i, or -1 if there is none. */
+static long sf_index_prev(struct sf_frlst_index *index, int i, long g){
+	size_t w = (size_t)g / 64;
+	uint64_t m = index->bits[i][w] & (((uint64_t)1 << (g % 64)) - 1);
+	if(m != 0)
+		return (long)(w * 64 + 63 - __builtin_clzll(m));
+
+	size_t sw = w / 64;
+	uint64_t sm = index->summary[i][sw] & (((uint64_t)1 << (w % 64)) - 1);
+	while(sm == 0)
+	{
+		if(sw == 0)
+			return -1;
+		sw--;
+		sm = index->summary[i][sw];
+	}
+	w = sw * 64 + 63 - __builtin_clzll(sm);
+	return (long)(w * 64 + 63 - __builtin_clzll(index->bits[i][w]));
+}
+
+/* The block of free list i that blkp goes behind to keep the list in address order. */
+static sf_block *sf_frlst_ordered_prev(sf_block *blkp, int i){
+	sf_block *dummy_ptr = &sf_cur_heap->free_list_heads[i];
+	struct sf_frlst_index *index = sf_cur_heap->frlst_index;
+	sf_block *prev = dummy_ptr;
+
+	/* Start from the head of the nearest granule at or below blkp. */
+	long g = (index == NULL) ? -1 : sf_index_granule(index, i, blkp);
+	if(g != -1)
+	{
+		sf_block *head = index->heads[i][g];
+		if(head == NULL || head > blkp)
+		{
+			long pg = sf_index_prev(index, i, g);
+			head = (pg == -1) ? NULL : index->heads[i][pg];
+		}
+		if(head != NULL)
+			prev = head;
+	}
+
+	while(prev->body.links.next != dummy_ptr && prev->body.links.next < blkp)
+		prev = prev->body.links.next;
+	return prev;
+}
+
+void sf_frlst_link(sf_block *block_ptr, int findex){
+	sf_block *prev = &sf_cur_heap->free_list_heads[findex];
+	if(sf_cur_heap->frlst_order == SF_ORDER_ADDRESS)
+		prev = sf_frlst_ordered_prev(block_ptr, findex);
+
+	/* Insert behind prev. */
+	block_ptr->body.links.next = prev->body.links.next;
+	block_ptr->body.links.prev = prev;
+	(prev->body.links.next)->body.links.prev = block_ptr;
+	prev->body.links.next = block_ptr;
+
+	struct sf_frlst_index *index = sf_cur_heap->frlst_index;
+	long g = (index == NULL) ? -1 : sf_index_granule(index, findex, block_ptr);
+	if(g != -1 && (index->heads[findex][g] == NULL || index->heads[findex][g] > block_ptr))
+	{
+		index->heads[findex][g] = block_ptr;
+		sf_index_set(index, findex, g);
+	}
+	return;
+}
+
+void sf_frlst_unlink(sf_block *block_ptr){
+	/* The wilderness is on no list. */
+	if(block_ptr == sf_wilderness())
+		return;
+
+	struct sf_frlst_index *index = sf_cur_heap->frlst_index;
+	if(index != NULL)
+	{
+		int findex = sf_frlst_index(get_block_size(get_hdrp(block_ptr)));
+		long g = sf_index_granule(index, findex, block_ptr);
+		if(g != -1 && index->heads[findex][g] == block_ptr)
+		{
+			/* The next block in the list takes over the granule if it starts in it. */
+			sf_block *next = block_ptr->body.links.next;
+			if(next != &sf_cur_heap->free_list_heads[findex] && sf_index_granule(index, findex, next) == g)
+				index->heads[findex][g] = next;
+			else
+			{
+				index->heads[findex][g] = NULL;
+				sf_index_reset(index, findex, g);
+			}
+		}
+	}
+
+	(block_ptr->body.links.prev)->body.links.next = block_ptr->body.links.next;
+	(block_ptr->body.links.next)->body.links.prev = block_ptr->body.links.prev;
+	block_ptr->body.links.prev = NULL;
+	block_ptr->body.links.next = NULL;
+	return;
+}
+
+void sf_frlst_index_clear(){
+	if(sf_cur_heap->frlst_index != NULL)
+		sf_index_clear(sf_cur_heap->frlst_index);
+	return;
+}
+
+void sf_frlst_reorder(){
+	int i;
+	sf_frlst_index_clear();
+
+	/* Nothing is on the lists before the heap is initialized. */
+	char *heap_start = sf_heap_start();
+	char *heap_end = sf_heap_end();
+	if(heap_start == heap_end)
+		return;
+
+	for(i = 0; i < NUM_FREE_LISTS; i++)
+	{
+		sf_block *dummy_ptr = &sf_cur_heap->free_list_heads[i];
+		dummy_ptr->body.links.next = dummy_ptr;
+		dummy_ptr->body.links.prev = dummy_ptr;
+	}
+
+	/* Walk the heap upwards, appending every free block but the wilderness to its list. */
+	sf_header *epilogue = (sf_header *)(heap_end - sizeof(sf_header));
+	sf_block *top = sf_wilderness();
+	sf_block *blkp = (sf_block *)(heap_start + sizeof(sf_block));
+	while(get_hdrp(blkp) < epilogue)
+	{
+		sf_header *hdrp = get_hdrp(blkp);
+		if(get_alloc(hdrp) == 0 && blkp != top)
+		{
+			int findex = sf_frlst_index(get_block_size(hdrp));
+			sf_block *dummy_ptr = &sf_cur_heap->free_list_heads[findex];
+			sf_frlst_link(blkp, findex);
+			/* The walk is in address order, so the block must have landed at the tail. */
+			if(dummy_ptr->body.links.prev != blkp)
+				abort();
+		}
+		blkp = get_next_blkp(blkp);
+	}
+	return;
+}
+
+int sf_set_frlst_order(int order){
+	if(order != SF_ORDER_LIFO && order != SF_ORDER_ADDRESS)
+	{
+		sf_errno = EINVAL;
+		return -1;
+	}
+
+	if(order == SF_ORDER_LIFO)
+	{
+		/* Lists in address order are as good as any for LIFO. */
+		sf_frlst_index_drop();
+		sf_cur_heap->frlst_order = SF_ORDER_LIFO;
+		return 0;
+	}
+
+	if(sf_cur_heap->frlst_index == NULL)
+	{
+		char *base = sf_heap_start();
+		size_t span = SF_ORDER_SFUTIL_SPAN;
+		if(sf_cur_heap->base != NULL)
+			span = (size_t)(sf_cur_heap->limit - sf_cur_heap->base);
+		sf_cur_heap->frlst_index = sf_index_create(base, span);
+		if(sf_cur_heap->frlst_index == NULL)
+		{
+			sf_errno = ENOMEM;
+			return -1;
+		}
+	}
+	sf_cur_heap->frlst_order = SF_ORDER_ADDRESS;
+	sf_frlst_reorder();
+	return 0;
+}
+
+int sf_get_frlst_order(){
+	return sf_cur_heap->frlst_order;
+}
+
+void sf_frlst_index_drop(){
+	if(sf_cur_heap->frlst_index != NULL)
+	{
+		munmap(sf_cur_heap->frlst_index, sf_cur_heap->frlst_index->map_size);
+		sf_cur_heap->frlst_index = NULL;
+	}
+	return;
+}
@@ -0,0 +1,334 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfhelper.h"
+#include "sfpage.h"
+
+/* Free tail size above which sf_free() trims the heap. 0 disables automatic trimming. */
+static size_t trim_threshold = SF_DEFAULT_TRIM_THRESHOLD;
+
+/* Whether the heap grows in huge page multiples. */
+static bool huge_pages = false;
+
+/* How many pages each growth adds. */
+static struct sf_grow_policy grow_policy = { SF_GROW_FIXED, 1, 1 };
+
+/* Automatic scavenging: block size, interval in frees (0 disables), frees since last run. */
+static size_t scavenge_min_size = 0;
+static unsigned int scavenge_interval = 0;
+static unsigned int scavenge_countdown = 0;
+
+/* Total number of resident bytes released by sf_scavenge(). */
+static size_t scavenged_bytes = 0;
+
+
+void *sf_heap_start(){
+	if(sf_cur_heap->base != NULL)
+		return sf_cur_heap->base;
+	return sf_mem_start();
+}
+
+/* End of all the pages the heap has ever grown, including released ones. */
+static void *sf_heap_top(){
+	if(sf_cur_heap->base != NULL)
+		return sf_cur_heap->top;
+	return sf_mem_end();
+}
+
+void *sf_heap_end(){
+	return (void *)((char *)sf_heap_top() - sf_cur_heap->released_bytes);
+}
+
+void *sf_page_grow(){
+	/* Reuse a page released by sf_trim() if there is one. */
+	if(sf_cur_heap->released_bytes >= PAGE_SZ)
+	{
+		void *previous_heap_end = sf_heap_end();
+		sf_cur_heap->released_bytes = sf_cur_heap->released_bytes - PAGE_SZ;
+		return previous_heap_end;
+	}
+
+	/* A heap with its own pages grows inside its reserved address range. */
+	if(sf_cur_heap->base != NULL)
+	{
+		if(sf_cur_heap->top + PAGE_SZ > sf_cur_heap->limit)
+			return NULL;
+		void *previous_heap_end = sf_cur_heap->top;
+		sf_cur_heap->top = sf_cur_heap->top + PAGE_SZ;
+		return previous_heap_end;
+	}
+
+	return sf_mem_grow();
+}
+
+/* Mark every huge page lying entirely inside the heap with MADV_HUGEPAGE. */
+static void sf_page_advise_huge(){
+	uintptr_t lo = (uintptr_t)sf_heap_start();
+	uintptr_t hi = (uintptr_t)sf_heap_end();
+
+	lo = (lo + SF_HUGE_PAGE_SZ - 1) & ~(SF_HUGE_PAGE_SZ - 1);
+	hi = hi & ~(SF_HUGE_PAGE_SZ - 1);
+	if(lo < hi)
+		madvise((void *)lo, hi - lo, MADV_HUGEPAGE);
+	return;
+}
+
+int sf_set_grow_policy(const struct sf_grow_policy *policy){
+	if((policy->kind != SF_GROW_FIXED && policy->kind != SF_GROW_GEOMETRIC && policy->kind != SF_GROW_RATE)
+		|| policy->pages == 0 || (policy->kind != SF_GROW_FIXED && policy->max_pages < policy->pages))
+	{
+		sf_errno = EINVAL;
+		return -1;
+	}
+	grow_policy = *policy;
+	return 0;
+}
+
+void sf_get_grow_policy(struct sf_grow_policy *policy){
+	*policy = grow_policy;
+	return;
+}
+
+/* Number of pages the next growth of the current heap adds. */
+static size_t sf_grow_npages(){
+	size_t npages = grow_policy.pages;
+
+	if(grow_policy.kind == SF_GROW_GEOMETRIC)
+	{
+		if(sf_cur_heap->grow_pages < grow_policy.pages || sf_cur_heap->grow_pages > grow_policy.max_pages)
+			sf_cur_heap->grow_pages = grow_policy.pages;
+		npages = sf_cur_heap->grow_pages;
+		sf_cur_heap->grow_pages = (npages > grow_policy.max_pages / 2) ? grow_policy.max_pages : 2 * npages;
+	}
+	else if(grow_policy.kind == SF_GROW_RATE)
+	{
+		/* Net bytes allocated since the last growth, as pages. */
+		uint64_t allocated = sf_cur_heap->stats.allocated_bytes;
+		if(allocated > sf_cur_heap->grow_mark)
+		{
+			uint64_t rate_pages = (allocated - sf_cur_heap->grow_mark + PAGE_SZ - 1) / PAGE_SZ;
+			npages = (rate_pages > grow_policy.max_pages) ? grow_policy.max_pages : (size_t)rate_pages;
+			if(npages < grow_policy.pages)
+				npages = grow_policy.pages;
+		}
+		sf_cur_heap->grow_mark = allocated;
+	}
+
+	if(huge_pages)
+	{
+		size_t huge_npages = SF_HUGE_PAGE_SZ / PAGE_SZ;
+		npages = (npages + huge_npages - 1) / huge_npages * huge_npages;
+	}
+	return npages;
+}
+
+void *sf_page_grow_chunk(){
+	size_t npages = sf_grow_npages();
+
+	void *previous_heap_end = sf_page_grow();
+	if(previous_heap_end == NULL)
+		return NULL;
+
+	/* Keep whatever could be obtained if the page source runs out. */
+	size_t i;
+	for(i = 1; i < npages; i++)
+	{
+		if(sf_page_grow() == NULL)
+			break;
+	}
+	sf_cur_heap->stats.grow_bytes = sf_cur_heap->stats.grow_bytes + i * PAGE_SZ;
+
+	if(huge_pages)
+		sf_page_advise_huge();
+
+	return previous_heap_end;
+}
+
+void sf_set_huge_pages(bool enable){
+	huge_pages = enable;
+	return;
+}
+
+/* Release the system pages lying entirely inside [lo, hi) and return how many bytes
+   of them were resident before the call. */
+static size_t sf_page_release_range(uintptr_t lo, uintptr_t hi){
+	uintptr_t os_page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	unsigned char resident[64];
+	size_t released = 0;
+
+	lo = (lo + os_page - 1) & ~(os_page - 1);
+	hi = hi & ~(os_page - 1);
+	if(lo >= hi)
+		return 0;
+
+	/* Count resident pages, 64 system pages at a time. */
+	uintptr_t chunk_lo, chunk_hi;
+	for(chunk_lo = lo; chunk_lo < hi; chunk_lo = chunk_hi)
+	{
+		chunk_hi = chunk_lo + 64 * os_page;
+		if(chunk_hi > hi)
+			chunk_hi = hi;
+		if(mincore((void *)chunk_lo, chunk_hi - chunk_lo, resident) == 0)
+		{
+			size_t i, n = (chunk_hi - chunk_lo) / os_page;
+			for(i = 0; i < n; i++)
+				if(resident[i] & 0x1)
+					released = released + os_page;
+		}
+	}
+
+	madvise((void *)lo, hi - lo, MADV_DONTNEED);
+	return released;
+}
+
+void sf_page_release(size_t bytes){
+	sf_cur_heap->released_bytes = sf_cur_heap->released_bytes + bytes;
+	sf_page_release_range((uintptr_t)sf_heap_end(), (uintptr_t)sf_heap_top());
+	return;
+}
+
+size_t sf_trim(size_t keep_bytes){
+	void *heap_start = sf_heap_start();
+	void *heap_end = sf_heap_end();
+
+	/* Nothing to trim before the heap is initialized. */
+	if(heap_start == heap_end)
+		return 0;
+
+	/* If the block before the epilogue is allocated, there is no free tail. */
+	sf_header *epilogue = (sf_header *)((char *)heap_end - sizeof(sf_header));
+	if(get_prev_alloc(epilogue) != 0)
+		return 0;
+
+	/* The footer of the free tail sits right in front of the epilogue. */
+	sf_footer *tail_ftrp = (sf_footer *)((char *)epilogue - sizeof(sf_footer));
+	sf_size_t tail_size = get_block_size((sf_header *)tail_ftrp);
+	sf_block *tail_blkp = (sf_block *)((char *)tail_ftrp - tail_size);
+	unsigned int tail_prev_alloc = get_prev_alloc(get_hdrp(tail_blkp));
+
+	if(tail_size <= keep_bytes)
+		return 0;
+
+	/* Release whole pages only, and never leave a splinter behind. */
+	size_t npages = (tail_size - keep_bytes) / PAGE_SZ;
+	size_t remain_size = tail_size - npages * PAGE_SZ;
+	if(remain_size != 0 && remain_size < SF_MIN_BLOCK_SIZE)
+	{
+		npages--;
+		remain_size = remain_size + PAGE_SZ;
+	}
+	if(npages == 0)
+		return 0;
+
+	/* Remove the free tail from its free list. */
+	sf_frlst_unlink(tail_blkp);
+
+	/* New Epilogue Header: 0 payload, 0 block size, 1 alloc bit, 0 qklst bit.
+	   If the whole tail is released, the epilogue takes over the tail header and
+	   inherits its pre alloc bit. */
+	void *new_heap_end = (void *)((char *)heap_end - npages * PAGE_SZ);
+	sf_header *new_epilogue = (sf_header *)((char *)new_heap_end - sizeof(sf_header));
+	set_header(new_epilogue, pack_header(0, 0, 1, (remain_size == 0) ? tail_prev_alloc : 0, 0));
+
+	/* Put what is left of the tail back into the free lists. */
+	if(remain_size != 0)
+	{
+		sf_header remain_header = pack_header(0, (sf_size_t)remain_size, 0, tail_prev_alloc, 0);
+		set_header(get_hdrp(tail_blkp), remain_header);
+		set_footer(get_ftrp(tail_blkp), (sf_footer)remain_header);
+		if(sf_frlst_insert(tail_blkp) == -1)
+			return 0;
+	}
+
+	/* Hand the pages back to the page source. */
+	sf_page_release(npages * PAGE_SZ);
+
+	return npages * PAGE_SZ;
+}
+
+void sf_set_trim_threshold(size_t threshold){
+	trim_threshold = threshold;
+	return;
+}
+
+void sf_trim_if_needed(){
+	if(trim_threshold == 0)
+		return;
+
+	/* Look at the size of the free tail, if there is one. */
+	sf_header *epilogue = (sf_header *)((char *)sf_heap_end() - sizeof(sf_header));
+	if(get_prev_alloc(epilogue) != 0)
+		return;
+	sf_footer *tail_ftrp = (sf_footer *)((char *)epilogue - sizeof(sf_footer));
+	if(get_block_size((sf_header *)tail_ftrp) > trim_threshold)
+		sf_trim(SF_TRIM_PAD);
+	return;
+}
+
+/* Release the pages inside a free block, keeping the header and links at the start,
+   and the footer at the end. */
+static size_t sf_scavenge_block(sf_block *blkp){
+	uintptr_t lo = (uintptr_t)blkp + sizeof(sf_block);
+	uintptr_t hi = (uintptr_t)get_ftrp(blkp);
+	return sf_page_release_range(lo, hi);
+}
+
+size_t sf_scavenge(size_t min_block_size){
+	size_t released = 0;
+	int i;
+
+	/* Nothing to scavenge before the heap is initialized. */
+	if(sf_heap_start() == sf_heap_end())
+		return 0;
+
+	for(i = 0; i < NUM_FREE_LISTS; i++)
+	{
+		sf_block *blkp = sf_cur_heap->free_list_heads[i].body.links.next;
+		while(blkp != &sf_cur_heap->free_list_heads[i])
+		{
+			if(get_block_size(get_hdrp(blkp)) >= min_block_size)
+				released = released + sf_scavenge_block(blkp);
+			blkp = blkp->body.links.next;
+		}
+	}
+
+	/* The wilderness is on no list. */
+	sf_block *top = sf_wilderness();
+	if(top != NULL && get_block_size(get_hdrp(top)) >= min_block_size)
+		released = released + sf_scavenge_block(top);
+
+	scavenged_bytes = scavenged_bytes + released;
+	return released;
+}
+
+void sf_set_scavenge(size_t min_block_size, unsigned int interval){
+	scavenge_min_size = min_block_size;
+	scavenge_interval = interval;
+	scavenge_countdown = interval;
+	return;
+}
+
+void sf_scavenge_if_needed(){
+	if(scavenge_interval == 0)
+		return;
+
+	if(scavenge_countdown > 1)
+	{
+		scavenge_countdown--;
+		return;
+	}
+
+	scavenge_countdown = scavenge_interval;
+	sf_scavenge(scavenge_min_size);
+	return;
+}
+
+size_t sf_scavenged_bytes(){
+	return scavenged_bytes;
+}
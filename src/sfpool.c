@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfhelper.h"
+#include "sfpool.h"
+
+/* A free slot holds a pointer to the next free slot. */
+typedef struct sf_pool_slot {
+	struct sf_pool_slot *next;
+} sf_pool_slot;
+
+/* A chunk starts with a pointer to the next chunk of the pool; the slots follow. */
+typedef struct sf_pool_chunk {
+	struct sf_pool_chunk *next;
+} sf_pool_chunk;
+
+/* The free slots a thread keeps for one pool, padded to a cache line so that the
+   magazines of different threads do not share one. */
+typedef struct sf_pool_magazine {
+	sf_pool_slot *slots;		// LIFO list of cached slots.
+	size_t count;
+	char pad[64 - sizeof(sf_pool_slot *) - sizeof(size_t)];
+} sf_pool_magazine;
+
+struct sf_pool {
+	size_t slot_size;		// Object size rounded up to the alignment.
+	size_t alignment;
+	sf_size_t chunk_size;		// Payload size of each chunk.
+	sf_pool_slot *free_slots;	// LIFO list of free slots.
+	size_t free_count;		// Number of slots in free_slots.
+	sf_pool_chunk *chunks;		// All chunks taken from the heap.
+	size_t magazine_size;		// Per-thread cache size, 0 if the pool has no caches.
+	pthread_mutex_t lock;		// Guards everything above once the pool has caches.
+	sf_pool_magazine *magazines;	// SF_POOL_MAX_THREADS magazines, taken from the heap on first use.
+};
+
+/* Threads are numbered on first use of a pool with caches; the number picks the
+   thread's magazine in every pool.  0 means not numbered yet. */
+static unsigned int pool_threads = 0;
+static __thread unsigned int pool_thread = 0;
+
+
+sf_pool *sf_pool_create(size_t object_size, size_t alignment){
+	if(alignment == 0)
+		alignment = SF_ALIGN_SIZE;
+
+	/* The object size must be nonzero and the alignment a power of two. */
+	if(object_size == 0 || (alignment & (alignment - 1)) != 0)
+	{
+		sf_errno = EINVAL;
+		return NULL;
+	}
+
+	/* A slot must be able to hold the free list link. */
+	size_t slot_size = object_size;
+	if(slot_size < sizeof(sf_pool_slot))
+		slot_size = sizeof(sf_pool_slot);
+	if(alignment < sizeof(sf_pool_slot))
+		alignment = sizeof(sf_pool_slot);
+	slot_size = (slot_size + alignment - 1) & ~(alignment - 1);
+
+	/* A chunk holds at least one slot, the chunk link and room to align the first slot. */
+	size_t chunk_size = SF_POOL_CHUNK_SIZE;
+	if(chunk_size < sizeof(sf_pool_chunk) + alignment + slot_size)
+		chunk_size = sizeof(sf_pool_chunk) + alignment + slot_size;
+	if(chunk_size > UINT32_MAX)
+	{
+		sf_errno = EINVAL;
+		return NULL;
+	}
+
+	sf_pool *pool = sf_malloc(sizeof(sf_pool));
+	if(pool == NULL)
+		return NULL;
+	pool->slot_size = slot_size;
+	pool->alignment = alignment;
+	pool->chunk_size = (sf_size_t)chunk_size;
+	pool->free_slots = NULL;
+	pool->free_count = 0;
+	pool->chunks = NULL;
+	pool->magazine_size = 0;
+	pthread_mutex_init(&pool->lock, NULL);
+	pool->magazines = NULL;
+	return pool;
+}
+
+/* Take a new chunk from the heap and put all of its slots on the free list. */
+static int sf_pool_grow(sf_pool *pool){
+	sf_pool_chunk *chunk = sf_malloc(pool->chunk_size);
+	if(chunk == NULL)
+		return -1;
+	chunk->next = pool->chunks;
+	pool->chunks = chunk;
+
+	/* The first slot is the first aligned address after the chunk link. */
+	uintptr_t slot = ((uintptr_t)(chunk + 1) + pool->alignment - 1) & ~(uintptr_t)(pool->alignment - 1);
+	uintptr_t chunk_end = (uintptr_t)chunk + pool->chunk_size;
+
+	/* Push the slots from the last one down, so the list hands them out in address order. */
+	size_t nslots = (chunk_end - slot) / pool->slot_size;
+	while(nslots > 0)
+	{
+		nslots--;
+		sf_pool_slot *sp = (sf_pool_slot *)(slot + nslots * pool->slot_size);
+		sp->next = pool->free_slots;
+		pool->free_slots = sp;
+		pool->free_count++;
+	}
+	return 0;
+}
+
+/* The calling thread's magazine, or NULL if it has none. */
+static sf_pool_magazine *sf_pool_magazine_of(sf_pool *pool){
+	if(pool_thread == 0)
+		pool_thread = __atomic_add_fetch(&pool_threads, 1, __ATOMIC_RELAXED);
+	if(pool_thread > SF_POOL_MAX_THREADS)
+		return NULL;
+	return &pool->magazines[pool_thread - 1];
+}
+
+/* Move up to n slots from the shared free list to a magazine, growing the pool if it
+   has none.  Called with the pool lock held. */
+static void sf_pool_refill(sf_pool *pool, sf_pool_magazine *mag, size_t n){
+	if(pool->free_slots == NULL)
+		sf_pool_grow(pool);
+	while(n > 0 && pool->free_slots != NULL)
+	{
+		sf_pool_slot *sp = pool->free_slots;
+		pool->free_slots = sp->next;
+		pool->free_count--;
+		sp->next = mag->slots;
+		mag->slots = sp;
+		mag->count++;
+		n--;
+	}
+	return;
+}
+
+/* Move up to n slots from a magazine to the shared free list.  Called with the pool
+   lock held. */
+static void sf_pool_drain(sf_pool *pool, sf_pool_magazine *mag, size_t n){
+	while(n > 0 && mag->slots != NULL)
+	{
+		sf_pool_slot *sp = mag->slots;
+		mag->slots = sp->next;
+		mag->count--;
+		sp->next = pool->free_slots;
+		pool->free_slots = sp;
+		pool->free_count++;
+		n--;
+	}
+	return;
+}
+
+void *sf_pool_alloc(sf_pool *pool){
+	if(pool->magazine_size != 0)
+	{
+		sf_pool_magazine *mag = sf_pool_magazine_of(pool);
+		sf_pool_magazine one = { NULL, 0, {0} };
+		if(mag == NULL)
+			mag = &one;
+		if(mag->slots == NULL)
+		{
+			pthread_mutex_lock(&pool->lock);
+			sf_pool_refill(pool, mag, (mag == &one) ? 1 : pool->magazine_size / 2);
+			pthread_mutex_unlock(&pool->lock);
+			if(mag->slots == NULL)
+			{
+				sf_errno = ENOMEM;
+				return NULL;
+			}
+		}
+		sf_pool_slot *sp = mag->slots;
+		mag->slots = sp->next;
+		mag->count--;
+		return (void *)sp;
+	}
+
+	if(pool->free_slots == NULL && sf_pool_grow(pool) == -1)
+	{
+		sf_errno = ENOMEM;
+		return NULL;
+	}
+
+	sf_pool_slot *sp = pool->free_slots;
+	pool->free_slots = sp->next;
+	pool->free_count--;
+	return (void *)sp;
+}
+
+void sf_pool_free(sf_pool *pool, void *ptr){
+	if(ptr == NULL)
+		abort();
+
+	sf_pool_slot *sp = (sf_pool_slot *)ptr;
+	if(pool->magazine_size != 0)
+	{
+		sf_pool_magazine *mag = sf_pool_magazine_of(pool);
+		if(mag == NULL)
+		{
+			pthread_mutex_lock(&pool->lock);
+			sp->next = pool->free_slots;
+			pool->free_slots = sp;
+			pool->free_count++;
+			pthread_mutex_unlock(&pool->lock);
+			return;
+		}
+		if(mag->count >= pool->magazine_size)
+		{
+			pthread_mutex_lock(&pool->lock);
+			sf_pool_drain(pool, mag, pool->magazine_size / 2);
+			pthread_mutex_unlock(&pool->lock);
+		}
+		sp->next = mag->slots;
+		mag->slots = sp;
+		mag->count++;
+		return;
+	}
+
+	sp->next = pool->free_slots;
+	pool->free_slots = sp;
+	pool->free_count++;
+	return;
+}
+
+int sf_pool_set_thread_cache(sf_pool *pool, unsigned int magazine_size){
+	if(magazine_size == 1)
+	{
+		sf_errno = EINVAL;
+		return -1;
+	}
+
+	if(pool->magazines == NULL)
+	{
+		if(magazine_size == 0)
+			return 0;
+		pool->magazines = sf_malloc(SF_POOL_MAX_THREADS * sizeof(sf_pool_magazine));
+		if(pool->magazines == NULL)
+			return -1;
+		memset(pool->magazines, 0, SF_POOL_MAX_THREADS * sizeof(sf_pool_magazine));
+	}
+
+	/* Empty every magazine, so that no slot is lost if the size goes to 0. */
+	int i;
+	for(i = 0; i < SF_POOL_MAX_THREADS; i++)
+		sf_pool_drain(pool, &pool->magazines[i], pool->magazines[i].count);
+	pool->magazine_size = magazine_size;
+	return 0;
+}
+
+void sf_pool_flush_thread_cache(sf_pool *pool){
+	if(pool->magazine_size == 0)
+		return;
+	sf_pool_magazine *mag = sf_pool_magazine_of(pool);
+	if(mag == NULL)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	sf_pool_drain(pool, mag, mag->count);
+	pthread_mutex_unlock(&pool->lock);
+	return;
+}
+
+int sf_pool_reserve(sf_pool *pool, size_t count){
+	int ret = 0;
+	pthread_mutex_lock(&pool->lock);
+	while(pool->free_count < count)
+	{
+		if(sf_pool_grow(pool) == -1)
+		{
+			sf_errno = ENOMEM;
+			ret = -1;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return ret;
+}
+
+void sf_pool_destroy(sf_pool *pool){
+	if(pool == NULL)
+		return;
+
+	/* Only the chunks are visited, never the objects in them. */
+	sf_pool_chunk *chunk = pool->chunks;
+	while(chunk != NULL)
+	{
+		sf_pool_chunk *next = chunk->next;
+		sf_free(chunk);
+		chunk = next;
+	}
+	if(pool->magazines != NULL)
+		sf_free(pool->magazines);
+	pthread_mutex_destroy(&pool->lock);
+	sf_free(pool);
+	return;
+}
@@ -0,0 +1,83 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfhelper.h"
+#include "sfregion.h"
+
+/* The region: [base, bump) is handed out, [bump, top) is grown but unused,
+   and [top, limit) is reserved address space. */
+static char *region_base = NULL;
+static char *region_bump = NULL;
+static char *region_top = NULL;
+static char *region_limit = NULL;
+
+
+/* Reserve the address range of the region on first use. */
+static int sf_region_init(){
+	void *map = mmap(NULL, SF_REGION_CAPACITY, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(map == MAP_FAILED)
+		return -1;
+
+	region_base = (char *)map;
+	region_bump = region_base;
+	region_top = region_base;
+	region_limit = region_base + SF_REGION_CAPACITY;
+	return 0;
+}
+
+void *sf_region_malloc(sf_size_t size){
+	/* If the request size is 0, then return NULL without setting sf_errno. */
+	if(size == 0)
+		return NULL;
+
+	if(region_base == NULL && sf_region_init() == -1)
+	{
+		sf_errno = ENOMEM;
+		return NULL;
+	}
+
+	/* Round up to keep the next block two-row aligned. */
+	size_t asize = ((size_t)size + SF_ALIGN_SIZE - 1) / SF_ALIGN_SIZE * SF_ALIGN_SIZE;
+	if(asize > (size_t)(region_limit - region_bump))
+	{
+		sf_errno = ENOMEM;
+		return NULL;
+	}
+
+	/* Grow the region by whole pages until the block fits. */
+	while(region_bump + asize > region_top)
+		region_top = region_top + PAGE_SZ;
+
+	void *pp = region_bump;
+	region_bump = region_bump + asize;
+	return pp;
+}
+
+void *sf_region_realloc(void *ptr, sf_size_t size){
+	void *new_ptr = sf_region_malloc(size);
+	if(new_ptr == NULL || ptr == NULL)
+		return new_ptr;
+
+	/* Region blocks have no header.  The new block starts where the bump pointer was,
+	   so everything from ptr up to it may belong to the old block. */
+	size_t copy_size = (size_t)((char *)new_ptr - (char *)ptr);
+	if(copy_size > size)
+		copy_size = size;
+	memcpy(new_ptr, ptr, copy_size);
+	return new_ptr;
+}
+
+void sf_region_reset(){
+	region_bump = region_base;
+	return;
+}
+
+bool sf_region_owns(void *ptr){
+	return region_base != NULL && (char *)ptr >= region_base && (char *)ptr < region_bump;
+}
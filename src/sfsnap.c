@@ -0,0 +1,280 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfhelper.h"
+#include "sfpage.h"
+#include "sfplace.h"
+#include "sfsnap.h"
+#include "sftag.h"
+
+/* Identifies a snapshot ("sfmmsnap"). */
+#define SF_SNAPSHOT_MAGIC 0x70616e736d6d6673ULL
+
+typedef struct sf_snapshot_header {
+	uint64_t magic;
+	uint64_t heap_size;		// Bytes from the heap start to the heap end.
+	uint64_t heap_start;		// Heap start address when the snapshot was taken.
+	uint64_t header_magic;		// MAGIC the headers and footers are obfuscated with.
+	struct sf_stats stats;
+} sf_snapshot_header;
+
+typedef struct sf_snapshot_run {
+	uint64_t offset;
+	uint64_t length;
+} sf_snapshot_run;
+
+
+/* Write or read exactly n bytes, retrying on short transfers. */
+static int sf_write_all(int fd, const void *buf, size_t n){
+	const char *p = buf;
+	while(n > 0)
+	{
+		ssize_t done = write(fd, p, n);
+		if(done <= 0)
+			return -1;
+		p = p + done;
+		n = n - (size_t)done;
+	}
+	return 0;
+}
+static int sf_read_all(int fd, void *buf, size_t n){
+	char *p = buf;
+	while(n > 0)
+	{
+		ssize_t done = read(fd, p, n);
+		if(done <= 0)
+			return -1;
+		p = p + done;
+		n = n - (size_t)done;
+	}
+	return 0;
+}
+
+/* Write the heap bytes in [lo, hi) as one run. */
+static int sf_snapshot_run_write(int fd, char *heap_start, char *lo, char *hi){
+	if(lo >= hi)
+		return 0;
+	sf_snapshot_run run = { (uint64_t)(lo - heap_start), (uint64_t)(hi - lo) };
+	if(sf_write_all(fd, &run, sizeof(run)) == -1)
+		return -1;
+	return sf_write_all(fd, lo, (size_t)(hi - lo));
+}
+
+/* Write a block count followed by the offsets of the blocks in a list, and of extra
+   at the end of it unless extra is NULL. */
+static int sf_snapshot_list_write(int fd, char *heap_start, sf_block *first, sf_block *stop, sf_block *extra){
+	uint64_t count = (extra != NULL) ? 1 : 0;
+	sf_block *blkp;
+	for(blkp = first; blkp != stop; blkp = blkp->body.links.next)
+		count++;
+	if(sf_write_all(fd, &count, sizeof(count)) == -1)
+		return -1;
+	for(blkp = first; blkp != stop; blkp = blkp->body.links.next)
+	{
+		uint64_t offset = (uint64_t)((char *)blkp - heap_start);
+		if(sf_write_all(fd, &offset, sizeof(offset)) == -1)
+			return -1;
+	}
+	if(extra != NULL)
+	{
+		uint64_t offset = (uint64_t)((char *)extra - heap_start);
+		if(sf_write_all(fd, &offset, sizeof(offset)) == -1)
+			return -1;
+	}
+	return 0;
+}
+
+int sf_heap_snapshot(int fd){
+	char *heap_start = sf_heap_start();
+	char *heap_end = sf_heap_end();
+	int i;
+
+	if(heap_start == heap_end)
+	{
+		sf_errno = EINVAL;
+		return -1;
+	}
+
+	sf_snapshot_header header;
+	header.magic = SF_SNAPSHOT_MAGIC;
+	header.heap_size = (uint64_t)(heap_end - heap_start);
+	header.heap_start = (uint64_t)(uintptr_t)heap_start;
+	header.header_magic = MAGIC;
+	header.stats = sf_cur_heap->stats;
+	if(sf_write_all(fd, &header, sizeof(header)) == -1)
+	{
+		sf_errno = EIO;
+		return -1;
+	}
+
+	/* Walk the blocks after the prologue, leaving out the links and unused space
+	   of each free block.  Its footer is the first row of the next run. */
+	char *run_start = heap_start;
+	sf_block *blkp = (sf_block *)(heap_start + sizeof(sf_block));
+	while(get_block_size(get_hdrp(blkp)) != 0)
+	{
+		if(get_alloc(get_hdrp(blkp)) == 0)
+		{
+			char *skip_start = (char *)&blkp->body;
+			if(sf_snapshot_run_write(fd, heap_start, run_start, skip_start) == -1)
+			{
+				sf_errno = EIO;
+				return -1;
+			}
+			run_start = (char *)get_ftrp(blkp);
+		}
+		blkp = get_next_blkp(blkp);
+	}
+	if(sf_snapshot_run_write(fd, heap_start, run_start, heap_end) == -1)
+	{
+		sf_errno = EIO;
+		return -1;
+	}
+	sf_snapshot_run end_run = { 0, 0 };
+	if(sf_write_all(fd, &end_run, sizeof(end_run)) == -1)
+	{
+		sf_errno = EIO;
+		return -1;
+	}
+
+	/* List order, free lists first.  The wilderness is saved at the end of its list, so
+	   the snapshot does not depend on the wilderness mode. */
+	sf_block *top = sf_wilderness();
+	for(i = 0; i < NUM_FREE_LISTS; i++)
+	{
+		sf_block *dummy_ptr = &sf_cur_heap->free_list_heads[i];
+		sf_block *extra = NULL;
+		if(top != NULL && sf_frlst_index(get_block_size(get_hdrp(top))) == i)
+			extra = top;
+		if(sf_snapshot_list_write(fd, heap_start, dummy_ptr->body.links.next, dummy_ptr, extra) == -1)
+		{
+			sf_errno = EIO;
+			return -1;
+		}
+	}
+	for(i = 0; i < NUM_QUICK_LISTS; i++)
+	{
+		if(sf_snapshot_list_write(fd, heap_start, sf_cur_heap->quick_lists[i].first, NULL, NULL) == -1)
+		{
+			sf_errno = EIO;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int sf_heap_restore(int fd){
+	sf_snapshot_header header;
+	int i;
+
+	if(sf_read_all(fd, &header, sizeof(header)) == -1 || header.magic != SF_SNAPSHOT_MAGIC
+		|| header.heap_size == 0 || header.heap_size % PAGE_SZ != 0)
+	{
+		sf_errno = EINVAL;
+		return -1;
+	}
+
+	/* Tags are not saved; the blocks about to be overwritten lose theirs. */
+	sf_tag_forget();
+
+	/* Size the heap to the snapshot: grow it, or release the pages above it. */
+	char *heap_start = sf_heap_start();
+	while((uint64_t)((char *)sf_heap_end() - heap_start) < header.heap_size)
+	{
+		if(sf_page_grow() == NULL)
+		{
+			sf_errno = ENOMEM;
+			return -1;
+		}
+		heap_start = sf_heap_start();
+	}
+	sf_page_release((size_t)((char *)sf_heap_end() - heap_start - header.heap_size));
+
+	/* Heap bytes. */
+	sf_snapshot_run run;
+	while(1)
+	{
+		if(sf_read_all(fd, &run, sizeof(run)) == -1)
+		{
+			sf_errno = EIO;
+			return -1;
+		}
+		if(run.length == 0)
+			break;
+		if(run.offset + run.length > header.heap_size)
+		{
+			sf_errno = EINVAL;
+			return -1;
+		}
+		if(sf_read_all(fd, heap_start + run.offset, (size_t)run.length) == -1)
+		{
+			sf_errno = EIO;
+			return -1;
+		}
+	}
+	sf_heap_remagic((sf_header)header.header_magic);
+
+	/* Rebuild the lists at the current heap address. */
+	uint64_t count, offset, k;
+	for(i = 0; i < NUM_FREE_LISTS; i++)
+	{
+		sf_block *dummy_ptr = &sf_cur_heap->free_list_heads[i];
+		dummy_ptr->prev_footer = 0;
+		dummy_ptr->header = 0;
+		dummy_ptr->body.links.next = dummy_ptr;
+		dummy_ptr->body.links.prev = dummy_ptr;
+		if(sf_read_all(fd, &count, sizeof(count)) == -1)
+		{
+			sf_errno = EIO;
+			return -1;
+		}
+		for(k = 0; k < count; k++)
+		{
+			if(sf_read_all(fd, &offset, sizeof(offset)) == -1)
+			{
+				sf_errno = EIO;
+				return -1;
+			}
+			/* Append at the tail to keep the list order. */
+			sf_block *blkp = (sf_block *)(heap_start + offset);
+			blkp->body.links.prev = dummy_ptr->body.links.prev;
+			blkp->body.links.next = dummy_ptr;
+			(dummy_ptr->body.links.prev)->body.links.next = blkp;
+			dummy_ptr->body.links.prev = blkp;
+		}
+	}
+	for(i = 0; i < NUM_QUICK_LISTS; i++)
+	{
+		sf_block **tailp = &sf_cur_heap->quick_lists[i].first;
+		if(sf_read_all(fd, &count, sizeof(count)) == -1)
+		{
+			sf_errno = EIO;
+			return -1;
+		}
+		for(k = 0; k < count; k++)
+		{
+			if(sf_read_all(fd, &offset, sizeof(offset)) == -1)
+			{
+				sf_errno = EIO;
+				return -1;
+			}
+			*tailp = (sf_block *)(heap_start + offset);
+			tailp = &(*tailp)->body.links.next;
+		}
+		*tailp = NULL;
+		sf_cur_heap->quick_lists[i].length = (int)count;
+	}
+
+	/* The saved lists hold the wilderness, and may come from a heap in another order. */
+	sf_wilderness_detach();
+	if(sf_cur_heap->frlst_order == SF_ORDER_ADDRESS)
+		sf_frlst_reorder();
+
+	sf_cur_heap->stats = header.stats;
+	return 0;
+}
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfhelper.h"
+#include "sfpage.h"
+#include "sfstats.h"
+
+void sf_get_stats(struct sf_stats *stats){
+	memset(stats, 0, sizeof(*stats));
+
+	/* Every field is 0 before the heap is initialized. */
+	if(sf_heap_start() == sf_heap_end())
+		return;
+
+	/* Event counters are kept by the allocator as it runs. */
+	*stats = sf_cur_heap->stats;
+	stats->heap_bytes = (uint64_t)((char *)sf_heap_end() - (char *)sf_heap_start());
+
+	/* The rest is a snapshot of the lists. */
+	int i;
+	for(i = 0; i < NUM_QUICK_LISTS; i++)
+	{
+		stats->quick_bytes[i] = 0;
+		sf_block *blkp = sf_cur_heap->quick_lists[i].first;
+		while(blkp != NULL)
+		{
+			stats->quick_bytes[i] = stats->quick_bytes[i] + get_block_size(get_hdrp(blkp));
+			blkp = blkp->body.links.next;
+		}
+	}
+
+	stats->largest_free_block = 0;
+	for(i = 0; i < NUM_FREE_LISTS; i++)
+	{
+		stats->free_blocks[i] = 0;
+		stats->free_bytes[i] = 0;
+		sf_block *blkp = sf_cur_heap->free_list_heads[i].body.links.next;
+		while(blkp != &sf_cur_heap->free_list_heads[i])
+		{
+			sf_size_t bsize = get_block_size(get_hdrp(blkp));
+			stats->free_blocks[i]++;
+			stats->free_bytes[i] = stats->free_bytes[i] + bsize;
+			if(bsize > stats->largest_free_block)
+				stats->largest_free_block = bsize;
+			blkp = blkp->body.links.next;
+		}
+	}
+
+	/* The wilderness is free too, though it is on no list. */
+	sf_block *top = sf_wilderness();
+	if(top != NULL)
+	{
+		sf_size_t bsize = get_block_size(get_hdrp(top));
+		i = sf_frlst_index(bsize);
+		stats->free_blocks[i]++;
+		stats->free_bytes[i] = stats->free_bytes[i] + bsize;
+		if(bsize > stats->largest_free_block)
+			stats->largest_free_block = bsize;
+	}
+	return;
+}
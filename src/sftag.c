@@ -0,0 +1,348 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfhelper.h"
+#include "sfpage.h"
+#include "sfplace.h"
+#include "sfheapmap.h"
+#include "sftag.h"
+
+/* Every 16 bytes of heap address space has an entry in the side table. */
+#define SF_TAG_GRANULE_SHIFT 4
+
+struct sf_tag_counters {
+	uint64_t mallocs;
+	uint64_t frees;
+	uint64_t reallocs;
+	uint64_t total_bytes;
+	uint64_t payload_bytes;
+	uint64_t allocated_bytes;
+	uint64_t peak_payload_bytes;
+	uint64_t first_ns;			// Time of the first allocation, 0 if there was none.
+};
+
+/* The tag state of a heap.  A pinned sub-heap has a table of its own for its entries,
+   but counts its blocks in the counters of its parent, so a tag has one set of counters. */
+struct sf_tag_table {
+	size_t map_size;
+	char *base;				// Start of the address range covered by entries[].
+	size_t span;				// Length of that range.
+	struct sf_tag_counters *counters;	// own[], or the parent's for a pinned sub-heap.
+	struct sf_tag_counters own[SF_NUM_TAGS];
+	sf_arena *heaps[SF_NUM_TAGS];		// Sub-heaps of pinned (or once pinned) tags.
+	bool pinned[SF_NUM_TAGS];
+	int nheaps;
+	uint8_t heap_tags[SF_NUM_TAGS];		// Tags with a sub-heap, in order of creation.
+	uint16_t *entries;			// Tag + 1 of the block starting in each granule, 0 if none.
+};
+
+static uint64_t sf_tag_now_ns(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Create the table of the current heap, counting in counters, or in its own if NULL. */
+static struct sf_tag_table *sf_tag_table_create(struct sf_tag_counters *counters){
+	char *base = sf_heap_start();
+	size_t span = SF_TAG_HEAP_CAPACITY;
+	if(sf_cur_heap->base != NULL)
+	{
+		base = sf_cur_heap->base;
+		span = (size_t)(sf_cur_heap->limit - sf_cur_heap->base);
+	}
+	size_t header_size = (sizeof(struct sf_tag_table) + sizeof(uint16_t) - 1) / sizeof(uint16_t) * sizeof(uint16_t);
+	size_t map_size = header_size + (span >> SF_TAG_GRANULE_SHIFT) * sizeof(uint16_t);
+
+	char *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(map == MAP_FAILED)
+		return NULL;
+
+	/* The mapping starts out zero: no counts, no sub-heaps, no tagged blocks. */
+	struct sf_tag_table *table = (struct sf_tag_table *)map;
+	table->map_size = map_size;
+	table->base = base;
+	table->span = span;
+	table->counters = (counters != NULL) ? counters : table->own;
+	table->entries = (uint16_t *)(map + header_size);
+	sf_cur_heap->tags = table;
+	return table;
+}
+
+/* The table of the current heap, created on first use. */
+static struct sf_tag_table *sf_tag_table(){
+	if(sf_cur_heap->tags != NULL)
+		return sf_cur_heap->tags;
+	return sf_tag_table_create(NULL);
+}
+
+/* Side table entry of blkp, or NULL if blkp is outside the table. */
+static uint16_t *sf_tag_entry(struct sf_tag_table *table, sf_block *blkp){
+	char *p = (char *)blkp;
+	if(p < table->base || p >= table->base + table->span)
+		return NULL;
+	return &table->entries[(size_t)(p - table->base) >> SF_TAG_GRANULE_SHIFT];
+}
+
+static void sf_tag_peak(struct sf_tag_counters *c){
+	if(c->payload_bytes > c->peak_payload_bytes)
+		c->peak_payload_bytes = c->payload_bytes;
+	return;
+}
+
+void *sf_malloc_tagged(sf_size_t size, unsigned int tag){
+	if(tag >= SF_NUM_TAGS)
+	{
+		sf_errno = EINVAL;
+		return NULL;
+	}
+
+	/* If the request size is 0, then return NULL without setting sf_errno. */
+	if(size == 0)
+		return NULL;
+
+	struct sf_tag_table *table = sf_tag_table();
+	if(table == NULL)
+	{
+		sf_errno = ENOMEM;
+		return NULL;
+	}
+	if(table->pinned[tag])
+		return sf_arena_malloc_tagged(table->heaps[tag], size, tag);
+
+	char *pp = sf_malloc(size);
+	if(pp == NULL)
+		return NULL;
+
+	sf_block *blkp = (sf_block *)(pp - sizeof(sf_header) - sizeof(sf_footer));
+	uint16_t *entry = sf_tag_entry(table, blkp);
+	if(entry == NULL)
+	{
+		/* The heap has outgrown the table; the block stays untagged. */
+		sf_free(pp);
+		sf_errno = ENOMEM;
+		return NULL;
+	}
+	*entry = (uint16_t)(tag + 1);
+
+	struct sf_tag_counters *c = &table->counters[tag];
+	if(c->first_ns == 0)
+		c->first_ns = sf_tag_now_ns();
+	c->mallocs++;
+	c->total_bytes = c->total_bytes + size;
+	c->payload_bytes = c->payload_bytes + size;
+	c->allocated_bytes = c->allocated_bytes + get_block_size(get_hdrp(blkp));
+	sf_tag_peak(c);
+	return pp;
+}
+
+int sf_tag_of(void *ptr){
+	struct sf_tag_table *table = sf_cur_heap->tags;
+	if(table == NULL || ptr == NULL)
+		return -1;
+
+	/* Pinned blocks are tagged in the table of their sub-heap. */
+	sf_arena *tag_heap = sf_tag_owner(ptr);
+	if(tag_heap != NULL)
+	{
+		sf_heap *saved_heap = sf_cur_heap;
+		sf_cur_heap = sf_arena_heap(tag_heap);
+		int tag = sf_tag_of(ptr);
+		sf_cur_heap = saved_heap;
+		return tag;
+	}
+
+	uint16_t *entry = sf_tag_entry(table, (sf_block *)((char *)ptr - sizeof(sf_header) - sizeof(sf_footer)));
+	if(entry == NULL || *entry == 0)
+		return -1;
+	return (int)*entry - 1;
+}
+
+int sf_tag_get_stats(unsigned int tag, struct sf_tag_stats *stats){
+	if(tag >= SF_NUM_TAGS)
+	{
+		sf_errno = EINVAL;
+		return -1;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+	struct sf_tag_table *table = sf_cur_heap->tags;
+	if(table == NULL)
+		return 0;
+
+	struct sf_tag_counters *c = &table->counters[tag];
+	stats->mallocs = c->mallocs;
+	stats->frees = c->frees;
+	stats->reallocs = c->reallocs;
+	stats->total_bytes = c->total_bytes;
+	stats->payload_bytes = c->payload_bytes;
+	stats->allocated_bytes = c->allocated_bytes;
+	stats->peak_payload_bytes = c->peak_payload_bytes;
+	stats->pinned = table->pinned[tag];
+
+	if(c->first_ns != 0)
+	{
+		uint64_t elapsed = sf_tag_now_ns() - c->first_ns;
+		if(elapsed != 0)
+			stats->alloc_rate = (double)c->total_bytes * 1e9 / (double)elapsed;
+	}
+	if(c->allocated_bytes != 0)
+		stats->internal_fragmentation = 1.0 - (double)c->payload_bytes / (double)c->allocated_bytes;
+	if(table->heaps[tag] != NULL)
+	{
+		struct sf_frag_report report;
+		if(sf_arena_heap_frag(table->heaps[tag], &report) == 0)
+			stats->external_fragmentation = report.external_fragmentation;
+	}
+	return 0;
+}
+
+int sf_tag_pin(unsigned int tag, bool pin){
+	if(tag >= SF_NUM_TAGS)
+	{
+		sf_errno = EINVAL;
+		return -1;
+	}
+
+	struct sf_tag_table *table = sf_tag_table();
+	if(table == NULL)
+	{
+		sf_errno = ENOMEM;
+		return -1;
+	}
+	if(!pin || table->heaps[tag] != NULL)
+	{
+		table->pinned[tag] = pin;
+		return 0;
+	}
+
+	sf_arena *arena = sf_arena_create(table->span);
+	if(arena == NULL)
+		return -1;
+
+	/* Place blocks the way the parent heap does, and count them with the parent. */
+	if(sf_cur_heap->frlst_order != SF_ORDER_LIFO)
+		sf_arena_set_frlst_order(arena, sf_cur_heap->frlst_order);
+	sf_arena_set_wilderness(arena, sf_cur_heap->wilderness);
+	sf_heap *saved_heap = sf_cur_heap;
+	sf_cur_heap = sf_arena_heap(arena);
+	struct sf_tag_table *sub_table = sf_tag_table_create(table->counters);
+	sf_cur_heap = saved_heap;
+	if(sub_table == NULL)
+	{
+		sf_arena_destroy(arena);
+		sf_errno = ENOMEM;
+		return -1;
+	}
+
+	table->heaps[tag] = arena;
+	table->heap_tags[table->nheaps++] = (uint8_t)tag;
+	table->pinned[tag] = true;
+	sf_cur_heap->sub_heaps = true;
+	return 0;
+}
+
+sf_arena *sf_tag_owner(void *ptr){
+	struct sf_tag_table *table = sf_cur_heap->tags;
+	if(table == NULL)
+		return NULL;
+
+	int i;
+	for(i = 0; i < table->nheaps; i++)
+	{
+		sf_arena *arena = table->heaps[table->heap_tags[i]];
+		if(sf_arena_contains(arena, ptr))
+			return arena;
+	}
+	return NULL;
+}
+
+void sf_tag_free_block(sf_block *blkp){
+	struct sf_tag_table *table = sf_cur_heap->tags;
+	if(table == NULL)
+		return;
+	uint16_t *entry = sf_tag_entry(table, blkp);
+	if(entry == NULL || *entry == 0)
+		return;
+
+	sf_header *hdrp = get_hdrp(blkp);
+	struct sf_tag_counters *c = &table->counters[*entry - 1];
+	c->frees++;
+	c->payload_bytes = c->payload_bytes - get_payload_size(hdrp);
+	c->allocated_bytes = c->allocated_bytes - get_block_size(hdrp);
+	*entry = 0;
+	return;
+}
+
+void sf_tag_realloc_block(sf_block *old_blkp, sf_block *new_blkp, sf_size_t old_payload, sf_size_t old_bsize){
+	struct sf_tag_table *table = sf_cur_heap->tags;
+	if(table == NULL)
+		return;
+	uint16_t *old_entry = sf_tag_entry(table, old_blkp);
+	if(old_entry == NULL || *old_entry == 0)
+		return;
+
+	sf_header *hdrp = get_hdrp(new_blkp);
+	sf_size_t new_payload = get_payload_size(hdrp);
+	struct sf_tag_counters *c = &table->counters[*old_entry - 1];
+	c->reallocs++;
+	if(new_payload > old_payload)
+		c->total_bytes = c->total_bytes + (new_payload - old_payload);
+	c->payload_bytes = c->payload_bytes - old_payload + new_payload;
+	c->allocated_bytes = c->allocated_bytes - old_bsize + get_block_size(hdrp);
+	sf_tag_peak(c);
+
+	/* Both blocks are in the heap, so both are in the table. */
+	if(new_blkp != old_blkp)
+	{
+		*sf_tag_entry(table, new_blkp) = *old_entry;
+		*old_entry = 0;
+	}
+	return;
+}
+
+void sf_tag_forget(){
+	struct sf_tag_table *table = sf_cur_heap->tags;
+	char *heap_start = sf_heap_start();
+	char *heap_end = sf_heap_end();
+	if(table == NULL || heap_start == heap_end)
+		return;
+
+	/* Take the live tagged blocks out of the counts, as if they had never been allocated. */
+	sf_header *epilogue = (sf_header *)(heap_end - sizeof(sf_header));
+	sf_block *blkp = (sf_block *)(heap_start + sizeof(sf_block));
+	while(get_hdrp(blkp) < epilogue)
+	{
+		sf_header *hdrp = get_hdrp(blkp);
+		uint16_t *entry = sf_tag_entry(table, blkp);
+		if(get_alloc(hdrp) != 0 && entry != NULL && *entry != 0)
+		{
+			struct sf_tag_counters *c = &table->counters[*entry - 1];
+			c->payload_bytes = c->payload_bytes - get_payload_size(hdrp);
+			c->allocated_bytes = c->allocated_bytes - get_block_size(hdrp);
+			*entry = 0;
+		}
+		blkp = get_next_blkp(blkp);
+	}
+	return;
+}
+
+void sf_tag_drop(){
+	struct sf_tag_table *table = sf_cur_heap->tags;
+	if(table == NULL)
+		return;
+
+	int i;
+	for(i = 0; i < table->nheaps; i++)
+		sf_arena_destroy(table->heaps[table->heap_tags[i]]);
+	munmap(table, table->map_size);
+	sf_cur_heap->tags = NULL;
+	return;
+}
@@ -0,0 +1,285 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sftrace.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* A ring slot.  seq tells producers and the flusher whose turn the slot is: it is
+   pos when the slot is free for the event at position pos, and pos + 1 once that
+   event has been written. */
+typedef struct sf_trace_cell {
+	uint64_t seq;
+	sf_trace_event event;
+} sf_trace_cell;
+
+/* Events drained by the flusher per write(). */
+#define SF_TRACE_BATCH 256
+
+static sf_trace_cell *trace_ring = NULL;			// The ring as seen by producers.
+static sf_trace_cell *trace_cells = NULL;			// The ring as seen by the flusher.
+static uint64_t trace_mask = 0;
+static uint64_t trace_head __attribute__((aligned(64))) = 0;	// Next position to append.
+static uint64_t trace_dropped_events __attribute__((aligned(64))) = 0;
+static uint64_t trace_tail = 0;					// Next position to drain.
+static int trace_fd = -1;
+static int trace_stopping = 0;
+static int trace_paused = 0;
+static int trace_error = 0;
+static pthread_t trace_thread;
+
+/* Kernel thread id of the calling thread, looked up on its first event. */
+static __thread uint32_t trace_tid = 0;
+
+
+/* Timestamps come from the TSC where there is one, and the monotonic clock otherwise. */
+#if defined(__x86_64__) || defined(__i386__)
+static uint64_t sf_trace_ticks(){
+	return __rdtsc();
+}
+#else
+static uint64_t sf_trace_ticks(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+static uint64_t sf_trace_now_ns(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/* Measure the timestamp frequency against the monotonic clock over 10ms. */
+static uint64_t sf_trace_calibrate(){
+	struct timespec pause = {0, 10000000};
+	uint64_t ns0 = sf_trace_now_ns();
+	uint64_t ticks0 = sf_trace_ticks();
+	nanosleep(&pause, NULL);
+	uint64_t ns1 = sf_trace_now_ns();
+	uint64_t ticks1 = sf_trace_ticks();
+
+	if(ns1 <= ns0)
+		return 1000000000;
+	return (uint64_t)((double)(ticks1 - ticks0) * 1e9 / (double)(ns1 - ns0));
+}
+
+/* Write exactly n bytes, retrying on short writes. */
+static int sf_trace_write(int fd, const void *buf, size_t n){
+	const char *p = buf;
+	while(n > 0)
+	{
+		ssize_t w = write(fd, p, n);
+		if(w < 0 && errno == EINTR)
+			continue;
+		if(w <= 0)
+			return -1;
+		p = p + w;
+		n = n - (size_t)w;
+	}
+	return 0;
+}
+
+void sf_trace_record(uint32_t op, void *ptr, void *old_ptr, sf_size_t size){
+	sf_trace_cell *ring = __atomic_load_n(&trace_ring, __ATOMIC_ACQUIRE);
+	if(ring == NULL)
+		return;
+
+	if(trace_tid == 0)
+		trace_tid = (uint32_t)syscall(SYS_gettid);
+	uint64_t ticks = sf_trace_ticks();
+
+	/* Claim a position whose slot the flusher has released. */
+	sf_trace_cell *cell;
+	uint64_t pos = __atomic_load_n(&trace_head, __ATOMIC_RELAXED);
+	while(1)
+	{
+		cell = &ring[pos & trace_mask];
+		int64_t dif = (int64_t)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - pos);
+		if(dif == 0)
+		{
+			if(__atomic_compare_exchange_n(&trace_head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if(dif < 0)
+		{
+			/* The ring is full. */
+			__atomic_fetch_add(&trace_dropped_events, 1, __ATOMIC_RELAXED);
+			return;
+		}
+		else
+		{
+			pos = __atomic_load_n(&trace_head, __ATOMIC_RELAXED);
+		}
+	}
+
+	cell->event.ticks = ticks;
+	cell->event.ptr = (uint64_t)(uintptr_t)ptr;
+	cell->event.old_ptr = (uint64_t)(uintptr_t)old_ptr;
+	cell->event.size = size;
+	cell->event.tid = trace_tid;
+	cell->event.op = op;
+	cell->event.unused = 0;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+	return;
+}
+
+/* Move the events that are ready, up to one batch, from the ring to the file.
+   Return the number of events moved. */
+static size_t sf_trace_drain(){
+	sf_trace_event batch[SF_TRACE_BATCH];
+	size_t n = 0;
+
+	while(n < SF_TRACE_BATCH)
+	{
+		sf_trace_cell *cell = &trace_cells[trace_tail & trace_mask];
+		if(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != trace_tail + 1)
+			break;
+		batch[n] = cell->event;
+		n++;
+		__atomic_store_n(&cell->seq, trace_tail + trace_mask + 1, __ATOMIC_RELEASE);
+		trace_tail++;
+	}
+
+	if(n > 0 && sf_trace_write(trace_fd, batch, n * sizeof(sf_trace_event)) == -1)
+		trace_error = 1;
+	return n;
+}
+
+static void *sf_trace_flusher(void *arg){
+	struct timespec pause = {0, 1000000};
+
+	while(__atomic_load_n(&trace_stopping, __ATOMIC_ACQUIRE) == 0)
+	{
+		if(__atomic_load_n(&trace_paused, __ATOMIC_ACQUIRE) != 0 || sf_trace_drain() == 0)
+			nanosleep(&pause, NULL);
+	}
+
+	/* Write whatever is left. */
+	while(sf_trace_drain() != 0)
+		;
+	return NULL;
+}
+
+int sf_trace_start(const char *path, size_t ring_events){
+#ifndef SF_TRACE
+	sf_errno = ENOSYS;
+	return -1;
+#endif
+
+	if(__atomic_load_n(&trace_ring, __ATOMIC_ACQUIRE) != NULL)
+	{
+		sf_errno = EINVAL;
+		return -1;
+	}
+
+	if(ring_events == 0)
+		ring_events = SF_TRACE_DEFAULT_EVENTS;
+	size_t capacity = 2;
+	while(capacity < ring_events)
+		capacity = capacity * 2;
+
+	sf_trace_cell *ring = mmap(NULL, capacity * sizeof(sf_trace_cell), PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(ring == MAP_FAILED)
+	{
+		sf_errno = ENOMEM;
+		return -1;
+	}
+	size_t i;
+	for(i = 0; i < capacity; i++)
+		ring[i].seq = i;
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd == -1)
+	{
+		munmap(ring, capacity * sizeof(sf_trace_cell));
+		sf_errno = EIO;
+		return -1;
+	}
+
+	sf_trace_header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = SF_TRACE_MAGIC;
+	header.version = SF_TRACE_VERSION;
+	header.event_size = sizeof(sf_trace_event);
+	header.ticks_per_sec = sf_trace_calibrate();
+	header.start_ticks = sf_trace_ticks();
+	if(sf_trace_write(fd, &header, sizeof(header)) == -1)
+	{
+		close(fd);
+		munmap(ring, capacity * sizeof(sf_trace_cell));
+		sf_errno = EIO;
+		return -1;
+	}
+
+	trace_mask = capacity - 1;
+	trace_head = 0;
+	trace_tail = 0;
+	trace_dropped_events = 0;
+	trace_fd = fd;
+	trace_stopping = 0;
+	trace_paused = 0;
+	trace_error = 0;
+	trace_cells = ring;
+
+	if(pthread_create(&trace_thread, NULL, sf_trace_flusher, NULL) != 0)
+	{
+		trace_cells = NULL;
+		close(fd);
+		munmap(ring, capacity * sizeof(sf_trace_cell));
+		sf_errno = ENOMEM;
+		return -1;
+	}
+
+	/* Publish the ring last, so producers only see it once it is ready. */
+	__atomic_store_n(&trace_ring, ring, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int sf_trace_stop(){
+	if(__atomic_load_n(&trace_ring, __ATOMIC_ACQUIRE) == NULL)
+	{
+		sf_errno = EINVAL;
+		return -1;
+	}
+
+	/* Stop new events, then let the flusher drain the ring before it goes away. */
+	__atomic_store_n(&trace_ring, NULL, __ATOMIC_RELEASE);
+	__atomic_store_n(&trace_stopping, 1, __ATOMIC_RELEASE);
+	pthread_join(trace_thread, NULL);
+
+	munmap(trace_cells, (trace_mask + 1) * sizeof(sf_trace_cell));
+	trace_cells = NULL;
+	if(close(trace_fd) == -1)
+		trace_error = 1;
+	trace_fd = -1;
+
+	if(trace_error)
+	{
+		sf_errno = EIO;
+		return -1;
+	}
+	return 0;
+}
+
+void sf_trace_pause(bool pause){
+	__atomic_store_n(&trace_paused, pause ? 1 : 0, __ATOMIC_RELEASE);
+	return;
+}
+
+uint64_t sf_trace_dropped(){
+	return __atomic_load_n(&trace_dropped_events, __ATOMIC_RELAXED);
+}
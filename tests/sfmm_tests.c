@@ -1,8 +1,26 @@
+#define _DEFAULT_SOURCE
 #include <criterion/criterion.h>
 #include <errno.h>
 #include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/wait.h>
 #include "debug.h"
 #include "sfmm.h"
+#include "sfpage.h"
+#include "sfarena.h"
+#include "sfregion.h"
+#include "sfpool.h"
+#include "sfsnap.h"
+#include "sfstats.h"
+#include "sftrace.h"
+#include "sfheapmap.h"
+#include "sfalign.h"
+#include "sfplace.h"
+#include "sfhint.h"
+#include "sftag.h"
 #define TEST_TIMEOUT 15
 
 /*
@@ -522,3 +540,1145 @@ Test(sfmm_student_suite, student_test_5, .timeout = TEST_TIMEOUT, .signal = SIGA
 	/* sf_free should abort, test recieve signal = SIGABRT */
 	sf_free(p0);
 }
+
+Test(sfmm_student_suite, trim_free_tail, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	sf_set_trim_threshold(0);
+	void *x = sf_malloc(4032);
+	cr_assert_not_null(x, "x is NULL!");
+	cr_assert(sf_mem_start() + 4*PAGE_SZ == sf_heap_end(), "Heap is not four pages!");
+	sf_free(x);
+	assert_free_block_count(0, 1);
+	assert_free_block_count(4048, 1);
+
+	/* Keep nothing: everything but the first page goes back to the page source. */
+	size_t released = sf_trim(0);
+	cr_assert_eq(released, 3*PAGE_SZ, "Wrong number of bytes released (exp=%d, found=%ld)",
+		     3*PAGE_SZ, released);
+	cr_assert(sf_mem_start() + PAGE_SZ == sf_heap_end(), "Heap end was not moved down!");
+	assert_free_block_count(0, 1);
+	assert_free_block_count(976, 1);
+
+	/* Released pages are reused before sfutil grows the heap again. */
+	void *y = sf_malloc(4032);
+	cr_assert_not_null(y, "y is NULL!");
+	cr_assert(sf_mem_start() + 4*PAGE_SZ == sf_mem_end(), "Released pages were not reused!");
+	cr_assert(sf_mem_start() + 4*PAGE_SZ == sf_heap_end(), "Heap end is wrong after regrowth!");
+	assert_free_block_count(0, 0);
+	cr_assert(sf_errno == 0, "sf_errno is not 0!");
+}
+
+Test(sfmm_student_suite, trim_threshold, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	sf_set_trim_threshold(2*PAGE_SZ);
+	void *x = sf_malloc(8);
+	cr_assert_not_null(x, "x is NULL!");
+	void *y = sf_malloc(4032);
+	cr_assert_not_null(y, "y is NULL!");
+	cr_assert(sf_mem_start() + 5*PAGE_SZ == sf_heap_end(), "Heap is not five pages!");
+
+	/* Freeing y leaves a free tail of 5040 bytes, which is above the threshold.
+	   Three pages are released, keeping at least SF_TRIM_PAD bytes. */
+	sf_free(y);
+	cr_assert(sf_mem_start() + 2*PAGE_SZ == sf_heap_end(), "Heap was not trimmed!");
+	assert_quick_list_block_count(0, 0);
+	assert_free_block_count(0, 1);
+	assert_free_block_count(1968, 1);
+	assert_sf_statistics((double)8/32, (double)4040/(2*PAGE_SZ));
+
+	/* Freeing x leaves the free tail below the threshold. */
+	sf_free(x);
+	cr_assert(sf_mem_start() + 2*PAGE_SZ == sf_heap_end(), "Heap was trimmed below threshold!");
+	cr_assert(sf_errno == 0, "sf_errno is not 0!");
+}
+
+Test(sfmm_student_suite, trim_default_threshold, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	void *x = sf_malloc(8);
+	void *y = sf_malloc(10000);
+	cr_assert_not_null(y, "y is NULL!");
+	cr_assert(sf_mem_start() + 10*PAGE_SZ == sf_heap_end(), "Heap is not ten pages!");
+
+	/* With the default threshold, freeing y trims the heap of sfutil on its own. */
+	sf_free(y);
+	cr_assert(sf_heap_end() < sf_mem_start() + 10*PAGE_SZ, "Heap was not trimmed!");
+	cr_assert(sf_heap_end() <= sf_mem_start() + 2*PAGE_SZ + SF_TRIM_PAD, "Heap was not trimmed to the pad!");
+	sf_free(x);
+	cr_assert(sf_errno == 0, "sf_errno is not 0!");
+}
+
+Test(sfmm_student_suite, scavenge_large_free_block, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	void *x = sf_malloc(8);
+	char *y = sf_malloc(8000);
+	void *z = sf_malloc(8);
+	cr_assert_not_null(y, "y is NULL!");
+	memset(y, 0xAB, 8000);
+	sf_free(y);
+	assert_free_block_count(8016, 1);
+
+	/* Small blocks are left alone. */
+	cr_assert_eq(sf_scavenge(32*PAGE_SZ), 0, "Scavenged a block below the size limit!");
+
+	size_t released = sf_scavenge(PAGE_SZ);
+	cr_assert(released > 0, "Nothing was scavenged!");
+	cr_assert_eq(sf_scavenged_bytes(), released, "Scavenged byte count is wrong!");
+	/* Pages that are not resident are not counted twice. */
+	cr_assert_eq(sf_scavenge(PAGE_SZ), 0, "Released pages were counted again!");
+
+	/* The interior reads as zero, but the block is still intact in its free list. */
+	cr_assert_eq(y[4000], 0, "Interior of the free block was not released!");
+	assert_free_block_count(0, 2);
+	assert_free_block_count(8016, 1);
+
+	/* The block can still be allocated and coalesced. */
+	y = sf_malloc(8000);
+	cr_assert_not_null(y, "y is NULL!");
+	memset(y, 0xCD, 8000);
+	sf_free(y);
+	sf_free(x);
+	sf_free(z);
+	cr_assert(sf_errno == 0, "sf_errno is not 0!");
+}
+
+Test(sfmm_student_suite, huge_page_growth, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	sf_set_huge_pages(true);
+	void *x = sf_malloc(8);
+	cr_assert_not_null(x, "x is NULL!");
+
+	/* The first growth asks for a whole huge page, and keeps everything the 24-page
+	   sfutil heap can provide. */
+	cr_assert(sf_mem_start() + 24*PAGE_SZ == sf_heap_end(), "Heap did not grow in one chunk!");
+	assert_free_block_count(0, 1);
+	assert_free_block_count(24496, 1);
+
+	/* Once the page source is exhausted, growth fails as usual. */
+	void *y = sf_malloc(98304);
+	cr_assert_null(y, "y is not NULL!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+}
+
+Test(sfmm_student_suite, huge_page_arena_aligned, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	sf_set_huge_pages(true);
+	sf_arena *a = sf_arena_create(8*SF_HUGE_PAGE_SZ);
+	cr_assert_not_null(a, "a is NULL!");
+	char *x = sf_arena_malloc(a, 8);
+	cr_assert_not_null(x, "x is NULL!");
+
+	/* The heap starts on a huge page (the first payload is behind the prologue and a
+	   header), and grew by one whole huge page. */
+	cr_assert_eq(((uintptr_t)x - 48) % SF_HUGE_PAGE_SZ, 0, "Arena heap is not huge-page aligned!");
+	struct sf_stats stats;
+	sf_arena_get_stats(a, &stats);
+	cr_assert_eq(stats.heap_bytes, SF_HUGE_PAGE_SZ, "Arena heap did not grow by a huge page!");
+	sf_arena_destroy(a);
+	sf_set_huge_pages(false);
+}
+
+Test(sfmm_student_suite, frlst_last_list_searched, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	void *x = sf_malloc(12000);
+	void *y = sf_malloc(8);
+	cr_assert(x != NULL && y != NULL, "sf_malloc failed!");
+	sf_free(x);
+	assert_free_block_count(12016, 1);
+	void *end = sf_heap_end();
+
+	/* The freed block is in the last free list, and is reused without growing the heap. */
+	void *z = sf_malloc(10000);
+	cr_assert_eq(z, x, "Block in the last free list was not reused!");
+	cr_assert(sf_heap_end() == end, "Heap grew instead!");
+	cr_assert(sf_errno == 0, "sf_errno is not 0!");
+}
+
+Test(sfmm_student_suite, arena_isolation, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	sf_arena *a = sf_arena_create(64*PAGE_SZ);
+	sf_arena *b = sf_arena_create(64*PAGE_SZ);
+	cr_assert_not_null(a, "a is NULL!");
+	cr_assert_not_null(b, "b is NULL!");
+
+	/* Arena blocks have the usual format, and do not touch the sfutil heap. */
+	void *x = sf_arena_malloc(a, 100);
+	void *y = sf_arena_malloc(b, 100);
+	cr_assert_not_null(x, "x is NULL!");
+	cr_assert_not_null(y, "y is NULL!");
+	assert_block_header(x, 100, 112, 1, 1, 0);
+	assert_block_header(y, 100, 112, 1, 1, 0);
+	cr_assert(sf_mem_start() == sf_mem_end(), "The sfutil heap was initialized!");
+	cr_assert((char *)y - (char *)x >= 64*PAGE_SZ || (char *)x - (char *)y >= 64*PAGE_SZ,
+		  "Arenas overlap!");
+
+	/* An arena can grow past one page, and realloc stays inside it. */
+	void *z = sf_arena_malloc(a, 20000);
+	cr_assert_not_null(z, "z is NULL!");
+	x = sf_arena_realloc(a, x, 3000);
+	cr_assert_not_null(x, "x is NULL!");
+	assert_block_header(x, 3000, 3008, 1, 1, 0);
+
+	/* Freed blocks go to the arena's own lists. */
+	sf_arena_free(b, y);
+	assert_block_header(y, 0, 112, 1, 1, 1);
+	cr_assert(sf_mem_start() == sf_mem_end(), "The sfutil heap was initialized!");
+
+	/* The sfutil heap still works on its own. */
+	void *w = sf_malloc(8);
+	cr_assert_not_null(w, "w is NULL!");
+	assert_free_block_count(0, 1);
+	assert_free_block_count(944, 1);
+
+	sf_arena_destroy(a);
+	sf_arena_destroy(b);
+	cr_assert(sf_errno == 0, "sf_errno is not 0!");
+}
+
+Test(sfmm_student_suite, arena_full, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	sf_arena *a = sf_arena_create(2*PAGE_SZ);
+	cr_assert_not_null(a, "a is NULL!");
+	void *x = sf_arena_malloc(a, 1900);
+	cr_assert_not_null(x, "x is NULL!");
+	void *y = sf_arena_malloc(a, 100);
+	cr_assert_null(y, "y is not NULL!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+	sf_arena_destroy(a);
+}
+
+Test(sfmm_student_suite, region_bump_and_reset, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	char *x = sf_region_malloc(1);
+	char *y = sf_region_malloc(20);
+	char *z = sf_region_malloc(5000);
+	cr_assert_not_null(x, "x is NULL!");
+	cr_assert_not_null(z, "z is NULL!");
+	cr_assert(((uintptr_t)x & 0xF) == 0 && ((uintptr_t)y & 0xF) == 0, "Region block is not aligned!");
+	cr_assert(y == x + 16 && z == y + 32, "Region blocks are not contiguous!");
+	memset(z, 0xAB, 5000);
+
+	/* Region frees do nothing and the heap is left alone. */
+	sf_free(y);
+	cr_assert(sf_mem_start() == sf_mem_end(), "The sfutil heap was initialized!");
+	void *w = sf_malloc(100);
+	cr_assert_not_null(w, "w is NULL!");
+	cr_assert(!sf_region_owns(w), "Heap block is owned by the region!");
+
+	/* Realloc keeps the contents. */
+	y[0] = 'y';
+	y = sf_realloc(y, 40);
+	cr_assert_not_null(y, "y is NULL!");
+	cr_assert_eq(y[0], 'y', "Region realloc lost the contents!");
+
+	/* Reset hands out the same memory again. */
+	sf_region_reset();
+	cr_assert(!sf_region_owns(z), "Region still owns z after reset!");
+	cr_assert_eq(sf_region_malloc(64), x, "Region was not rewound!");
+	cr_assert(sf_errno == 0, "sf_errno is not 0!");
+}
+
+Test(sfmm_student_suite, pool_alloc_free_destroy, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	sf_pool *pool = sf_pool_create(24, 8);
+	cr_assert_not_null(pool, "pool is NULL!");
+
+	/* Slots are 24 bytes apart with no header in between. */
+	char *x = sf_pool_alloc(pool);
+	char *y = sf_pool_alloc(pool);
+	cr_assert_not_null(x, "x is NULL!");
+	cr_assert(y == x + 24, "Pool slots are not packed!");
+
+	/* Enough objects to need a second chunk. */
+	int i;
+	void *objs[200];
+	for(i = 0; i < 200; i++) {
+		objs[i] = sf_pool_alloc(pool);
+		cr_assert_not_null(objs[i], "objs[%d] is NULL!", i);
+		memset(objs[i], i, 24);
+	}
+
+	/* Frees are LIFO. */
+	sf_pool_free(pool, y);
+	cr_assert(sf_pool_alloc(pool) == y, "Freed slot was not reused!");
+
+	/* Destroying the pool returns every chunk to the heap. */
+	sf_pool_destroy(pool);
+	assert_quick_list_block_count(0, 1);
+	assert_free_block_count(0, 1);
+	cr_assert(sf_errno == 0, "sf_errno is not 0!");
+
+	/* Objects honour alignments larger than the heap's. */
+	pool = sf_pool_create(40, 64);
+	cr_assert_not_null(pool, "pool is NULL!");
+	for(i = 0; i < 3; i++)
+		cr_assert(((uintptr_t)sf_pool_alloc(pool) & 0x3F) == 0, "Pool object is not aligned!");
+	sf_pool_destroy(pool);
+
+	/* Alignment must be a power of two. */
+	cr_assert_null(sf_pool_create(24, 12), "Pool with bad alignment was created!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+}
+
+
+#define POOL_TEST_THREADS 4
+#define POOL_TEST_LIVE 64
+
+/* Take POOL_TEST_LIVE objects, fill them with the thread's byte, check that no other
+   thread wrote to them, and give them back, over and over. */
+static void *pool_test_thread(void *arg){
+	sf_pool *pool = ((void **)arg)[0];
+	char mark = (char)(uintptr_t)((void **)arg)[1];
+	char *objs[POOL_TEST_LIVE];
+	int round, i;
+	for(round = 0; round < 2000; round++) {
+		for(i = 0; i < POOL_TEST_LIVE; i++) {
+			objs[i] = sf_pool_alloc(pool);
+			if(objs[i] == NULL)
+				return (void *)1;
+			memset(objs[i], mark, 16);
+		}
+		for(i = 0; i < POOL_TEST_LIVE; i++) {
+			if(objs[i][0] != mark || objs[i][15] != mark)
+				return (void *)1;
+			sf_pool_free(pool, objs[i]);
+		}
+	}
+	sf_pool_flush_thread_cache(pool);
+	return NULL;
+}
+
+Test(sfmm_student_suite, pool_thread_cache, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	sf_pool *pool = sf_pool_create(16, 0);
+	cr_assert_not_null(pool, "pool is NULL!");
+	cr_assert_eq(sf_pool_set_thread_cache(pool, 1), -1, "Magazine of one slot was accepted!");
+	cr_assert_eq(sf_pool_set_thread_cache(pool, 16), 0, "sf_pool_set_thread_cache failed!");
+
+	/* Grow the pool up front, so the threads never use the heap. */
+	size_t need = POOL_TEST_THREADS * (POOL_TEST_LIVE + 16);
+	cr_assert_eq(sf_pool_reserve(pool, need), 0, "sf_pool_reserve failed!");
+	void *end = sf_heap_end();
+
+	pthread_t threads[POOL_TEST_THREADS];
+	void *args[POOL_TEST_THREADS][2];
+	int i;
+	for(i = 0; i < POOL_TEST_THREADS; i++) {
+		args[i][0] = pool;
+		args[i][1] = (void *)(uintptr_t)('a' + i);
+		cr_assert_eq(pthread_create(&threads[i], NULL, pool_test_thread, args[i]), 0, "pthread_create failed!");
+	}
+	for(i = 0; i < POOL_TEST_THREADS; i++) {
+		void *ret;
+		pthread_join(threads[i], &ret);
+		cr_assert_null(ret, "Thread %d saw an object shared with another thread!", i);
+	}
+
+	/* Every slot came back from the magazines: the reserve is still enough. */
+	cr_assert_eq(sf_pool_set_thread_cache(pool, 0), 0, "sf_pool_set_thread_cache failed!");
+	for(i = 0; i < (int)need; i++)
+		cr_assert_not_null(sf_pool_alloc(pool), "Pool ran out!");
+	cr_assert(sf_heap_end() == end, "Slots were lost in the magazines!");
+	sf_pool_destroy(pool);
+}
+
+Test(sfmm_student_suite, persistent_heap_reopen, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	char path[] = "/tmp/sfmm_heap_XXXXXX";
+	int fd = mkstemp(path);
+	cr_assert(fd != -1, "Could not create a temporary file!");
+	close(fd);
+
+	sf_arena *heap = sf_heap_open(path, 16*PAGE_SZ);
+	cr_assert_not_null(heap, "heap is NULL!");
+	char *x = sf_arena_malloc(heap, 64);
+	void *y = sf_arena_malloc(heap, 200);
+	cr_assert_not_null(x, "x is NULL!");
+	strcpy(x, "persistent");
+	sf_arena_set_root(heap, x);
+	sf_arena_free(heap, y);
+	cr_assert_eq(sf_heap_close(heap), 0, "Heap was not closed!");
+
+	/* The heap comes back at the same place, with its root, data and lists. */
+	heap = sf_heap_open(path, 0);
+	cr_assert_not_null(heap, "heap is NULL after reopening!");
+	x = sf_arena_get_root(heap);
+	cr_assert_not_null(x, "Root was lost!");
+	cr_assert(strcmp(x, "persistent") == 0, "Data was lost!");
+	cr_assert_eq(sf_arena_malloc(heap, 200), y, "Free lists were lost!");
+
+	/* A heap that was not closed is refused. */
+	sf_arena_destroy(heap);
+	cr_assert_null(sf_heap_open(path, 0), "Dirty heap was opened!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+	unlink(path);
+}
+
+Test(sfmm_student_suite, persistent_heap_other_process, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	char path[] = "/tmp/sfmm_heap_XXXXXX";
+	int fd = mkstemp(path);
+	cr_assert(fd != -1, "Could not create a temporary file!");
+	close(fd);
+
+	/* A child with a MAGIC of its own writes the heap. */
+	sf_header magic = MAGIC;
+	pid_t pid = fork();
+	cr_assert(pid != -1, "fork failed!");
+	if(pid == 0) {
+		sf_set_magic(~magic);
+		sf_arena *heap = sf_heap_open(path, 16*PAGE_SZ);
+		if(heap == NULL)
+			_exit(1);
+		char *x = sf_arena_malloc(heap, 64);
+		void *y = sf_arena_malloc(heap, 300);
+		void *z = sf_arena_malloc(heap, 64);
+		if(x == NULL || y == NULL || z == NULL)
+			_exit(1);
+		strcpy(x, "written by the child");
+		sf_arena_set_root(heap, x);
+		sf_arena_free(heap, y);
+		_exit(sf_heap_close(heap) == 0 ? 0 : 1);
+	}
+	int status;
+	cr_assert(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0,
+		"Child could not write the heap!");
+
+	/* The parent reads it back, and uses its lists. */
+	sf_arena *heap = sf_heap_open(path, 0);
+	cr_assert_not_null(heap, "heap is NULL after reopening!");
+	char *x = sf_arena_get_root(heap);
+	cr_assert(x != NULL && strcmp(x, "written by the child") == 0, "Data was lost!");
+	void *y = sf_arena_malloc(heap, 300);
+	cr_assert_not_null(y, "Allocation in the reopened heap failed!");
+	cr_assert_eq((char *)y, x + 80, "Free block of the child was not reused!");
+	sf_arena_free(heap, x);
+	sf_arena_free(heap, y);
+	cr_assert_eq(sf_heap_close(heap), 0, "Heap was not closed!");
+	unlink(path);
+}
+
+Test(sfmm_student_suite, persistent_heap_address_in_use, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	char path[] = "/tmp/sfmm_heap_XXXXXX";
+	char copy[] = "/tmp/sfmm_heap_XXXXXX";
+	int fd = mkstemp(path);
+	int copy_fd = mkstemp(copy);
+	cr_assert(fd != -1 && copy_fd != -1, "Could not create a temporary file!");
+	close(fd);
+
+	sf_arena *heap = sf_heap_open(path, 16*PAGE_SZ);
+	cr_assert_not_null(heap, "heap is NULL!");
+	cr_assert_eq(sf_heap_close(heap), 0, "Heap was not closed!");
+
+	/* A copy of the file wants the same address as the original. */
+	char buf[4096];
+	ssize_t n;
+	fd = open(path, O_RDONLY);
+	while((n = read(fd, buf, sizeof(buf))) > 0)
+		cr_assert_eq(write(copy_fd, buf, (size_t)n), n, "Could not copy the heap!");
+	close(fd);
+	close(copy_fd);
+
+	/* While the original is open, its address is taken, and the copy cannot be opened. */
+	heap = sf_heap_open(path, 0);
+	cr_assert_not_null(heap, "heap is NULL after reopening!");
+	cr_assert_null(sf_heap_open(copy, 0), "Heap was mapped over another mapping!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+	cr_assert_eq(sf_heap_close(heap), 0, "Heap was not closed!");
+
+	/* Once the address is free again, the copy opens. */
+	heap = sf_heap_open(copy, 0);
+	cr_assert_not_null(heap, "Copy could not be opened at a free address!");
+	cr_assert_eq(sf_heap_close(heap), 0, "Heap was not closed!");
+	unlink(path);
+	unlink(copy);
+}
+
+Test(sfmm_student_suite, snapshot_restore, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	char path[] = "/tmp/sfmm_snap_XXXXXX";
+	int fd = mkstemp(path);
+	cr_assert(fd != -1, "Could not create a temporary file!");
+
+	/* A fragmented heap: two quick list blocks and a free block. */
+	char *u = sf_malloc(200);
+	void *v = sf_malloc(150);
+	char *w = sf_malloc(50);
+	void *x = sf_malloc(1500);
+	strcpy(u, "snapshot");
+	sf_free(v);
+	sf_free(x);
+	void *q = sf_malloc(20);
+	sf_free(q);
+	cr_assert_eq(sf_heap_snapshot(fd), 0, "Snapshot failed!");
+
+	/* Change everything, then go back. */
+	strcpy(u, "changed");
+	sf_free(w);
+	void *y = sf_malloc(3000);
+	cr_assert_not_null(y, "y is NULL!");
+	double itfg = sf_internal_fragmentation();
+	lseek(fd, 0, SEEK_SET);
+	cr_assert_eq(sf_heap_restore(fd), 0, "Restore failed!");
+	close(fd);
+	unlink(path);
+
+	cr_assert(strcmp(u, "snapshot") == 0, "Payload was not restored!");
+	cr_assert(sf_internal_fragmentation() != itfg, "Statistics were not restored!");
+	assert_block_header(w, 50, 64, 1, 1, 0);
+	assert_quick_list_block_count(0, 2);
+	assert_quick_list_block_count(32, 1);
+	assert_quick_list_block_count(160, 1);
+	assert_free_block_count(0, 1);
+	assert_free_block_count(1536, 1);
+	cr_assert(sf_mem_start() + 2*PAGE_SZ == sf_heap_end(), "Heap was not resized!");
+
+	/* The restored lists work. */
+	cr_assert_eq(sf_malloc(150), v, "Quick list was not restored!");
+	cr_assert_eq(sf_malloc(20), q, "Quick list was not restored!");
+	cr_assert_eq(sf_malloc(1000), (char *)q + 32, "Free list was not restored!");
+	sf_free(u);
+	sf_free(w);
+	cr_assert(sf_errno == 0, "sf_errno is not 0!");
+}
+
+Test(sfmm_student_suite, snapshot_restore_releases_pages, .timeout = TEST_TIMEOUT) {
+	char path[] = "/tmp/sfmm_snap_XXXXXX";
+	int fd = mkstemp(path);
+	cr_assert(fd != -1, "Could not create a temporary file!");
+
+	void *x = sf_malloc(100);
+	cr_assert_eq(sf_heap_snapshot(fd), 0, "Snapshot failed!");
+
+	/* Grow the heap well past the snapshot and fill the new pages. */
+	char *y = sf_malloc(12000);
+	cr_assert_not_null(y, "y is NULL!");
+	memset(y, 0x5a, 12000);
+	char *old_end = sf_heap_end();
+	lseek(fd, 0, SEEK_SET);
+	cr_assert_eq(sf_heap_restore(fd), 0, "Restore failed!");
+	close(fd);
+	unlink(path);
+
+	/* The first system page lying wholly above the restored heap was given back, so it
+	   reads as zero. */
+	uintptr_t os_page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	char *lo = (char *)(((uintptr_t)sf_heap_end() + os_page - 1) & ~(os_page - 1));
+	cr_assert(lo + os_page <= old_end && lo + os_page - 1 >= y, "No whole page above the snapshot!");
+	cr_assert_eq(lo[os_page - 1], 0, "Pages above the snapshot were not released!");
+	sf_free(x);
+}
+
+Test(sfmm_student_suite, stats_counters, .timeout = TEST_TIMEOUT) {
+	struct sf_stats stats;
+	int i;
+	uint64_t searches = 0, free_blocks = 0;
+
+	sf_get_stats(&stats);
+	cr_assert_eq(stats.mallocs, 0, "Statistics are not 0 before the heap is initialized!");
+	cr_assert_eq(stats.heap_bytes, 0, "Statistics are not 0 before the heap is initialized!");
+
+	void *x = sf_malloc(100);
+	void *y = sf_malloc(100);
+	sf_free(x);
+	void *z = sf_malloc(100);
+	cr_assert_eq(z, x, "Block was not taken from the quick list!");
+
+	sf_get_stats(&stats);
+	cr_assert_eq(stats.mallocs, 3, "Wrong number of mallocs (%lu)!", stats.mallocs);
+	cr_assert_eq(stats.frees, 1, "Wrong number of frees (%lu)!", stats.frees);
+	cr_assert_eq(stats.quick_hits[5], 1, "Wrong number of quick list hits!");
+	cr_assert_eq(stats.quick_misses[5], 2, "Wrong number of quick list misses!");
+	cr_assert_eq(stats.splits, 2, "Wrong number of splits (%lu)!", stats.splits);
+	cr_assert_eq(stats.grows, 1, "Wrong number of grows (%lu)!", stats.grows);
+	cr_assert_eq(stats.payload_bytes, 200, "Wrong payload bytes (%lu)!", stats.payload_bytes);
+	cr_assert_eq(stats.allocated_bytes, 224, "Wrong allocated bytes (%lu)!", stats.allocated_bytes);
+	cr_assert_eq(stats.peak_payload_bytes, 200, "Wrong peak payload bytes!");
+	cr_assert_eq(stats.heap_bytes, PAGE_SZ, "Wrong heap bytes (%lu)!", stats.heap_bytes);
+	for(i = 0; i < NUM_FREE_LISTS; i++) {
+		searches += stats.searches[i];
+		free_blocks += stats.free_blocks[i];
+	}
+	cr_assert_eq(searches, 2, "Wrong number of free list searches (%lu)!", searches);
+	cr_assert_eq(free_blocks, 1, "Wrong number of free blocks (%lu)!", free_blocks);
+	cr_assert_eq(stats.largest_free_block, 752, "Wrong largest free block (%lu)!", stats.largest_free_block);
+
+	sf_free(y);
+	sf_free(z);
+	sf_get_stats(&stats);
+	cr_assert_eq(stats.quick_bytes[5], 224, "Wrong quick list bytes (%lu)!", stats.quick_bytes[5]);
+	cr_assert_eq(stats.payload_bytes, 0, "Wrong payload bytes (%lu)!", stats.payload_bytes);
+	cr_assert(sf_errno == 0, "sf_errno is not 0!");
+}
+
+Test(sfmm_student_suite, latency_histograms, .timeout = TEST_TIMEOUT) {
+	struct sf_latency_stats lat;
+	int i;
+
+	sf_reset_latency();
+	for(i = 0; i < 100; i++) {
+		void *x = sf_malloc(100);
+		void *y = sf_malloc(3000);
+		sf_free(x);
+		sf_free(y);
+	}
+
+	cr_assert_eq(sf_get_latency(SF_LATENCY_MALLOC, SF_LATENCY_ALL_CLASSES, &lat), 0, "sf_get_latency failed!");
+#ifdef SF_LATENCY
+	cr_assert_eq(lat.count, 200, "Wrong number of timed mallocs (%lu)!", lat.count);
+	cr_assert(lat.min_ns <= lat.p50_ns && lat.p50_ns <= lat.p90_ns && lat.p90_ns <= lat.p99_ns
+		&& lat.p99_ns <= lat.p999_ns && lat.p999_ns <= lat.max_ns, "Percentiles are out of order!");
+	cr_assert(lat.min_ns <= lat.mean_ns && lat.mean_ns <= lat.max_ns, "Mean is out of range!");
+	cr_assert_eq(sf_get_latency(SF_LATENCY_MALLOC, 2, &lat), 0, "sf_get_latency failed!");
+	cr_assert_eq(lat.count, 100, "Wrong number of timed mallocs in class 2 (%lu)!", lat.count);
+	cr_assert_eq(sf_get_latency(SF_LATENCY_FREE, 7, &lat), 0, "sf_get_latency failed!");
+	cr_assert_eq(lat.count, 100, "Wrong number of timed frees in class 7 (%lu)!", lat.count);
+#else
+	cr_assert_eq(lat.count, 0, "Calls were timed without SF_LATENCY!");
+#endif
+
+	cr_assert_eq(sf_get_latency(SF_LATENCY_NUM_OPS, 0, &lat), -1, "Bad operation was accepted!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+}
+
+Test(sfmm_student_suite, trace_events, .timeout = TEST_TIMEOUT) {
+	char path[] = "/tmp/sfmm_trace_XXXXXX";
+	int fd = mkstemp(path);
+	cr_assert(fd != -1, "mkstemp failed!");
+	close(fd);
+
+#ifdef SF_TRACE
+	cr_assert_eq(sf_trace_start(path, 0), 0, "sf_trace_start failed!");
+	void *x = sf_malloc(100);
+	void *y = sf_realloc(x, 500);
+	sf_free(y);
+	cr_assert_eq(sf_trace_stop(), 0, "sf_trace_stop failed!");
+	cr_assert_eq(sf_trace_dropped(), 0, "Events were dropped!");
+
+	sf_trace_header header;
+	sf_trace_event events[4];
+	fd = open(path, O_RDONLY);
+	cr_assert(read(fd, &header, sizeof(header)) == sizeof(header), "Header is missing!");
+	cr_assert(header.magic == SF_TRACE_MAGIC, "Bad trace magic!");
+	cr_assert(header.event_size == sizeof(sf_trace_event), "Bad event size!");
+	cr_assert(read(fd, events, sizeof(events)) == 3 * sizeof(sf_trace_event), "Wrong number of events!");
+	close(fd);
+
+	cr_assert(events[0].op == SF_TRACE_MALLOC && events[0].ptr == (uintptr_t)x && events[0].size == 100,
+		"Bad malloc event!");
+	cr_assert(events[1].op == SF_TRACE_REALLOC && events[1].ptr == (uintptr_t)y && events[1].old_ptr == (uintptr_t)x
+		&& events[1].size == 500, "Bad realloc event!");
+	cr_assert(events[2].op == SF_TRACE_FREE && events[2].ptr == (uintptr_t)y, "Bad free event!");
+	cr_assert(events[0].tid == events[2].tid && events[0].ticks <= events[2].ticks, "Bad thread id or timestamp!");
+#else
+	cr_assert_eq(sf_trace_start(path, 0), -1, "Tracing started without SF_TRACE!");
+	cr_assert(sf_errno == ENOSYS, "sf_errno is not ENOSYS!");
+#endif
+	unlink(path);
+}
+
+Test(sfmm_student_suite, trace_memalign, .timeout = TEST_TIMEOUT) {
+	char path[] = "/tmp/sfmm_trace_XXXXXX";
+	int fd = mkstemp(path);
+	cr_assert(fd != -1, "mkstemp failed!");
+	close(fd);
+
+#ifdef SF_TRACE
+	/* One event for the aligned block, not one for the larger block it was cut from. */
+	void *x = sf_malloc(8);
+	cr_assert_eq(sf_trace_start(path, 0), 0, "sf_trace_start failed!");
+	void *m = sf_memalign(256, 100);
+	sf_free(m);
+	cr_assert_eq(sf_trace_stop(), 0, "sf_trace_stop failed!");
+	sf_free(x);
+
+	sf_trace_header header;
+	sf_trace_event events[3];
+	fd = open(path, O_RDONLY);
+	cr_assert(read(fd, &header, sizeof(header)) == sizeof(header), "Header is missing!");
+	cr_assert(read(fd, events, sizeof(events)) == 2 * sizeof(sf_trace_event), "Wrong number of events!");
+	close(fd);
+	cr_assert(events[0].op == SF_TRACE_MALLOC && events[0].ptr == (uintptr_t)m && events[0].size == 100,
+		"Bad memalign event!");
+	cr_assert(events[1].op == SF_TRACE_FREE && events[1].ptr == (uintptr_t)m, "Bad free event!");
+#else
+	cr_assert_eq(sf_trace_start(path, 0), -1, "Tracing started without SF_TRACE!");
+#endif
+	unlink(path);
+}
+
+Test(sfmm_student_suite, trace_hinted, .timeout = TEST_TIMEOUT) {
+	char path[] = "/tmp/sfmm_trace_XXXXXX";
+	int fd = mkstemp(path);
+	cr_assert(fd != -1, "mkstemp failed!");
+	close(fd);
+
+#ifdef SF_TRACE
+	/* Calls on hinted blocks are passed on to the sub-heap, and still recorded once. */
+	cr_assert_eq(sf_trace_start(path, 0), 0, "sf_trace_start failed!");
+	void *b = sf_malloc_hint(40, SF_HINT_LONG);
+	void *c = sf_realloc(b, 4000);
+	sf_free(c);
+	cr_assert_eq(sf_trace_stop(), 0, "sf_trace_stop failed!");
+
+	sf_trace_header header;
+	sf_trace_event events[4];
+	fd = open(path, O_RDONLY);
+	cr_assert(read(fd, &header, sizeof(header)) == sizeof(header), "Header is missing!");
+	cr_assert(read(fd, events, sizeof(events)) == 3 * sizeof(sf_trace_event), "Wrong number of events!");
+	close(fd);
+	cr_assert(events[0].op == SF_TRACE_MALLOC && events[0].ptr == (uintptr_t)b, "Bad malloc event!");
+	cr_assert(events[1].op == SF_TRACE_REALLOC && events[1].ptr == (uintptr_t)c && events[1].old_ptr == (uintptr_t)b,
+		"Bad realloc event!");
+	cr_assert(events[2].op == SF_TRACE_FREE && events[2].ptr == (uintptr_t)c, "Bad free event!");
+#else
+	cr_assert_eq(sf_trace_start(path, 0), -1, "Tracing started without SF_TRACE!");
+#endif
+	unlink(path);
+}
+
+Test(sfmm_student_suite, trace_pinned_tag, .timeout = TEST_TIMEOUT) {
+	char path[] = "/tmp/sfmm_trace_XXXXXX";
+	int fd = mkstemp(path);
+	cr_assert(fd != -1, "mkstemp failed!");
+	close(fd);
+
+#ifdef SF_TRACE
+	/* As for hinted blocks: the sub-heap of a pinned tag does not record calls again. */
+	cr_assert_eq(sf_tag_pin(3, true), 0, "sf_tag_pin failed!");
+	cr_assert_eq(sf_trace_start(path, 0), 0, "sf_trace_start failed!");
+	void *b = sf_malloc_tagged(40, 3);
+	void *c = sf_realloc(b, 4000);
+	sf_free(c);
+	cr_assert_eq(sf_trace_stop(), 0, "sf_trace_stop failed!");
+
+	sf_trace_header header;
+	sf_trace_event events[4];
+	fd = open(path, O_RDONLY);
+	cr_assert(read(fd, &header, sizeof(header)) == sizeof(header), "Header is missing!");
+	cr_assert(read(fd, events, sizeof(events)) == 3 * sizeof(sf_trace_event), "Wrong number of events!");
+	close(fd);
+	cr_assert(events[0].op == SF_TRACE_MALLOC && events[0].ptr == (uintptr_t)b, "Bad malloc event!");
+	cr_assert(events[1].op == SF_TRACE_REALLOC && events[1].ptr == (uintptr_t)c && events[1].old_ptr == (uintptr_t)b,
+		"Bad realloc event!");
+	cr_assert(events[2].op == SF_TRACE_FREE && events[2].ptr == (uintptr_t)c, "Bad free event!");
+#else
+	cr_assert_eq(sf_trace_start(path, 0), -1, "Tracing started without SF_TRACE!");
+#endif
+	unlink(path);
+}
+
+Test(sfmm_student_suite, trace_pause, .timeout = TEST_TIMEOUT) {
+	char path[] = "/tmp/sfmm_trace_XXXXXX";
+	int fd = mkstemp(path);
+	cr_assert(fd != -1, "mkstemp failed!");
+	close(fd);
+
+#ifdef SF_TRACE
+	/* With the writer held, an 8-event ring keeps the first 8 events and drops the rest;
+	   sf_trace_stop() still writes the 8. */
+	cr_assert_eq(sf_trace_start(path, 8), 0, "sf_trace_start failed!");
+	sf_trace_pause(true);
+	int i;
+	for(i = 0; i < 10; i++)
+		sf_trace_record(SF_TRACE_MALLOC, NULL, NULL, i);
+	cr_assert_eq(sf_trace_dropped(), 2, "Full ring did not drop!");
+	cr_assert_eq(sf_trace_stop(), 0, "sf_trace_stop failed!");
+
+	sf_trace_header header;
+	sf_trace_event events[10];
+	fd = open(path, O_RDONLY);
+	cr_assert(read(fd, &header, sizeof(header)) == sizeof(header), "Header is missing!");
+	cr_assert(read(fd, events, sizeof(events)) == 8 * sizeof(sf_trace_event), "Wrong number of events!");
+	close(fd);
+	cr_assert(events[0].size == 0 && events[7].size == 7, "Wrong events kept!");
+#else
+	sf_trace_pause(true);
+	sf_trace_pause(false);
+	cr_assert_eq(sf_trace_start(path, 8), -1, "Tracing started without SF_TRACE!");
+#endif
+	unlink(path);
+}
+
+Test(sfmm_student_suite, malloc_no_splinter, .timeout = TEST_TIMEOUT) {
+	/* Leave a 48-byte free block in a free list: too big for 32 bytes without a splinter. */
+	void *x = sf_malloc(200);
+	void *y = sf_malloc(10);
+	cr_assert_eq(sf_realloc(x, 150), x, "Shrinking realloc moved the block!");
+	void *z = sf_malloc(11);
+
+	cr_assert_eq(z, (char *)x + 160, "Block was not taken from the free list!");
+	assert_block_header(z, 11, 48, 1, 1, 0);
+	assert_free_block_count(0, 1);
+	sf_free(y);
+	sf_free(z);
+	cr_assert(sf_errno == 0, "sf_errno is not 0!");
+}
+
+Test(sfmm_student_suite, arena_utilization, .timeout = TEST_TIMEOUT) {
+	sf_arena *arena = sf_arena_create(64 * PAGE_SZ);
+	cr_assert_not_null(arena, "Arena creation failed!");
+
+	void *x = sf_arena_malloc(arena, 100);
+	cr_assert(sf_arena_internal_fragmentation(arena) == 100.0 / 112.0, "Wrong internal fragmentation!");
+	cr_assert(sf_arena_peak_utilization(arena) == 100.0 / PAGE_SZ, "Wrong peak utilization!");
+	cr_assert(sf_internal_fragmentation() == 0, "Arena statistics leaked into the main heap!");
+	sf_arena_free(arena, x);
+	sf_arena_destroy(arena);
+}
+
+Test(sfmm_student_suite, heap_map_frag, .timeout = TEST_TIMEOUT) {
+	void *x = sf_malloc(100);
+	void *y = sf_malloc(200);
+	void *z = sf_malloc(100);
+	void *w = sf_malloc(10);
+	sf_free(x);
+	sf_free(y);
+	sf_free(z);
+
+	/* x and z go to quick lists, y to a free list, w splits off the wilderness. */
+	sf_heap_map_entry entries[8];
+	cr_assert_eq(sf_heap_map(entries, 8), 5, "Wrong number of blocks!");
+	cr_assert(entries[0].state == SF_BLOCK_QUICK && entries[0].size == 112, "Bad entry for x!");
+	cr_assert(entries[1].state == SF_BLOCK_FREE && entries[1].size == 208, "Bad entry for y!");
+	cr_assert(entries[2].state == SF_BLOCK_QUICK && entries[2].size == 112, "Bad entry for z!");
+	cr_assert(entries[3].state == SF_BLOCK_ALLOC && entries[3].size == 32 && entries[3].payload == 10,
+		"Bad entry for w!");
+	cr_assert(entries[3].offset == (uint64_t)((char *)w - 16 - (char *)sf_mem_start()), "Bad offset for w!");
+	cr_assert(entries[4].state == SF_BLOCK_FREE && entries[4].size == 512, "Bad entry for the wilderness!");
+
+	struct sf_frag_report report;
+	cr_assert_eq(sf_heap_frag(&report), 0, "sf_heap_frag failed!");
+	cr_assert_eq(report.heap_bytes, 976, "Wrong heap bytes!");
+	cr_assert_eq(report.alloc_blocks, 1, "Wrong number of allocated blocks!");
+	cr_assert_eq(report.quick_blocks, 2, "Wrong number of quick list blocks!");
+	cr_assert_eq(report.total_free_bytes, 944, "Wrong free bytes!");
+	cr_assert_eq(report.largest_free_block, 512, "Wrong largest free block!");
+	cr_assert_eq(report.largest_gap, 512, "Wrong largest gap!");
+	cr_assert(report.gaps[8] == 1 && report.gaps[9] == 1, "Wrong gap histogram!");
+	cr_assert(report.external_fragmentation == 1.0 - 512.0 / 944.0, "Wrong external fragmentation!");
+
+	char path[] = "/tmp/sfmm_heapmapXXXXXX";
+	int fd = mkstemp(path);
+	cr_assert(fd != -1, "mkstemp failed!");
+	cr_assert_eq(sf_heap_map_write(fd), 0, "sf_heap_map_write failed!");
+	lseek(fd, 0, SEEK_SET);
+	sf_heap_map_header header;
+	cr_assert(read(fd, &header, sizeof(header)) == sizeof(header), "Header is missing!");
+	cr_assert(header.magic == SF_HEAP_MAP_MAGIC && header.nblocks == 5, "Bad heap map header!");
+	cr_assert(read(fd, entries, sizeof(entries)) == 5 * sizeof(sf_heap_map_entry), "Wrong number of entries!");
+	cr_assert(entries[1].state == SF_BLOCK_FREE && entries[1].size == 208, "Bad entry in the file!");
+	close(fd);
+	unlink(path);
+	sf_free(w);
+}
+
+Test(sfmm_student_suite, memalign, .timeout = TEST_TIMEOUT) {
+	void *x = sf_malloc(10);
+	void *y = sf_memalign(256, 100);
+	cr_assert_not_null(y, "sf_memalign returned NULL!");
+	cr_assert(((uintptr_t)y & 255) == 0, "Payload is not aligned!");
+	cr_assert_eq(sf_usable_size(y), 100, "Wrong usable size!");
+
+	/* Where the padding goes depends on the heap address: the block behind the payload
+	   is only split off if it is not a splinter, and the block in front of it is only
+	   split off if y did not land aligned, right behind x. */
+	sf_header header = ((sf_block *)((char *)y - 16))->header ^ MAGIC;
+	sf_size_t bsize = header & 0xfffffff0;
+	sf_header prev_alloc = ((char *)y == (char *)x + 32) ? 0x2 : 0x0;
+	cr_assert(bsize == 112 || bsize == 128, "Wrong block size %u!", bsize);
+	cr_assert((header & 0x7) == (0x4 | prev_alloc), "Wrong alloc, prev_alloc or qklst bit!");
+
+	/* The space in front of y and behind it went back to the free lists. */
+	struct sf_stats stats;
+	sf_get_stats(&stats);
+	cr_assert_eq(stats.payload_bytes, 110, "Wrong payload bytes!");
+	cr_assert_eq(stats.allocated_bytes, 32 + bsize, "Wrong allocated bytes!");
+	cr_assert_eq(stats.peak_payload_bytes, 110, "Peak counted the padding!");
+
+	sf_free(y);
+	sf_free(x);
+	cr_assert_null(sf_memalign(48, 100), "Alignment that is not a power of two was accepted!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+}
+
+Test(sfmm_student_suite, free_sized, .timeout = TEST_TIMEOUT) {
+	void *x = sf_malloc(100);
+	void *y = sf_malloc(200);
+	sf_free_sized(x, 100);
+	sf_free_sized(y, 200);
+
+	struct sf_stats stats;
+	sf_get_stats(&stats);
+	cr_assert_eq(stats.frees, 2, "Wrong number of frees!");
+	cr_assert_eq(stats.payload_bytes, 0, "Blocks were not freed!");
+}
+
+Test(sfmm_student_suite, free_sized_mismatch, .timeout = TEST_TIMEOUT, .signal = SIGABRT) {
+	void *x = sf_malloc(100);
+	sf_free_sized(x, 101);
+}
+
+Test(sfmm_student_suite, fit_policy, .timeout = TEST_TIMEOUT) {
+	/* Free a 288-byte and then a 480-byte block of the same class, so the 480-byte
+	   block is first in the list. */
+	void *a = sf_malloc(472);
+	void *g1 = sf_malloc(10);
+	void *b = sf_malloc(280);
+	void *g2 = sf_malloc(10);
+	sf_free(b);
+	sf_free(a);
+
+	/* Good fit comparing a single fit is first fit. */
+	cr_assert_eq(sf_set_fit_policy(SF_FIT_GOOD, 1), 0, "sf_set_fit_policy failed!");
+	void *x = sf_malloc(264);
+	cr_assert_eq(x, a, "Good fit did not take the first block!");
+	sf_free(x);
+
+	/* a went back to the front of the list. */
+	cr_assert_eq(sf_set_fit_policy(SF_FIT_BEST, 0), 0, "sf_set_fit_policy failed!");
+	x = sf_malloc(264);
+	cr_assert_eq(x, b, "Best fit did not take the tightest block!");
+
+	cr_assert_eq(sf_set_fit_policy(7, 0), -1, "Unknown policy was accepted!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+	cr_assert_eq(sf_get_fit_policy(), SF_FIT_BEST, "Policy changed!");
+	sf_set_fit_policy(SF_FIT_FIRST, 0);
+	sf_free(x);
+	sf_free(g1);
+	sf_free(g2);
+}
+
+Test(sfmm_student_suite, frlst_order, .timeout = TEST_TIMEOUT) {
+	/* Free the lower block first, so it is second in a LIFO list. */
+	void *a = sf_malloc(472);
+	void *g1 = sf_malloc(10);
+	void *b = sf_malloc(280);
+	void *g2 = sf_malloc(10);
+	sf_free(a);
+	sf_free(b);
+
+	/* Switching the order sorts the lists as they are. */
+	cr_assert_eq(sf_set_frlst_order(SF_ORDER_ADDRESS), 0, "sf_set_frlst_order failed!");
+	cr_assert_eq(sf_get_frlst_order(), SF_ORDER_ADDRESS, "Order not set!");
+	void *x = sf_malloc(264);
+	cr_assert_eq(x, a, "First fit did not take the lowest block!");
+
+	/* A freed block goes back in front of the higher one. */
+	sf_free(x);
+	x = sf_malloc(264);
+	cr_assert_eq(x, a, "Freed block was not inserted in address order!");
+
+	cr_assert_eq(sf_set_frlst_order(5), -1, "Unknown order was accepted!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+	cr_assert_eq(sf_set_frlst_order(SF_ORDER_LIFO), 0, "sf_set_frlst_order failed!");
+	sf_free(x);
+	sf_free(g1);
+	sf_free(g2);
+}
+
+Test(sfmm_student_suite, frlst_order_arena, .timeout = TEST_TIMEOUT) {
+	sf_arena *arena = sf_arena_create(1 << 20);
+	cr_assert_not_null(arena, "sf_arena_create failed!");
+	cr_assert_eq(sf_arena_set_frlst_order(arena, SF_ORDER_ADDRESS), 0, "sf_arena_set_frlst_order failed!");
+
+	/* Free every other block, in scrambled order, so none of them coalesce. */
+	void *p[256];
+	int i;
+	for(i = 0; i < 256; i++)
+		p[i] = sf_arena_malloc(arena, 200);
+	for(i = 0; i < 128; i++)
+		sf_arena_free(arena, p[2 * ((i * 37) % 128)]);
+
+	/* First fit now hands them out from the bottom of the heap up. */
+	for(i = 0; i < 128; i++)
+		cr_assert_eq(sf_arena_malloc(arena, 200), p[2 * i], "Block %d is out of address order!", i);
+	sf_arena_destroy(arena);
+}
+
+Test(sfmm_student_suite, wilderness, .timeout = TEST_TIMEOUT) {
+	sf_set_wilderness(true);
+	cr_assert(sf_get_wilderness(), "Wilderness mode is not on!");
+
+	/* [x 720][g 32][top 224]: the top is in a smaller class than x. */
+	void *x = sf_malloc(700);
+	void *g = sf_malloc(10);
+	sf_free(x);
+
+	/* The top block is only used when nothing else fits. */
+	void *y = sf_malloc(100);
+	cr_assert_eq(y, x, "Small request was carved from the wilderness!");
+
+	/* Growing the heap extends the top block without coalescing. */
+	struct sf_stats before, after;
+	sf_get_stats(&before);
+	void *z = sf_malloc(2000);
+	sf_get_stats(&after);
+	cr_assert_eq(z, (char *)g + 32, "Large request was not carved from the wilderness!");
+	cr_assert(after.grows > before.grows, "Heap did not grow!");
+	cr_assert_eq(after.coalesces, before.coalesces, "Growing the wilderness coalesced!");
+
+	/* Freeing the last block gives the wilderness back, counted as a free block. */
+	sf_free(z);
+	sf_get_stats(&after);
+	cr_assert_eq(after.largest_free_block, (uint64_t)(after.heap_bytes - 32 - 720 - 32 - 16),
+		"Wilderness is not the largest free block!");
+
+	/* Turning the mode off puts the top block back on its free list. */
+	sf_set_wilderness(false);
+	void *w = sf_malloc(1000);
+	cr_assert_eq(w, z, "Top block is not on the free lists!");
+	sf_free(w);
+	sf_free(y);
+	sf_free(g);
+}
+
+Test(sfmm_student_suite, split_threshold, .timeout = TEST_TIMEOUT) {
+	sf_set_split_threshold(512);
+	cr_assert_eq(sf_get_split_threshold(), 512, "Split threshold not set!");
+
+	/* A large request takes the top of the initial 976-byte block, a small one the bottom. */
+	char *start = sf_mem_start();
+	void *a = sf_malloc(700);
+	void *b = sf_malloc(100);
+	cr_assert_eq(a, start + 32 + 256 + 16, "Large request was not split off the top!");
+	cr_assert_eq(b, start + 32 + 16, "Small request was not split off the bottom!");
+
+	struct sf_stats stats;
+	sf_get_stats(&stats);
+	cr_assert_eq(stats.high_splits, 1, "Wrong number of upper splits!");
+	cr_assert_eq(stats.free_bytes[3], 144, "Lower remainder is not free!");
+
+	sf_set_split_threshold(0);
+	sf_free(a);
+	sf_free(b);
+}
+
+Test(sfmm_student_suite, grow_policy, .timeout = TEST_TIMEOUT) {
+	struct sf_grow_policy bad = { SF_GROW_GEOMETRIC, 4, 2 };
+	cr_assert_eq(sf_set_grow_policy(&bad), -1, "Bad policy was accepted!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+
+	/* Growths of 1, 2, 4, 8, 8, ... pages. */
+	struct sf_grow_policy geometric = { SF_GROW_GEOMETRIC, 1, 8 };
+	cr_assert_eq(sf_set_grow_policy(&geometric), 0, "sf_set_grow_policy failed!");
+	sf_arena *arena = sf_arena_create(1 << 20);
+	cr_assert_not_null(arena, "sf_arena_create failed!");
+	int i;
+	for(i = 0; i < 20; i++)
+		cr_assert_not_null(sf_arena_malloc(arena, 1000), "sf_arena_malloc failed!");
+
+	struct sf_stats stats;
+	sf_arena_get_stats(arena, &stats);
+	cr_assert_eq(stats.grows, 5, "Wrong number of growths!");
+	cr_assert_eq(stats.grow_bytes, 23 * PAGE_SZ, "Wrong number of bytes grown!");
+	cr_assert_eq(stats.heap_bytes, stats.grow_bytes, "Heap size does not match the growths!");
+
+	struct sf_grow_policy fixed = { SF_GROW_FIXED, 1, 1 };
+	sf_set_grow_policy(&fixed);
+	sf_arena_destroy(arena);
+}
+
+Test(sfmm_student_suite, malloc_hint, .timeout = TEST_TIMEOUT) {
+	void *a = sf_malloc_hint(100, SF_HINT_SHORT);
+	void *b = sf_malloc_hint(100, SF_HINT_LONG);
+	void *c = sf_malloc_hint(100, SF_HINT_NONE);
+	cr_assert(a != NULL && b != NULL && c != NULL, "sf_malloc_hint failed!");
+
+	/* Each lifetime group has a sub-heap of its own, apart from the heap. */
+	sf_arena *short_heap = sf_hint_owner(a);
+	cr_assert_not_null(short_heap, "Short-lived block is not in a sub-heap!");
+	cr_assert_not_null(sf_hint_owner(b), "Long-lived block is not in a sub-heap!");
+	cr_assert(sf_hint_owner(b) != short_heap, "Lifetime groups share a sub-heap!");
+	cr_assert_null(sf_hint_owner(c), "Unhinted block is in a sub-heap!");
+
+	/* realloc keeps a block in its group. */
+	a = sf_realloc(a, 2000);
+	cr_assert_eq(sf_hint_owner(a), short_heap, "realloc moved the block out of its group!");
+
+	struct sf_stats stats;
+	sf_free(a);
+	sf_free(b);
+	sf_free(c);
+	sf_hint_get_stats(SF_HINT_SHORT, &stats);
+	cr_assert_eq(stats.payload_bytes, 0, "Short-lived block was not freed in its sub-heap!");
+	sf_hint_get_stats(SF_HINT_LONG, &stats);
+	cr_assert_eq(stats.payload_bytes, 0, "Long-lived block was not freed in its sub-heap!");
+	sf_get_stats(&stats);
+	cr_assert_eq(stats.mallocs, 1, "Hinted blocks were counted in the heap!");
+
+	cr_assert_null(sf_malloc_hint(100, 3), "Unknown hint was accepted!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+}
+
+Test(sfmm_student_suite, malloc_tagged, .timeout = TEST_TIMEOUT) {
+	void *a = sf_malloc_tagged(100, 7);
+	void *b = sf_malloc_tagged(40, 7);
+	void *c = sf_malloc(100);
+	cr_assert(a != NULL && b != NULL && c != NULL, "sf_malloc_tagged failed!");
+	cr_assert_eq(sf_tag_of(a), 7, "Block has the wrong tag!");
+	cr_assert_eq(sf_tag_of(c), -1, "Untagged block has a tag!");
+
+	/* The tag is kept beside the heap, so the blocks are as large as untagged ones. */
+	cr_assert_eq(sf_usable_size(a), sf_usable_size(c), "Tagged block has a different size!");
+
+	struct sf_tag_stats stats;
+	sf_tag_get_stats(7, &stats);
+	cr_assert_eq(stats.mallocs, 2, "Wrong number of tagged mallocs!");
+	cr_assert_eq(stats.payload_bytes, 140, "Wrong live payload for the tag!");
+	cr_assert_eq(stats.allocated_bytes, 112 + 48, "Wrong live size for the tag!");
+	cr_assert(stats.internal_fragmentation > 0.12 && stats.internal_fragmentation < 0.13,
+		"Wrong internal fragmentation for the tag!");
+
+	/* realloc keeps the tag, wherever the block ends up. */
+	a = sf_realloc(a, 1000);
+	cr_assert_eq(sf_tag_of(a), 7, "realloc lost the tag!");
+	sf_free(a);
+	sf_free(c);
+	sf_tag_get_stats(7, &stats);
+	cr_assert_eq(stats.payload_bytes, 40, "Freed block is still counted!");
+	cr_assert_eq(stats.frees, 1, "Wrong number of tagged frees!");
+	cr_assert_eq(stats.total_bytes, 1040, "Wrong number of bytes allocated for the tag!");
+
+	cr_assert_null(sf_malloc_tagged(100, SF_NUM_TAGS), "Tag out of range was accepted!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+}
+
+Test(sfmm_student_suite, tag_pin, .timeout = TEST_TIMEOUT) {
+	void *x = sf_malloc_tagged(100, 3);
+	cr_assert_eq(sf_tag_pin(3, true), 0, "sf_tag_pin failed!");
+	void *a = sf_malloc_tagged(100, 3);
+	void *b = sf_malloc_tagged(100, 3);
+	void *c = sf_malloc_tagged(100, 4);
+	cr_assert(a != NULL && b != NULL && c != NULL, "sf_malloc_tagged failed!");
+
+	/* A pinned tag has a sub-heap of its own, where its blocks sit side by side. */
+	sf_arena *tag_heap = sf_tag_owner(a);
+	cr_assert_not_null(tag_heap, "Pinned block is not in a sub-heap!");
+	cr_assert_eq(sf_tag_owner(b), tag_heap, "Pinned blocks are in different sub-heaps!");
+	cr_assert_eq((char *)b - (char *)a, 112, "Pinned blocks are not adjacent!");
+	cr_assert_null(sf_tag_owner(c), "Block of another tag is in the sub-heap!");
+	cr_assert_null(sf_tag_owner(x), "Block allocated before pinning moved!");
+	cr_assert_eq(sf_tag_of(a), 3, "Pinned block has the wrong tag!");
+
+	/* The sub-heap counts with the tag, and is freed through the heap. */
+	struct sf_tag_stats stats;
+	sf_tag_get_stats(3, &stats);
+	cr_assert(stats.pinned, "Tag is not reported pinned!");
+	cr_assert_eq(stats.mallocs, 3, "Wrong number of tagged mallocs!");
+	a = sf_realloc(a, 500);
+	cr_assert_eq(sf_tag_owner(a), tag_heap, "realloc moved the block out of the sub-heap!");
+	sf_free(a);
+	sf_free(b);
+	sf_free(x);
+	sf_tag_get_stats(3, &stats);
+	cr_assert_eq(stats.payload_bytes, 0, "Pinned blocks are still counted!");
+	cr_assert_eq(stats.frees, 3, "Wrong number of tagged frees!");
+
+	/* After unpinning, new blocks go back to the heap. */
+	cr_assert_eq(sf_tag_pin(3, false), 0, "sf_tag_pin failed!");
+	void *d = sf_malloc_tagged(100, 3);
+	cr_assert_null(sf_tag_owner(d), "Block of an unpinned tag is in the sub-heap!");
+	sf_free(c);
+	sf_free(d);
+}
@@ -0,0 +1,449 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "sfmm.h"
+#include "sfarena.h"
+#include "sfpage.h"
+#include "sfstats.h"
+#include "sftrace.h"
+
+/*
+ * sfmm_bench: allocator microbenchmarks.
+ *
+ * Usage: sfmm_bench [-s scale] [-f filter]
+ *        sfmm_bench -c base.json new.json
+ *
+ * Every scenario runs in a fresh arena, so scenarios do not see each other's heaps.
+ * The results are written to stdout as JSON: for each scenario, the number of
+ * allocator calls, the time per call, sf_peak_utilization(), and the heap size and
+ * number of heap growths when the scenario ends.  scale multiplies the iteration counts (default 1); filter
+ * runs only the scenarios whose name contains it.
+ *
+ * The timed part of each scenario also counts the dTLB load misses of the process with
+ * perf_event_open() (user space only), reported as dtlb_misses, or -1 if the system does
+ * not give access to the counter.  The scatter scenarios, run with and without huge pages,
+ * touch a heap of about 128 MB at random to show the effect of sf_set_huge_pages().
+ *
+ * The trace_record scenario times sf_trace_record() alone, into a ring large enough for
+ * every event, with the background writer held by sf_trace_pause() so that it does not
+ * take the CPU from the caller.  It only runs in a `make trace` build and reports 0 ops
+ * otherwise.
+ *
+ * Automatic trimming is turned off, so the heap never shrinks and sf_peak_utilization()
+ * is measured against the largest heap the scenario needed.
+ *
+ * With -c, nothing is run: two result files written by earlier runs are compared,
+ * scenario by scenario, and the change in ns/op is printed.  `make pgo` uses this to
+ * report the profile-guided build against the plain release build.
+ */
+
+#define BENCH_ARENA_CAPACITY ((size_t)1 << 30)
+
+/* Largest growth, in pages, for the scenarios with a geometric or rate growth policy. */
+#define BENCH_GROW_MAX_PAGES 4096
+
+typedef struct bench_result {
+	uint64_t ops;
+	double seconds;
+	int64_t dtlb_misses;			// -1 if the counter is not available.
+} bench_result;
+
+typedef void (*bench_fn)(sf_arena *arena, size_t arg, size_t scale, bench_result *r);
+
+typedef struct bench_scenario {
+	const char *name;
+	bench_fn fn;
+	size_t arg;
+	bool huge_pages;
+	int grow;				// Growth policy kind, SF_GROW_FIXED if not given.
+} bench_scenario;
+
+static double bench_now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* dTLB load miss counter of the process, -1 if it could not be opened. */
+static int dtlb_fd = -1;
+
+static int bench_dtlb_open(){
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+		| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* Start and stop the clock and the dTLB miss counter around the timed part of a scenario. */
+static double bench_started;
+static void bench_start(bench_result *r){
+	if(dtlb_fd != -1)
+	{
+		ioctl(dtlb_fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(dtlb_fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	bench_started = bench_now();
+	return;
+}
+static void bench_stop(bench_result *r){
+	r->seconds = bench_now() - bench_started;
+	r->dtlb_misses = -1;
+	if(dtlb_fd != -1)
+	{
+		uint64_t count;
+		ioctl(dtlb_fd, PERF_EVENT_IOC_DISABLE, 0);
+		if(read(dtlb_fd, &count, sizeof(count)) == (ssize_t)sizeof(count))
+			r->dtlb_misses = (int64_t)count;
+	}
+	return;
+}
+
+/* xorshift64, so runs are repeatable. */
+static uint64_t bench_rand(uint64_t *state){
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*state = x;
+	return x;
+}
+
+static void *bench_malloc(sf_arena *arena, size_t size){
+	void *pp = sf_arena_malloc(arena, (sf_size_t)size);
+	if(pp == NULL)
+	{
+		fprintf(stderr, "sfmm_bench: out of memory allocating %zu bytes\n", size);
+		exit(EXIT_FAILURE);
+	}
+	return pp;
+}
+
+/* Allocate and free one block of the given payload size, over and over. */
+static void bench_pingpong(sf_arena *arena, size_t size, size_t scale, bench_result *r){
+	size_t i, n = 200000 * scale;
+	bench_start(r);
+	for(i = 0; i < n; i++)
+		sf_arena_free(arena, bench_malloc(arena, size));
+	bench_stop(r);
+	r->ops = 2 * n;
+	return;
+}
+
+/* Allocate QUICK_LIST_MAX + 1 blocks of each quick list size and free them all, so
+   every round fills a quick list and the last free flushes it. */
+static void bench_quick_overflow(sf_arena *arena, size_t arg, size_t scale, bench_result *r){
+	void *blocks[QUICK_LIST_MAX + 1];
+	size_t i, n = 20000 * scale;
+	int q, b;
+	bench_start(r);
+	for(i = 0; i < n; i++)
+	{
+		for(q = 0; q < NUM_QUICK_LISTS; q++)
+		{
+			size_t size = 32 + 16 * q - 8;
+			for(b = 0; b < QUICK_LIST_MAX + 1; b++)
+				blocks[b] = bench_malloc(arena, size);
+			for(b = 0; b < QUICK_LIST_MAX + 1; b++)
+				sf_arena_free(arena, blocks[b]);
+		}
+	}
+	bench_stop(r);
+	r->ops = (uint64_t)n * NUM_QUICK_LISTS * 2 * (QUICK_LIST_MAX + 1);
+	return;
+}
+
+/* Grow a block from 16 bytes to 64 KB by half its size at a time, then free it. */
+static void bench_realloc_chain(sf_arena *arena, size_t arg, size_t scale, bench_result *r){
+	size_t i, n = 20000 * scale;
+	uint64_t ops = 0;
+	bench_start(r);
+	for(i = 0; i < n; i++)
+	{
+		size_t size = 16;
+		void *pp = bench_malloc(arena, size);
+		while(size < 65536)
+		{
+			size = size + size / 2;
+			pp = sf_arena_realloc(arena, pp, (sf_size_t)size);
+			ops++;
+		}
+		sf_arena_free(arena, pp);
+		ops = ops + 2;
+	}
+	bench_stop(r);
+	r->ops = ops;
+	return;
+}
+
+/* Random sizes (log-uniform up to 4 KB) in a window of 1000 live slots. */
+static void bench_random_stress(sf_arena *arena, size_t arg, size_t scale, bench_result *r){
+	void *slots[1000];
+	uint64_t seed = 0x5eed5eed5eedULL;
+	size_t i, n = 1000000 * scale;
+	memset(slots, 0, sizeof(slots));
+
+	bench_start(r);
+	for(i = 0; i < n; i++)
+	{
+		uint64_t x = bench_rand(&seed);
+		size_t s = (size_t)(x % 1000);
+		if(slots[s] == NULL)
+		{
+			size_t size = ((size_t)1 << ((x >> 16) % 12)) + (size_t)((x >> 32) % 64) + 1;
+			slots[s] = bench_malloc(arena, size);
+		}
+		else
+		{
+			sf_arena_free(arena, slots[s]);
+			slots[s] = NULL;
+		}
+	}
+	bench_stop(r);
+	r->ops = n;
+
+	for(i = 0; i < 1000; i++)
+		if(slots[i] != NULL)
+			sf_arena_free(arena, slots[i]);
+	return;
+}
+
+/* Fill the heap with small blocks and free every other one, leaving many small free
+   blocks in front of the wilderness, then time large allocations. */
+static void bench_large_after_fragmentation(sf_arena *arena, size_t arg, size_t scale, bench_result *r){
+	size_t i, nsmall = 20000, n = 20000 * scale;
+	void **small = malloc(nsmall * sizeof(void *));
+	if(small == NULL)
+		exit(EXIT_FAILURE);
+	for(i = 0; i < nsmall; i++)
+		small[i] = bench_malloc(arena, 200 + 16 * (i % 8));
+	for(i = 0; i < nsmall; i += 2)
+		sf_arena_free(arena, small[i]);
+
+	bench_start(r);
+	for(i = 0; i < n; i++)
+		sf_arena_free(arena, bench_malloc(arena, 8000));
+	bench_stop(r);
+	r->ops = 2 * n;
+
+	for(i = 1; i < nsmall; i += 2)
+		sf_arena_free(arena, small[i]);
+	free(small);
+	return;
+}
+
+/* Allocate 64 KB blocks until the heap has grown by 64 MB. */
+static void bench_multi_page_growth(sf_arena *arena, size_t arg, size_t scale, bench_result *r){
+	size_t i, n = 1024 * scale;
+	bench_start(r);
+	for(i = 0; i < n; i++)
+		bench_malloc(arena, 65536 - 8);
+	bench_stop(r);
+	r->ops = n;
+	return;
+}
+
+/* Keep BENCH_SCATTER_SLOTS blocks of up to 4 KB live (about 128 MB of heap), and replace
+   one at random, writing to it, over and over, so headers and payloads are touched all
+   over the heap. */
+#define BENCH_SCATTER_SLOTS 65536
+static void bench_scatter(sf_arena *arena, size_t arg, size_t scale, bench_result *r){
+	void **slots = malloc(BENCH_SCATTER_SLOTS * sizeof(void *));
+	uint64_t seed = 0x5ca77e5ca77eULL;
+	size_t i, n = 100000 * scale;
+	if(slots == NULL)
+		exit(EXIT_FAILURE);
+	for(i = 0; i < BENCH_SCATTER_SLOTS; i++)
+		slots[i] = bench_malloc(arena, 1 + bench_rand(&seed) % 4096);
+
+	bench_start(r);
+	for(i = 0; i < n; i++)
+	{
+		uint64_t x = bench_rand(&seed);
+		size_t s = (size_t)(x % BENCH_SCATTER_SLOTS);
+		sf_arena_free(arena, slots[s]);
+		slots[s] = bench_malloc(arena, 1 + (size_t)((x >> 32) % 4096));
+		*(char *)slots[s] = (char)x;
+	}
+	bench_stop(r);
+	r->ops = 2 * n;
+
+	for(i = 0; i < BENCH_SCATTER_SLOTS; i++)
+		sf_arena_free(arena, slots[i]);
+	free(slots);
+	return;
+}
+
+/* Record events with the trace writer held; see the comment at the top. */
+static void bench_trace_record(sf_arena *arena, size_t arg, size_t scale, bench_result *r){
+	size_t i, n = 200000 * scale;
+	if(sf_trace_start("/dev/null", n) == -1)
+		return;
+	sf_trace_pause(true);
+
+	bench_start(r);
+	for(i = 0; i < n; i++)
+		sf_trace_record(SF_TRACE_MALLOC, (void *)(uintptr_t)(i * 16), NULL, (sf_size_t)i);
+	bench_stop(r);
+	r->ops = n;
+
+	sf_trace_stop();
+	return;
+}
+
+static bench_scenario scenarios[] = {
+	{"pingpong_32", bench_pingpong, 32 - 8, false},
+	{"pingpong_64", bench_pingpong, 64 - 8, false},
+	{"pingpong_128", bench_pingpong, 128 - 8, false},
+	{"pingpong_256", bench_pingpong, 256 - 8, false},
+	{"pingpong_512", bench_pingpong, 512 - 8, false},
+	{"pingpong_1024", bench_pingpong, 1024 - 8, false},
+	{"pingpong_2048", bench_pingpong, 2048 - 8, false},
+	{"pingpong_4096", bench_pingpong, 4096 - 8, false},
+	{"pingpong_8192", bench_pingpong, 8192 - 8, false},
+	{"pingpong_16384", bench_pingpong, 16384 - 8, false},
+	{"quick_overflow", bench_quick_overflow, 0, false},
+	{"realloc_chain", bench_realloc_chain, 0, false},
+	{"random_stress", bench_random_stress, 0, false},
+	{"large_after_fragmentation", bench_large_after_fragmentation, 0, false},
+	{"multi_page_growth", bench_multi_page_growth, 0, false},
+	{"multi_page_growth_huge", bench_multi_page_growth, 0, true},
+	{"multi_page_growth_geometric", bench_multi_page_growth, 0, false, SF_GROW_GEOMETRIC},
+	{"multi_page_growth_rate", bench_multi_page_growth, 0, false, SF_GROW_RATE},
+	{"scatter", bench_scatter, 0, false},
+	{"scatter_huge", bench_scatter, 0, true},
+	{"trace_record", bench_trace_record, 0, false},
+};
+
+#define BENCH_MAX_RESULTS 64
+
+typedef struct bench_saved {
+	char name[64];
+	double ns_per_op;
+} bench_saved;
+
+/* Read the name and ns_per_op of every scenario in a result file. */
+static int bench_load(const char *path, bench_saved *saved, size_t max_saved){
+	FILE *fp = fopen(path, "r");
+	char line[512];
+	int n = 0;
+
+	if(fp == NULL)
+		return -1;
+	while(fgets(line, sizeof(line), fp) != NULL && (size_t)n < max_saved)
+	{
+		char *name = strstr(line, "\"name\": \"");
+		char *ns = strstr(line, "\"ns_per_op\": ");
+		if(name == NULL || ns == NULL)
+			continue;
+		if(sscanf(name + 9, "%63[^\"]", saved[n].name) != 1)
+			continue;
+		saved[n].ns_per_op = strtod(ns + 13, NULL);
+		n++;
+	}
+	fclose(fp);
+	return n;
+}
+
+static int bench_compare(const char *base_path, const char *new_path){
+	bench_saved base[BENCH_MAX_RESULTS], cur[BENCH_MAX_RESULTS];
+	int nbase = bench_load(base_path, base, BENCH_MAX_RESULTS);
+	int ncur = bench_load(new_path, cur, BENCH_MAX_RESULTS);
+	int i, j;
+
+	if(nbase <= 0 || ncur <= 0)
+	{
+		fprintf(stderr, "sfmm_bench: cannot read results from %s\n", (nbase <= 0) ? base_path : new_path);
+		return EXIT_FAILURE;
+	}
+
+	printf("%-28s %12s %12s %9s\n", "scenario", "base ns/op", "new ns/op", "change");
+	for(i = 0; i < ncur; i++)
+	{
+		for(j = 0; j < nbase; j++)
+			if(strcmp(base[j].name, cur[i].name) == 0)
+				break;
+		if(j == nbase || base[j].ns_per_op == 0)
+			continue;
+		printf("%-28s %12.2f %12.2f %+8.1f%%\n", cur[i].name, base[j].ns_per_op, cur[i].ns_per_op,
+			(cur[i].ns_per_op / base[j].ns_per_op - 1.0) * 100.0);
+	}
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]){
+	size_t scale = 1;
+	const char *filter = NULL;
+	size_t i;
+	int first = 1;
+
+	for(i = 1; i < (size_t)argc; i++)
+	{
+		if(strcmp(argv[i], "-s") == 0 && i + 1 < (size_t)argc)
+			scale = strtoul(argv[++i], NULL, 10);
+		else if(strcmp(argv[i], "-f") == 0 && i + 1 < (size_t)argc)
+			filter = argv[++i];
+		else if(strcmp(argv[i], "-c") == 0 && i + 2 < (size_t)argc)
+			return bench_compare(argv[i + 1], argv[i + 2]);
+		else
+		{
+			fprintf(stderr, "Usage: %s [-s scale] [-f filter]\n       %s -c base.json new.json\n", argv[0], argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if(scale == 0)
+		scale = 1;
+	sf_set_trim_threshold(0);
+	dtlb_fd = bench_dtlb_open();
+
+	printf("{\n  \"scale\": %zu,\n  \"scenarios\": [", scale);
+	for(i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+	{
+		bench_scenario *sc = &scenarios[i];
+		if(filter != NULL && strstr(sc->name, filter) == NULL)
+			continue;
+
+		sf_set_huge_pages(sc->huge_pages);
+		struct sf_grow_policy grow_policy = { sc->grow, 1, BENCH_GROW_MAX_PAGES };
+		sf_set_grow_policy(&grow_policy);
+		sf_arena *arena = sf_arena_create(BENCH_ARENA_CAPACITY);
+		if(arena == NULL)
+		{
+			fprintf(stderr, "sfmm_bench: cannot create an arena\n");
+			return EXIT_FAILURE;
+		}
+
+		bench_result r = {0, 0, -1};
+		struct sf_stats stats;
+		sc->fn(arena, sc->arg, scale, &r);
+		sf_arena_get_stats(arena, &stats);
+
+		printf("%s\n    {\"name\": \"%s\", \"huge_pages\": %s, \"ops\": %llu, \"ns_per_op\": %.2f, "
+			"\"dtlb_misses\": %lld, \"peak_util\": %.6f, \"heap_bytes\": %llu, \"grows\": %llu}", first ? "" : ",",
+			sc->name, sc->huge_pages ? "true" : "false", (unsigned long long)r.ops,
+			(r.ops == 0) ? 0.0 : r.seconds * 1e9 / (double)r.ops, (long long)r.dtlb_misses,
+			sf_arena_peak_utilization(arena), (unsigned long long)stats.heap_bytes,
+			(unsigned long long)stats.grows);
+		fflush(stdout);
+		first = 0;
+
+		sf_arena_destroy(arena);
+		sf_set_huge_pages(false);
+	}
+	struct sf_grow_policy fixed_policy = { SF_GROW_FIXED, 1, 1 };
+	sf_set_grow_policy(&fixed_policy);
+	printf("\n  ]\n}\n");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,140 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sfmm.h"
+#include "sfheapmap.h"
+
+/*
+ * sfmm_mapdiff: compare two heap maps written by sf_heap_map_write().
+ *
+ * Usage: sfmm_mapdiff old.map new.map
+ *
+ * Prints the fragmentation report of both maps side by side, then every block that
+ * differs: "-" lines are blocks only in the old map, "+" lines blocks only in the new
+ * one.  Blocks are matched by offset, size and state, so the diff still lines up when
+ * the maps were taken from heaps at different addresses.
+ */
+
+typedef struct mapdiff_map {
+	sf_heap_map_header header;
+	sf_heap_map_entry *entries;
+} mapdiff_map;
+
+static const char *state_names[] = {"alloc", "free", "quick"};
+
+static int mapdiff_load(const char *path, mapdiff_map *map){
+	FILE *fp = fopen(path, "rb");
+	if(fp == NULL)
+		return -1;
+
+	if(fread(&map->header, sizeof(map->header), 1, fp) != 1 || map->header.magic != SF_HEAP_MAP_MAGIC
+		|| map->header.entry_size != sizeof(sf_heap_map_entry))
+	{
+		fclose(fp);
+		return -1;
+	}
+
+	map->entries = malloc((map->header.nblocks + 1) * sizeof(sf_heap_map_entry));
+	if(map->entries == NULL
+		|| fread(map->entries, sizeof(sf_heap_map_entry), map->header.nblocks, fp) != map->header.nblocks)
+	{
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+	return 0;
+}
+
+static void mapdiff_print_entry(char sign, sf_heap_map_entry *e){
+	const char *state = (e->state <= SF_BLOCK_QUICK) ? state_names[e->state] : "?";
+	if(e->state == SF_BLOCK_ALLOC)
+		printf("%c %#10llx %-5s %8u (payload %u)\n", sign, (unsigned long long)e->offset, state, e->size, e->payload);
+	else
+		printf("%c %#10llx %-5s %8u\n", sign, (unsigned long long)e->offset, state, e->size);
+	return;
+}
+
+static int mapdiff_same(sf_heap_map_entry *a, sf_heap_map_entry *b){
+	return a->offset == b->offset && a->size == b->size && a->state == b->state && a->payload == b->payload;
+}
+
+#define MAPDIFF_ROW(name, field) \
+	printf("%-24s %16llu %16llu\n", name, (unsigned long long)ra.field, (unsigned long long)rb.field)
+
+int main(int argc, char *argv[]){
+	mapdiff_map a, b;
+	struct sf_frag_report ra, rb;
+	int i;
+
+	if(argc != 3)
+	{
+		fprintf(stderr, "Usage: %s old.map new.map\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	for(i = 1; i <= 2; i++)
+	{
+		if(mapdiff_load(argv[i], (i == 1) ? &a : &b) == -1)
+		{
+			fprintf(stderr, "sfmm_mapdiff: %s: cannot read heap map\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	sf_heap_map_analyze(a.entries, a.header.nblocks, &ra);
+	sf_heap_map_analyze(b.entries, b.header.nblocks, &rb);
+
+	printf("%-24s %16s %16s\n", "", "old", "new");
+	MAPDIFF_ROW("heap bytes", heap_bytes);
+	printf("%-24s %16llu %16llu\n", "blocks", (unsigned long long)a.header.nblocks, (unsigned long long)b.header.nblocks);
+	MAPDIFF_ROW("alloc blocks", alloc_blocks);
+	MAPDIFF_ROW("alloc bytes", alloc_bytes);
+	MAPDIFF_ROW("payload bytes", payload_bytes);
+	MAPDIFF_ROW("quick blocks", quick_blocks);
+	MAPDIFF_ROW("free bytes", total_free_bytes);
+	MAPDIFF_ROW("largest free block", largest_free_block);
+	MAPDIFF_ROW("largest gap", largest_gap);
+	printf("%-24s %16.4f %16.4f\n", "external fragmentation", ra.external_fragmentation, rb.external_fragmentation);
+	for(i = 0; i < NUM_FREE_LISTS; i++)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "free blocks [class %d]", i);
+		printf("%-24s %16llu %16llu\n", name, (unsigned long long)ra.free_blocks[i], (unsigned long long)rb.free_blocks[i]);
+	}
+	for(i = 0; i < SF_GAP_BUCKETS; i++)
+	{
+		char name[32];
+		if(ra.gaps[i] == 0 && rb.gaps[i] == 0)
+			continue;
+		snprintf(name, sizeof(name), "gaps [%llu, %llu)", 1ULL << i, 1ULL << (i + 1));
+		printf("%-24s %16llu %16llu\n", name, (unsigned long long)ra.gaps[i], (unsigned long long)rb.gaps[i]);
+	}
+	printf("\n");
+
+	/* Both maps are in offset order, so merge them. */
+	size_t ia = 0, ib = 0;
+	while(ia < a.header.nblocks || ib < b.header.nblocks)
+	{
+		sf_heap_map_entry *ea = (ia < a.header.nblocks) ? &a.entries[ia] : NULL;
+		sf_heap_map_entry *eb = (ib < b.header.nblocks) ? &b.entries[ib] : NULL;
+		if(ea != NULL && eb != NULL && mapdiff_same(ea, eb))
+		{
+			ia++;
+			ib++;
+		}
+		else if(eb == NULL || (ea != NULL && ea->offset <= eb->offset))
+		{
+			mapdiff_print_entry('-', ea);
+			ia++;
+		}
+		else
+		{
+			mapdiff_print_entry('+', eb);
+			ib++;
+		}
+	}
+
+	free(a.entries);
+	free(b.entries);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,513 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "sfmm.h"
+#include "sfarena.h"
+#include "sfpage.h"
+#include "sfstats.h"
+
+/*
+ * sfmm_mtbench: multi-threaded allocator benchmarks, after the classic workloads.
+ *
+ * Usage: sfmm_mtbench [-t max_threads] [-s scale] [-f filter]
+ *
+ *   threadtest     Each thread allocates and frees its own batches of objects.
+ *   xmalloc        Producer threads allocate objects and hand them to consumer
+ *                  threads, which free them (every free is a cross-thread free).
+ *   larson         Server simulation: each thread keeps a set of live objects and
+ *                  replaces random ones with objects of random size.  After each
+ *                  round a thread hands its objects to a new thread and exits.
+ *   cache_scratch  Each thread frees a 16-byte object allocated by the main thread,
+ *                  allocates its own and writes to it repeatedly.  Objects of
+ *                  different threads sharing a cache line slow each other down.
+ *
+ * Each benchmark runs with 1, 2, 4, ... up to max_threads threads (default 8), on
+ * sfmm and on the system allocator, and the results are written to stdout as JSON.
+ *
+ * sfmm is not thread-safe, so its calls are serialized with one mutex, and it runs in
+ * an arena so the benchmarks are not limited by the 24 KB sfutil heap.  Blowup is the
+ * heap size sfmm needed over the largest total payload live at any one time; it is
+ * only reported for sfmm.  shared_lines is the number of cache lines holding objects
+ * of more than one thread in cache_scratch.
+ */
+
+#define MT_ARENA_CAPACITY ((size_t)1 << 30)
+#define MT_CACHE_LINE 64
+
+typedef struct mt_allocator {
+	const char *name;
+	void *(*alloc)(size_t size);
+	void (*release)(void *ptr);
+} mt_allocator;
+
+typedef struct mt_result {
+	uint64_t ops;
+	double seconds;
+	long shared_lines;		// cache_scratch only, -1 otherwise.
+} mt_result;
+
+typedef void (*mt_bench_fn)(mt_allocator *a, int threads, size_t scale, mt_result *r);
+
+static pthread_mutex_t sfmm_lock = PTHREAD_MUTEX_INITIALIZER;
+static sf_arena *sfmm_arena = NULL;
+
+/* Payload live right now and at most, kept in the first word of every object. */
+static size_t live_payload = 0;
+static size_t peak_payload = 0;
+
+
+static double mt_now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint64_t mt_rand(uint64_t *state){
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*state = x;
+	return x;
+}
+
+static void *mt_sfmm_alloc(size_t size){
+	pthread_mutex_lock(&sfmm_lock);
+	void *pp = sf_arena_malloc(sfmm_arena, (sf_size_t)size);
+	pthread_mutex_unlock(&sfmm_lock);
+	return pp;
+}
+
+static void mt_sfmm_release(void *ptr){
+	pthread_mutex_lock(&sfmm_lock);
+	sf_arena_free(sfmm_arena, ptr);
+	pthread_mutex_unlock(&sfmm_lock);
+	return;
+}
+
+static mt_allocator allocators[] = {
+	{"sfmm", mt_sfmm_alloc, mt_sfmm_release},
+	{"system", malloc, free},
+};
+
+/* Every object is at least a size_t, and starts with its size. */
+static void *mt_alloc(mt_allocator *a, size_t size){
+	if(size < sizeof(size_t))
+		size = sizeof(size_t);
+	void *pp = a->alloc(size);
+	if(pp == NULL)
+	{
+		fprintf(stderr, "sfmm_mtbench: %s: out of memory allocating %zu bytes\n", a->name, size);
+		exit(EXIT_FAILURE);
+	}
+	*(size_t *)pp = size;
+
+	size_t live = __atomic_add_fetch(&live_payload, size, __ATOMIC_RELAXED);
+	size_t peak = __atomic_load_n(&peak_payload, __ATOMIC_RELAXED);
+	while(live > peak && !__atomic_compare_exchange_n(&peak_payload, &peak, live, true,
+		__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+	return pp;
+}
+
+static void mt_release(mt_allocator *a, void *ptr){
+	__atomic_sub_fetch(&live_payload, *(size_t *)ptr, __ATOMIC_RELAXED);
+	a->release(ptr);
+	return;
+}
+
+/* Start threads running fn on the given arguments, and wait for all of them. */
+static void mt_run(int threads, void *(*fn)(void *), void *args, size_t arg_size){
+	pthread_t *tids = malloc(threads * sizeof(pthread_t));
+	int i;
+	if(tids == NULL)
+		exit(EXIT_FAILURE);
+	for(i = 0; i < threads; i++)
+		if(pthread_create(&tids[i], NULL, fn, (char *)args + i * arg_size) != 0)
+		{
+			perror("pthread_create");
+			exit(EXIT_FAILURE);
+		}
+	for(i = 0; i < threads; i++)
+		pthread_join(tids[i], NULL);
+	free(tids);
+	return;
+}
+
+
+/* threadtest */
+
+typedef struct threadtest_arg {
+	mt_allocator *a;
+	size_t rounds;
+	size_t objects;
+} threadtest_arg;
+
+static void *threadtest_thread(void *varg){
+	threadtest_arg *arg = varg;
+	void **objs = malloc(arg->objects * sizeof(void *));
+	size_t i, j;
+	if(objs == NULL)
+		exit(EXIT_FAILURE);
+	for(i = 0; i < arg->rounds; i++)
+	{
+		for(j = 0; j < arg->objects; j++)
+			objs[j] = mt_alloc(arg->a, 64);
+		for(j = 0; j < arg->objects; j++)
+			mt_release(arg->a, objs[j]);
+	}
+	free(objs);
+	return NULL;
+}
+
+/* The total work is fixed and split between the threads. */
+static void bench_threadtest(mt_allocator *a, int threads, size_t scale, mt_result *r){
+	threadtest_arg *args = malloc(threads * sizeof(threadtest_arg));
+	int i;
+	if(args == NULL)
+		exit(EXIT_FAILURE);
+	for(i = 0; i < threads; i++)
+	{
+		args[i].a = a;
+		args[i].rounds = 50 * scale;
+		args[i].objects = 8000 / threads;
+	}
+
+	double start = mt_now();
+	mt_run(threads, threadtest_thread, args, sizeof(threadtest_arg));
+	r->seconds = mt_now() - start;
+	r->ops = (uint64_t)threads * args[0].rounds * args[0].objects * 2;
+	free(args);
+	return;
+}
+
+
+/* xmalloc: producers and consumers connected by bounded queues. */
+
+#define XMALLOC_QUEUE 1024
+
+typedef struct xmalloc_queue {
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	void *items[XMALLOC_QUEUE];
+	size_t head;
+	size_t count;
+} xmalloc_queue;
+
+typedef struct xmalloc_arg {
+	mt_allocator *a;
+	xmalloc_queue *queue;
+	size_t items;
+	int producer;
+	uint64_t seed;
+} xmalloc_arg;
+
+static void *xmalloc_thread(void *varg){
+	xmalloc_arg *arg = varg;
+	xmalloc_queue *q = arg->queue;
+	size_t i;
+
+	for(i = 0; i < arg->items; i++)
+	{
+		if(arg->producer)
+		{
+			void *pp = mt_alloc(arg->a, 16 + mt_rand(&arg->seed) % 497);
+			pthread_mutex_lock(&q->lock);
+			while(q->count == XMALLOC_QUEUE)
+				pthread_cond_wait(&q->not_full, &q->lock);
+			q->items[(q->head + q->count) % XMALLOC_QUEUE] = pp;
+			q->count++;
+			pthread_cond_signal(&q->not_empty);
+			pthread_mutex_unlock(&q->lock);
+		}
+		else
+		{
+			pthread_mutex_lock(&q->lock);
+			while(q->count == 0)
+				pthread_cond_wait(&q->not_empty, &q->lock);
+			void *pp = q->items[q->head];
+			q->head = (q->head + 1) % XMALLOC_QUEUE;
+			q->count--;
+			pthread_cond_signal(&q->not_full);
+			pthread_mutex_unlock(&q->lock);
+			mt_release(arg->a, pp);
+		}
+	}
+	return NULL;
+}
+
+/* threads / 2 producer-consumer pairs (at least one), sharing a fixed total. */
+static void bench_xmalloc(mt_allocator *a, int threads, size_t scale, mt_result *r){
+	int pairs = (threads < 2) ? 1 : threads / 2;
+	xmalloc_queue *queues = calloc(pairs, sizeof(xmalloc_queue));
+	xmalloc_arg *args = malloc(2 * pairs * sizeof(xmalloc_arg));
+	int i;
+	if(queues == NULL || args == NULL)
+		exit(EXIT_FAILURE);
+	for(i = 0; i < pairs; i++)
+	{
+		pthread_mutex_init(&queues[i].lock, NULL);
+		pthread_cond_init(&queues[i].not_empty, NULL);
+		pthread_cond_init(&queues[i].not_full, NULL);
+	}
+	for(i = 0; i < 2 * pairs; i++)
+	{
+		args[i].a = a;
+		args[i].queue = &queues[i / 2];
+		args[i].items = 200000 * scale / pairs;
+		args[i].producer = (i % 2 == 0);
+		args[i].seed = 0x1234567 + i;
+	}
+
+	double start = mt_now();
+	mt_run(2 * pairs, xmalloc_thread, args, sizeof(xmalloc_arg));
+	r->seconds = mt_now() - start;
+	r->ops = (uint64_t)pairs * args[0].items * 2;
+
+	for(i = 0; i < pairs; i++)
+	{
+		pthread_mutex_destroy(&queues[i].lock);
+		pthread_cond_destroy(&queues[i].not_empty);
+		pthread_cond_destroy(&queues[i].not_full);
+	}
+	free(queues);
+	free(args);
+	return;
+}
+
+
+/* larson */
+
+#define LARSON_SLOTS 500
+#define LARSON_GENERATIONS 5
+
+typedef struct larson_arg {
+	mt_allocator *a;
+	void *slots[LARSON_SLOTS];
+	size_t rounds;
+	int generation;
+	uint64_t seed;
+} larson_arg;
+
+static void *larson_thread(void *varg){
+	larson_arg *arg = varg;
+	size_t i;
+
+	for(i = 0; i < arg->rounds; i++)
+	{
+		uint64_t x = mt_rand(&arg->seed);
+		size_t s = (size_t)(x % LARSON_SLOTS);
+		mt_release(arg->a, arg->slots[s]);
+		arg->slots[s] = mt_alloc(arg->a, 16 + (x >> 32) % 1009);
+	}
+
+	/* Hand the objects over to a new thread. */
+	arg->generation++;
+	if(arg->generation < LARSON_GENERATIONS)
+	{
+		pthread_t next;
+		if(pthread_create(&next, NULL, larson_thread, arg) != 0)
+		{
+			perror("pthread_create");
+			exit(EXIT_FAILURE);
+		}
+		pthread_join(next, NULL);
+	}
+	return NULL;
+}
+
+static void bench_larson(mt_allocator *a, int threads, size_t scale, mt_result *r){
+	larson_arg *args = malloc(threads * sizeof(larson_arg));
+	int i, j;
+	if(args == NULL)
+		exit(EXIT_FAILURE);
+	for(i = 0; i < threads; i++)
+	{
+		args[i].a = a;
+		args[i].rounds = 20000 * scale / threads;
+		args[i].generation = 0;
+		args[i].seed = 0x9876543 + i;
+		for(j = 0; j < LARSON_SLOTS; j++)
+			args[i].slots[j] = mt_alloc(a, 16 + mt_rand(&args[i].seed) % 1009);
+	}
+
+	double start = mt_now();
+	mt_run(threads, larson_thread, args, sizeof(larson_arg));
+	r->seconds = mt_now() - start;
+	r->ops = (uint64_t)threads * args[0].rounds * LARSON_GENERATIONS * 2;
+
+	for(i = 0; i < threads; i++)
+		for(j = 0; j < LARSON_SLOTS; j++)
+			mt_release(a, args[i].slots[j]);
+	free(args);
+	return;
+}
+
+
+/* cache_scratch */
+
+typedef struct scratch_arg {
+	mt_allocator *a;
+	void *given;
+	void *own;
+	size_t rounds;
+	size_t writes;
+} scratch_arg;
+
+static void *scratch_thread(void *varg){
+	scratch_arg *arg = varg;
+	size_t i, j;
+
+	mt_release(arg->a, arg->given);
+	for(i = 0; i < arg->rounds; i++)
+	{
+		/* Write past the size word at the start. */
+		volatile char *obj = mt_alloc(arg->a, 16);
+		for(j = 0; j < arg->writes; j++)
+			obj[8 + j % 8] = obj[8 + j % 8] + 1;
+		if(i + 1 == arg->rounds)
+			arg->own = (void *)obj;
+		else
+			mt_release(arg->a, (void *)obj);
+	}
+	return NULL;
+}
+
+static void bench_cache_scratch(mt_allocator *a, int threads, size_t scale, mt_result *r){
+	scratch_arg *args = malloc(threads * sizeof(scratch_arg));
+	int i, j;
+	if(args == NULL)
+		exit(EXIT_FAILURE);
+	for(i = 0; i < threads; i++)
+	{
+		args[i].a = a;
+		args[i].given = mt_alloc(a, 16);
+		args[i].own = NULL;
+		args[i].rounds = 100;
+		args[i].writes = 1000000 * scale / threads / args[i].rounds;
+	}
+
+	double start = mt_now();
+	mt_run(threads, scratch_thread, args, sizeof(scratch_arg));
+	r->seconds = mt_now() - start;
+	r->ops = (uint64_t)threads * args[0].rounds * args[0].writes;
+
+	/* Count the cache lines holding the last objects of more than one thread. */
+	r->shared_lines = 0;
+	for(i = 0; i < threads; i++)
+	{
+		uintptr_t line = (uintptr_t)args[i].own / MT_CACHE_LINE;
+		for(j = 0; j < i; j++)
+			if((uintptr_t)args[j].own / MT_CACHE_LINE == line)
+				break;
+		if(j < i)
+			continue;
+		for(j = i + 1; j < threads; j++)
+			if((uintptr_t)args[j].own / MT_CACHE_LINE == line)
+			{
+				r->shared_lines++;
+				break;
+			}
+	}
+
+	for(i = 0; i < threads; i++)
+		mt_release(a, args[i].own);
+	free(args);
+	return;
+}
+
+
+typedef struct mt_bench {
+	const char *name;
+	mt_bench_fn fn;
+} mt_bench;
+
+static mt_bench benches[] = {
+	{"threadtest", bench_threadtest},
+	{"xmalloc", bench_xmalloc},
+	{"larson", bench_larson},
+	{"cache_scratch", bench_cache_scratch},
+};
+
+int main(int argc, char *argv[]){
+	int max_threads = 8;
+	size_t scale = 1;
+	const char *filter = NULL;
+	size_t b, k;
+	int i, first = 1;
+
+	for(i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+			max_threads = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+			scale = strtoul(argv[++i], NULL, 10);
+		else if(strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+			filter = argv[++i];
+		else
+		{
+			fprintf(stderr, "Usage: %s [-t max_threads] [-s scale] [-f filter]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if(max_threads < 1)
+		max_threads = 1;
+	if(scale == 0)
+		scale = 1;
+	sf_set_trim_threshold(0);
+
+	printf("{\n  \"scale\": %zu,\n  \"results\": [", scale);
+	for(b = 0; b < sizeof(benches) / sizeof(benches[0]); b++)
+	{
+		if(filter != NULL && strstr(benches[b].name, filter) == NULL)
+			continue;
+
+		int threads;
+		for(threads = 1; threads <= max_threads; threads = threads * 2)
+		{
+			for(k = 0; k < sizeof(allocators) / sizeof(allocators[0]); k++)
+			{
+				mt_allocator *a = &allocators[k];
+				mt_result r = {0, 0, -1};
+
+				sfmm_arena = sf_arena_create(MT_ARENA_CAPACITY);
+				if(sfmm_arena == NULL)
+				{
+					fprintf(stderr, "sfmm_mtbench: cannot create an arena\n");
+					return EXIT_FAILURE;
+				}
+				live_payload = 0;
+				peak_payload = 0;
+
+				benches[b].fn(a, threads, scale, &r);
+
+				printf("%s\n    {\"bench\": \"%s\", \"allocator\": \"%s\", \"threads\": %d, "
+					"\"ops\": %llu, \"ops_per_sec\": %.0f", first ? "" : ",", benches[b].name,
+					a->name, threads, (unsigned long long)r.ops,
+					(r.seconds > 0) ? (double)r.ops / r.seconds : 0.0);
+				if(a->alloc == mt_sfmm_alloc)
+				{
+					struct sf_stats stats;
+					sf_arena_get_stats(sfmm_arena, &stats);
+					printf(", \"heap_bytes\": %llu, \"blowup\": %.4f", (unsigned long long)stats.heap_bytes,
+						(peak_payload == 0) ? 0.0 : (double)stats.heap_bytes / (double)peak_payload);
+				}
+				if(r.shared_lines >= 0)
+					printf(", \"shared_lines\": %ld", r.shared_lines);
+				printf("}");
+				fflush(stdout);
+				first = 0;
+
+				sf_arena_destroy(sfmm_arena);
+				sfmm_arena = NULL;
+			}
+		}
+	}
+	printf("\n  ]\n}\n");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "sfmm.hpp"
+
+/*
+ * sfmm_pmrbench: standard containers on sfmm against the default memory resource.
+ *
+ * Usage: sfmm_pmrbench [-s scale] [-f filter]
+ *
+ * Every workload runs once on std::pmr::new_delete_resource() and once on an
+ * sfmm::memory_resource over a fresh arena.  The vector_allocator workload uses
+ * std::allocator and sfmm::allocator<T> instead of std::pmr containers.  The results
+ * are written to stdout as JSON: for each workload and resource, the number of
+ * container operations and the time per operation.  scale multiplies the operation
+ * counts (default 1); filter runs only the workloads whose name contains it.
+ */
+
+#define PMRBENCH_ARENA_CAPACITY ((size_t)1 << 30)
+
+typedef uint64_t (*pmrbench_fn)(std::pmr::memory_resource *mr, size_t scale);
+
+/* xorshift64, so runs are repeatable. */
+static uint64_t pmrbench_rand(uint64_t *state){
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*state = x;
+	return x;
+}
+
+/* Grow many vectors by push_back and drop them, so every growth step reallocates. */
+static uint64_t pmrbench_vector(std::pmr::memory_resource *mr, size_t scale){
+	uint64_t ops = 0, seed = 1;
+	for(size_t round = 0; round < 20 * scale; round++)
+	{
+		std::pmr::vector<std::pmr::vector<int>> vectors(mr);
+		for(int i = 0; i < 1000; i++)
+		{
+			vectors.emplace_back();
+			size_t n = pmrbench_rand(&seed) % 500;
+			for(size_t j = 0; j < n; j++)
+				vectors.back().push_back((int)j);
+			ops = ops + n;
+		}
+	}
+	return ops;
+}
+
+/* The same as pmrbench_vector, with std::allocator or sfmm::allocator<T>. */
+template <class Alloc>
+static uint64_t pmrbench_vector_alloc(const Alloc &alloc, size_t scale){
+	using inner_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<int>;
+	using outer_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<std::vector<int, inner_alloc>>;
+	uint64_t ops = 0, seed = 1;
+	for(size_t round = 0; round < 20 * scale; round++)
+	{
+		std::vector<std::vector<int, inner_alloc>, outer_alloc> vectors{outer_alloc(alloc)};
+		for(int i = 0; i < 1000; i++)
+		{
+			vectors.emplace_back(inner_alloc(alloc));
+			size_t n = pmrbench_rand(&seed) % 500;
+			for(size_t j = 0; j < n; j++)
+				vectors.back().push_back((int)j);
+			ops = ops + n;
+		}
+	}
+	return ops;
+}
+
+/* Insert random keys, look them up, and erase them in another order. */
+static uint64_t pmrbench_unordered_map(std::pmr::memory_resource *mr, size_t scale){
+	uint64_t ops = 0, seed = 2;
+	for(size_t round = 0; round < 4 * scale; round++)
+	{
+		std::pmr::unordered_map<uint64_t, uint64_t> map(mr);
+		std::vector<uint64_t> keys(50000);
+		for(uint64_t &key : keys)
+		{
+			key = pmrbench_rand(&seed);
+			map[key] = key;
+		}
+		for(uint64_t key : keys)
+			ops = ops + map.count(key);
+		for(size_t i = 0; i < keys.size(); i = i + 2)
+			map.erase(keys[i]);
+		for(size_t i = 1; i < keys.size(); i = i + 2)
+			map.erase(keys[i]);
+		ops = ops + 2 * keys.size();
+	}
+	return ops;
+}
+
+/* Balanced-tree nodes: interleaved inserts and erases keep the tree at a steady size. */
+static uint64_t pmrbench_map(std::pmr::memory_resource *mr, size_t scale){
+	uint64_t ops = 0, seed = 3;
+	std::pmr::map<uint32_t, uint64_t> map(mr);
+	for(size_t i = 0; i < 200000 * scale; i++)
+	{
+		uint32_t key = (uint32_t)(pmrbench_rand(&seed) % 20000);
+		auto it = map.find(key);
+		if(it == map.end())
+			map.emplace(key, i);
+		else
+			map.erase(it);
+		ops++;
+	}
+	return ops;
+}
+
+/* Strings longer than the small-string buffer: build, append, copy and sort them. */
+static uint64_t pmrbench_string(std::pmr::memory_resource *mr, size_t scale){
+	uint64_t ops = 0, seed = 4;
+	for(size_t round = 0; round < 4 * scale; round++)
+	{
+		std::pmr::vector<std::pmr::string> strings(mr);
+		for(int i = 0; i < 20000; i++)
+		{
+			std::pmr::string s(16 + pmrbench_rand(&seed) % 200, (char)('a' + i % 26), mr);
+			s += "-suffix-that-forces-a-reallocation";
+			strings.push_back(std::move(s));
+		}
+		std::pmr::vector<std::pmr::string> copies(strings, mr);
+		std::sort(copies.begin(), copies.end());
+		ops = ops + 3 * strings.size();
+	}
+	return ops;
+}
+
+struct pmrbench_workload {
+	const char *name;
+	pmrbench_fn fn;
+};
+
+static const pmrbench_workload workloads[] = {
+	{"vector", pmrbench_vector},
+	{"unordered_map", pmrbench_unordered_map},
+	{"map", pmrbench_map},
+	{"string", pmrbench_string},
+	{"vector_allocator", nullptr},
+};
+
+static double pmrbench_now(){
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char *argv[]){
+	size_t scale = 1;
+	const char *filter = nullptr;
+	int first = 1;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+			scale = strtoul(argv[++i], nullptr, 10);
+		else if(strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+			filter = argv[++i];
+		else
+		{
+			fprintf(stderr, "Usage: %s [-s scale] [-f filter]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if(scale == 0)
+		scale = 1;
+
+	printf("{\n  \"scale\": %zu,\n  \"workloads\": [", scale);
+	for(const pmrbench_workload &w : workloads)
+	{
+		if(filter != nullptr && strstr(w.name, filter) == nullptr)
+			continue;
+
+		for(int use_sfmm = 0; use_sfmm <= 1; use_sfmm++)
+		{
+			sf_arena *arena = nullptr;
+			if(use_sfmm)
+			{
+				arena = sf_arena_create(PMRBENCH_ARENA_CAPACITY);
+				if(arena == nullptr)
+				{
+					fprintf(stderr, "sfmm_pmrbench: cannot create an arena\n");
+					return EXIT_FAILURE;
+				}
+			}
+			sfmm::memory_resource sf_resource(arena);
+
+			uint64_t ops;
+			double start = pmrbench_now();
+			if(w.fn != nullptr)
+				ops = w.fn(use_sfmm ? (std::pmr::memory_resource *)&sf_resource : std::pmr::new_delete_resource(), scale);
+			else if(use_sfmm)
+				ops = pmrbench_vector_alloc(sfmm::allocator<int>(&sf_resource), scale);
+			else
+				ops = pmrbench_vector_alloc(std::allocator<int>(), scale);
+			double seconds = pmrbench_now() - start;
+
+			printf("%s\n    {\"name\": \"%s\", \"resource\": \"%s\", \"ops\": %llu, \"ns_per_op\": %.2f}",
+				first ? "" : ",", w.name, use_sfmm ? "sfmm" : "default", (unsigned long long)ops,
+				(ops == 0) ? 0.0 : seconds * 1e9 / (double)ops);
+			fflush(stdout);
+			first = 0;
+
+			sf_arena_destroy(arena);
+		}
+	}
+	printf("\n  ]\n}\n");
+
+	return EXIT_SUCCESS;
+}
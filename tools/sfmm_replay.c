@@ -0,0 +1,677 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <time.h>
+#include <malloc.h>
+#include "sfmm.h"
+#include "sfarena.h"
+#include "sfstats.h"
+#include "sftrace.h"
+#include "sfheapmap.h"
+#include "sfplace.h"
+#include "sfhint.h"
+
+/*
+ * sfmm_replay: replay allocation traces against sfmm and against the system allocator.
+ *
+ * Usage: sfmm_replay [-c capacity_mb] [-s samples] [-p first|best|good[:K]] [-o lifo|address] [-t split_threshold] [-L lifetime] trace...
+ *
+ * A trace is either a malloclab-style .rep file or a file recorded by sf_trace_start();
+ * the format is detected from the first bytes.  Each trace is replayed twice per
+ * allocator: once with heap size sampling, and once timed, for throughput.  sfmm runs
+ * in a fresh arena of capacity_mb megabytes (default 1024), so traces are not limited
+ * by the sfutil heap.
+ *
+ * For sfmm, peak utilization and internal fragmentation are sf_peak_utilization() and
+ * sf_internal_fragmentation() at the end of the trace.  For the system allocator, the
+ * heap size is taken from mallinfo2() at the sample points, and internal fragmentation
+ * is the payload over the malloc_usable_size() of the live blocks plus a size_t header.
+ * Memory the system allocator already held before the measured pass is not counted.
+ * Note that sf_peak_utilization() divides by the heap size at the end of the trace,
+ * so it can exceed 1 when sf_free() has trimmed the heap.
+ *
+ * -p selects the sfmm placement policy (see sfplace.h).  For sfmm, the number of free
+ * list probes per search and the external fragmentation are also printed; the latter
+ * is the mean of sf_heap_frag()'s external fragmentation over the sample points.
+ * -o selects the free-list order of the sfmm arenas.  -t sets the split threshold:
+ * requests with a block of that size or more are split off the top of a free block.
+ * Running a trace with and without -t shows the effect on external fragmentation.
+ *
+ * -L adds a pass with lifetime hints (see sfhint.h), taken from the trace itself: a
+ * block freed within lifetime ops of its allocation is allocated with SF_HINT_SHORT,
+ * any other block with SF_HINT_LONG.  The peak heap size over the sample points, summed
+ * over the sub-heaps, is printed next to the peak heap size without hints.
+ */
+
+#define REPLAY_DEFAULT_CAPACITY_MB 1024
+#define REPLAY_DEFAULT_SAMPLES 20
+
+/* Id of a trace pointer that is not live. */
+#define REPLAY_NO_ID UINT32_MAX
+
+typedef struct replay_op {
+	char type;			// 'a' (malloc), 'r' (realloc) or 'f' (free).
+	uint32_t id;
+	uint32_t size;
+} replay_op;
+
+typedef struct replay_trace {
+	replay_op *ops;
+	size_t num_ops;
+	size_t max_ops;
+	size_t num_ids;
+} replay_trace;
+
+typedef struct replay_result {
+	long failed_op;			// Index of the op that ran out of memory, -1 if none.
+	double ops_per_sec;
+	double peak_util;
+	double inter_frag;
+	size_t final_heap;
+	size_t *heap_samples;		// Heap size before every interval-th op.
+	double probes_per_search;	// sfmm only.
+	double ext_frag;		// sfmm only: mean over the sample points.
+} replay_result;
+
+
+static double replay_now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void replay_add_op(replay_trace *t, char type, uint32_t id, uint32_t size){
+	if(t->num_ops == t->max_ops)
+	{
+		t->max_ops = (t->max_ops == 0) ? 1024 : t->max_ops * 2;
+		t->ops = realloc(t->ops, t->max_ops * sizeof(replay_op));
+		if(t->ops == NULL)
+		{
+			perror("realloc");
+			exit(EXIT_FAILURE);
+		}
+	}
+	t->ops[t->num_ops].type = type;
+	t->ops[t->num_ops].id = id;
+	t->ops[t->num_ops].size = size;
+	t->num_ops++;
+	if((size_t)id + 1 > t->num_ids)
+		t->num_ids = (size_t)id + 1;
+	return;
+}
+
+/* Read a malloclab trace: a header of numbers (suggested heap size, number of ids,
+   number of ops, weight), then one "a id size", "r id size" or "f id" per line. */
+static int replay_load_rep(FILE *fp, replay_trace *t){
+	char line[256];
+	unsigned int id, size;
+	char type;
+
+	while(fgets(line, sizeof(line), fp) != NULL)
+	{
+		char *p = line;
+		while(isspace((unsigned char)*p))
+			p++;
+		if(*p == '\0' || *p == '#' || isdigit((unsigned char)*p))
+			continue;
+
+		int n = sscanf(p, "%c %u %u", &type, &id, &size);
+		if((type == 'a' || type == 'r') && n == 3)
+			replay_add_op(t, type, id, size);
+		else if(type == 'f' && n >= 2)
+			replay_add_op(t, type, id, 0);
+		else
+			return -1;
+	}
+	return 0;
+}
+
+/* Open-addressed map from trace pointers to ids.  Entries are never removed; a freed
+   pointer maps to REPLAY_NO_ID until it is handed out again. */
+typedef struct replay_map {
+	uint64_t *keys;
+	uint32_t *ids;
+	size_t mask;
+	size_t used;
+} replay_map;
+
+static uint32_t *replay_map_slot(replay_map *m, uint64_t key){
+	if(m->keys == NULL || (m->used + 1) * 2 > m->mask + 1)
+	{
+		/* Grow and rehash. */
+		replay_map old = *m;
+		size_t capacity = (old.keys == NULL) ? 1024 : (old.mask + 1) * 2;
+		m->keys = calloc(capacity, sizeof(uint64_t));
+		m->ids = calloc(capacity, sizeof(uint32_t));
+		if(m->keys == NULL || m->ids == NULL)
+		{
+			perror("calloc");
+			exit(EXIT_FAILURE);
+		}
+		m->mask = capacity - 1;
+		m->used = 0;
+		size_t i;
+		for(i = 0; old.keys != NULL && i <= old.mask; i++)
+			if(old.keys[i] != 0)
+				*replay_map_slot(m, old.keys[i]) = old.ids[i];
+		free(old.keys);
+		free(old.ids);
+	}
+
+	size_t i = (size_t)((key * 0x9e3779b97f4a7c15ULL) >> 20) & m->mask;
+	while(m->keys[i] != 0 && m->keys[i] != key)
+		i = (i + 1) & m->mask;
+	if(m->keys[i] == 0)
+	{
+		m->keys[i] = key;
+		m->ids[i] = REPLAY_NO_ID;
+		m->used++;
+	}
+	return &m->ids[i];
+}
+
+/* Read a trace recorded by sf_trace_start(), turning addresses into ids. */
+static int replay_load_sftrace(FILE *fp, replay_trace *t){
+	sf_trace_header header;
+	sf_trace_event event;
+	replay_map map = {NULL, NULL, 0, 0};
+	uint32_t next_id = 0;
+
+	if(fread(&header, sizeof(header), 1, fp) != 1 || header.magic != SF_TRACE_MAGIC
+		|| header.event_size != sizeof(sf_trace_event))
+		return -1;
+
+	while(fread(&event, sizeof(event), 1, fp) == 1)
+	{
+		uint32_t *slot;
+		switch(event.op)
+		{
+		case SF_TRACE_MALLOC:
+			if(event.ptr == 0)
+				break;
+			*replay_map_slot(&map, event.ptr) = next_id;
+			replay_add_op(t, 'a', next_id, event.size);
+			next_id++;
+			break;
+		case SF_TRACE_FREE:
+			if(event.ptr == 0)
+				break;
+			slot = replay_map_slot(&map, event.ptr);
+			if(*slot != REPLAY_NO_ID)
+				replay_add_op(t, 'f', *slot, 0);
+			*slot = REPLAY_NO_ID;
+			break;
+		case SF_TRACE_REALLOC:
+			slot = (event.old_ptr == 0) ? NULL : replay_map_slot(&map, event.old_ptr);
+			if(event.ptr == 0)
+			{
+				/* A failed realloc leaves the block alone; a size of 0 frees it. */
+				if(event.size == 0 && slot != NULL && *slot != REPLAY_NO_ID)
+				{
+					replay_add_op(t, 'f', *slot, 0);
+					*slot = REPLAY_NO_ID;
+				}
+				break;
+			}
+			if(slot == NULL || *slot == REPLAY_NO_ID)
+			{
+				replay_add_op(t, 'a', next_id, event.size);
+				*replay_map_slot(&map, event.ptr) = next_id;
+				next_id++;
+				break;
+			}
+			uint32_t id = *slot;
+			*slot = REPLAY_NO_ID;
+			replay_add_op(t, 'r', id, event.size);
+			*replay_map_slot(&map, event.ptr) = id;
+			break;
+		default:
+			free(map.keys);
+			free(map.ids);
+			return -1;
+		}
+	}
+
+	free(map.keys);
+	free(map.ids);
+	return 0;
+}
+
+static int replay_load(const char *path, replay_trace *t){
+	FILE *fp = fopen(path, "rb");
+	if(fp == NULL)
+		return -1;
+
+	uint64_t magic = 0;
+	size_t n = fread(&magic, 1, sizeof(magic), fp);
+	rewind(fp);
+
+	int ret;
+	if(n == sizeof(magic) && magic == SF_TRACE_MAGIC)
+		ret = replay_load_sftrace(fp, t);
+	else
+		ret = replay_load_rep(fp, t);
+	fclose(fp);
+	return ret;
+}
+
+/* Replay once on sfmm.  If r is not NULL, sample the heap into it.  Return the index of
+   the first op that failed, or -1. */
+static long replay_sfmm_pass(replay_trace *t, sf_arena *arena, void **ptrs, replay_result *r, size_t interval){
+	struct sf_stats stats;
+	struct sf_frag_report report;
+	size_t i, frag_samples = 0;
+
+	if(r != NULL)
+		r->ext_frag = 0;
+	for(i = 0; i < t->num_ops; i++)
+	{
+		replay_op *op = &t->ops[i];
+		if(r != NULL && i % interval == 0)
+		{
+			sf_arena_get_stats(arena, &stats);
+			r->heap_samples[i / interval] = stats.heap_bytes;
+			if(sf_arena_heap_frag(arena, &report) == 0 && report.total_free_bytes != 0)
+			{
+				r->ext_frag = r->ext_frag + report.external_fragmentation;
+				frag_samples++;
+			}
+		}
+
+		switch(op->type)
+		{
+		case 'a':
+			ptrs[op->id] = sf_arena_malloc(arena, op->size);
+			if(ptrs[op->id] == NULL && op->size != 0)
+				return (long)i;
+			break;
+		case 'r':
+			if(ptrs[op->id] == NULL)
+				ptrs[op->id] = sf_arena_malloc(arena, op->size);
+			else
+				ptrs[op->id] = sf_arena_realloc(arena, ptrs[op->id], op->size);
+			if(ptrs[op->id] == NULL && op->size != 0)
+				return (long)i;
+			break;
+		case 'f':
+			if(ptrs[op->id] != NULL)
+				sf_arena_free(arena, ptrs[op->id]);
+			ptrs[op->id] = NULL;
+			break;
+		}
+	}
+	if(r != NULL && frag_samples != 0)
+		r->ext_frag = r->ext_frag / (double)frag_samples;
+	return -1;
+}
+
+/* Free-list order of the sfmm arenas. */
+static int replay_frlst_order = SF_ORDER_LIFO;
+
+static sf_arena *replay_arena_create(size_t capacity){
+	sf_arena *arena = sf_arena_create(capacity);
+	if(arena != NULL && sf_arena_set_frlst_order(arena, replay_frlst_order) == -1)
+	{
+		sf_arena_destroy(arena);
+		return NULL;
+	}
+	return arena;
+}
+
+static void replay_sfmm(replay_trace *t, size_t capacity, size_t interval, replay_result *r){
+	void **ptrs = calloc(t->num_ids, sizeof(void *));
+	struct sf_stats stats;
+
+	/* Timed pass. */
+	sf_arena *arena = replay_arena_create(capacity);
+	if(arena == NULL || ptrs == NULL)
+	{
+		fprintf(stderr, "sfmm_replay: cannot create an arena of %zu bytes\n", capacity);
+		exit(EXIT_FAILURE);
+	}
+	double start = replay_now();
+	r->failed_op = replay_sfmm_pass(t, arena, ptrs, NULL, interval);
+	double seconds = replay_now() - start;
+	r->ops_per_sec = (seconds > 0) ? (double)t->num_ops / seconds : 0;
+	sf_arena_destroy(arena);
+
+	/* Measured pass. */
+	memset(ptrs, 0, t->num_ids * sizeof(void *));
+	arena = replay_arena_create(capacity);
+	replay_sfmm_pass(t, arena, ptrs, r, interval);
+	r->peak_util = sf_arena_peak_utilization(arena);
+	r->inter_frag = sf_arena_internal_fragmentation(arena);
+	sf_arena_get_stats(arena, &stats);
+	r->final_heap = stats.heap_bytes;
+
+	uint64_t searches = 0, probes = 0;
+	int j;
+	for(j = 0; j < NUM_FREE_LISTS; j++)
+	{
+		searches = searches + stats.searches[j];
+		probes = probes + stats.probes[j];
+	}
+	r->probes_per_search = (searches == 0) ? 0 : (double)probes / (double)searches;
+	sf_arena_destroy(arena);
+
+	free(ptrs);
+	return;
+}
+
+/* The lifetime hint of every op that allocates: SF_HINT_SHORT if the block is freed
+   within lifetime ops, SF_HINT_LONG otherwise. */
+static unsigned char *replay_hints(replay_trace *t, size_t lifetime){
+	unsigned char *hints = calloc(t->num_ops, 1);
+	size_t *free_at = malloc(t->num_ids * sizeof(size_t));
+	size_t i;
+	if(hints == NULL || free_at == NULL)
+	{
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	for(i = 0; i < t->num_ids; i++)
+		free_at[i] = SIZE_MAX;
+
+	/* Walk backwards, so the next free of every id is known at its allocation. */
+	for(i = t->num_ops; i-- > 0;)
+	{
+		replay_op *op = &t->ops[i];
+		if(op->type == 'f')
+			free_at[op->id] = i;
+		else
+		{
+			bool short_lived = free_at[op->id] != SIZE_MAX && free_at[op->id] - i <= lifetime;
+			hints[i] = short_lived ? SF_HINT_SHORT : SF_HINT_LONG;
+			if(op->type == 'a')
+				free_at[op->id] = SIZE_MAX;
+		}
+	}
+	free(free_at);
+	return hints;
+}
+
+/* Heap size of an arena and its sub-heaps. */
+static size_t replay_hinted_heap(sf_arena *arena){
+	struct sf_stats stats;
+	size_t heap = 0;
+	int hint;
+	for(hint = SF_HINT_NONE; hint <= SF_HINT_LONG; hint++)
+	{
+		sf_arena_hint_get_stats(arena, hint, &stats);
+		heap = heap + stats.heap_bytes;
+	}
+	return heap;
+}
+
+/* Replay on sfmm with lifetime hints, and return the peak heap size at the sample points
+   and at the end, or 0 if an op failed. */
+static size_t replay_sfmm_hinted(replay_trace *t, size_t capacity, size_t interval, size_t lifetime){
+	void **ptrs = calloc(t->num_ids, sizeof(void *));
+	unsigned char *hints = replay_hints(t, lifetime);
+	sf_arena *arena = replay_arena_create(capacity);
+	size_t i, peak = 0;
+	if(arena == NULL || ptrs == NULL)
+	{
+		fprintf(stderr, "sfmm_replay: cannot create an arena of %zu bytes\n", capacity);
+		exit(EXIT_FAILURE);
+	}
+
+	for(i = 0; i < t->num_ops; i++)
+	{
+		replay_op *op = &t->ops[i];
+		if(i % interval == 0)
+		{
+			size_t heap = replay_hinted_heap(arena);
+			peak = (heap > peak) ? heap : peak;
+		}
+
+		/* Frees and reallocs find the sub-heap of a block on their own. */
+		if(op->type == 'f')
+		{
+			if(ptrs[op->id] != NULL)
+				sf_arena_free(arena, ptrs[op->id]);
+			ptrs[op->id] = NULL;
+			continue;
+		}
+		if(op->type == 'r' && ptrs[op->id] != NULL)
+			ptrs[op->id] = sf_arena_realloc(arena, ptrs[op->id], op->size);
+		else
+			ptrs[op->id] = sf_arena_malloc_hint(arena, op->size, hints[i]);
+		if(ptrs[op->id] == NULL && op->size != 0)
+		{
+			peak = 0;
+			break;
+		}
+	}
+	if(peak != 0 && replay_hinted_heap(arena) > peak)
+		peak = replay_hinted_heap(arena);
+
+	sf_arena_destroy(arena);
+	free(hints);
+	free(ptrs);
+	return peak;
+}
+
+/* Bytes the system allocator holds from the kernel, above base_heap. */
+static size_t replay_system_heap(size_t base_heap){
+	size_t heap = 0;
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	struct mallinfo2 mi = mallinfo2();
+	heap = mi.arena + mi.hblkhd;
+#endif
+	return (heap > base_heap) ? heap - base_heap : 0;
+}
+
+static void replay_system(replay_trace *t, size_t interval, replay_result *r){
+	void **ptrs = calloc(t->num_ids, sizeof(void *));
+	uint32_t *sizes = calloc(t->num_ids, sizeof(uint32_t));
+	size_t i;
+	if(ptrs == NULL || sizes == NULL)
+	{
+		perror("calloc");
+		exit(EXIT_FAILURE);
+	}
+
+	/* The measured and timed passes differ only in sampling, so run the same loop twice.
+	   The measured pass goes first, while the heap holds little besides the bookkeeping. */
+	int pass;
+	for(pass = 0; pass < 2; pass++)
+	{
+		size_t base_heap = replay_system_heap(0);
+		size_t payload = 0, peak_payload = 0, peak_heap = 0;
+		double start = replay_now();
+
+		r->failed_op = -1;
+		for(i = 0; i < t->num_ops; i++)
+		{
+			replay_op *op = &t->ops[i];
+			if(pass == 0 && i % interval == 0)
+			{
+				size_t heap = replay_system_heap(base_heap);
+				r->heap_samples[i / interval] = heap;
+				if(heap > peak_heap)
+					peak_heap = heap;
+			}
+
+			switch(op->type)
+			{
+			case 'a':
+				ptrs[op->id] = malloc(op->size);
+				break;
+			case 'r':
+				ptrs[op->id] = realloc(ptrs[op->id], op->size);
+				payload = payload - sizes[op->id];
+				break;
+			case 'f':
+				free(ptrs[op->id]);
+				ptrs[op->id] = NULL;
+				payload = payload - sizes[op->id];
+				sizes[op->id] = 0;
+				continue;
+			}
+			if(ptrs[op->id] == NULL && op->size != 0 && r->failed_op == -1)
+				r->failed_op = (long)i;
+			sizes[op->id] = op->size;
+			payload = payload + op->size;
+			if(payload > peak_payload)
+				peak_payload = payload;
+		}
+
+		if(pass == 1)
+		{
+			double seconds = replay_now() - start;
+			r->ops_per_sec = (seconds > 0) ? (double)t->num_ops / seconds : 0;
+		}
+		else
+		{
+			size_t usable = 0;
+			for(i = 0; i < t->num_ids; i++)
+				if(ptrs[i] != NULL)
+					usable = usable + malloc_usable_size(ptrs[i]) + sizeof(size_t);
+			r->final_heap = replay_system_heap(base_heap);
+			if(r->final_heap > peak_heap)
+				peak_heap = r->final_heap;
+			r->peak_util = (peak_heap == 0) ? 0 : (double)peak_payload / (double)peak_heap;
+			r->inter_frag = (usable == 0) ? 0 : (double)payload / (double)usable;
+		}
+
+		for(i = 0; i < t->num_ids; i++)
+		{
+			free(ptrs[i]);
+			ptrs[i] = NULL;
+			sizes[i] = 0;
+		}
+	}
+
+	free(ptrs);
+	free(sizes);
+	return;
+}
+
+static void replay_print(const char *name, replay_result *r){
+	if(r->failed_op != -1)
+		printf("%-8s  out of memory at op %ld\n", name, r->failed_op);
+	else
+		printf("%-8s  %14.0f  %9.4f  %9.4f  %12zu\n", name, r->ops_per_sec, r->peak_util, r->inter_frag, r->final_heap);
+	return;
+}
+
+static void usage(const char *prog){
+	fprintf(stderr, "Usage: %s [-c capacity_mb] [-s samples] [-p first|best|good[:K]] [-o lifo|address] [-t split_threshold] [-L lifetime] trace...\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+static const char *fit_names[] = {"first", "best", "good"};
+
+/* Parse "first", "best", "good" or "good:K" and select that placement policy. */
+static int replay_set_policy(const char *arg){
+	unsigned int max_fits = 0;
+	int policy;
+	for(policy = SF_FIT_FIRST; policy <= SF_FIT_GOOD; policy++)
+	{
+		size_t n = strlen(fit_names[policy]);
+		if(strncmp(arg, fit_names[policy], n) != 0)
+			continue;
+		if(arg[n] == ':' && policy == SF_FIT_GOOD)
+			max_fits = (unsigned int)strtoul(arg + n + 1, NULL, 10);
+		else if(arg[n] != '\0')
+			continue;
+		return sf_set_fit_policy(policy, max_fits);
+	}
+	return -1;
+}
+
+int main(int argc, char *argv[]){
+	size_t capacity_mb = REPLAY_DEFAULT_CAPACITY_MB;
+	size_t num_samples = REPLAY_DEFAULT_SAMPLES;
+	size_t hint_lifetime = 0;
+	int i, status = EXIT_SUCCESS;
+
+	for(i = 1; i < argc && argv[i][0] == '-'; i++)
+	{
+		if(strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+			capacity_mb = strtoul(argv[++i], NULL, 10);
+		else if(strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+			num_samples = strtoul(argv[++i], NULL, 10);
+		else if(strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+		{
+			if(replay_set_policy(argv[++i]) == -1)
+				usage(argv[0]);
+		}
+		else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+		{
+			i++;
+			if(strcmp(argv[i], "lifo") == 0)
+				replay_frlst_order = SF_ORDER_LIFO;
+			else if(strcmp(argv[i], "address") == 0)
+				replay_frlst_order = SF_ORDER_ADDRESS;
+			else
+				usage(argv[0]);
+		}
+		else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+			sf_set_split_threshold((sf_size_t)strtoul(argv[++i], NULL, 10));
+		else if(strcmp(argv[i], "-L") == 0 && i + 1 < argc)
+			hint_lifetime = strtoul(argv[++i], NULL, 10);
+		else
+			usage(argv[0]);
+	}
+	if(i == argc || capacity_mb == 0 || num_samples == 0)
+		usage(argv[0]);
+
+	for(; i < argc; i++)
+	{
+		replay_trace t = {NULL, 0, 0, 0};
+		if(replay_load(argv[i], &t) == -1)
+		{
+			fprintf(stderr, "sfmm_replay: %s: cannot read trace\n", argv[i]);
+			status = EXIT_FAILURE;
+			continue;
+		}
+
+		size_t interval = (t.num_ops + num_samples - 1) / num_samples;
+		if(interval == 0)
+			interval = 1;
+		size_t samples = (t.num_ops + interval - 1) / interval;
+
+		replay_result sfmm_result, system_result;
+		sfmm_result.heap_samples = calloc(samples + 1, sizeof(size_t));
+		system_result.heap_samples = calloc(samples + 1, sizeof(size_t));
+		replay_sfmm(&t, capacity_mb << 20, interval, &sfmm_result);
+		replay_system(&t, interval, &system_result);
+
+		printf("trace: %s (%zu ops, %zu ids)\n", argv[i], t.num_ops, t.num_ids);
+		printf("%-8s  %14s  %9s  %9s  %12s\n", "", "ops/sec", "peak util", "int frag", "final heap");
+		replay_print("sfmm", &sfmm_result);
+		replay_print("system", &system_result);
+		printf("sfmm placement: %s fit, %s order, split threshold %u, %.2f probes per search, external fragmentation %.4f\n",
+			fit_names[sf_get_fit_policy()], (replay_frlst_order == SF_ORDER_ADDRESS) ? "address" : "lifo",
+			sf_get_split_threshold(), sfmm_result.probes_per_search, sfmm_result.ext_frag);
+		if(hint_lifetime != 0 && sfmm_result.failed_op == -1)
+		{
+			size_t peak = sfmm_result.final_heap, s;
+			for(s = 0; s < samples; s++)
+				peak = (sfmm_result.heap_samples[s] > peak) ? sfmm_result.heap_samples[s] : peak;
+			size_t hinted_peak = replay_sfmm_hinted(&t, capacity_mb << 20, interval, hint_lifetime);
+			if(hinted_peak == 0)
+				printf("sfmm lifetime hints: out of memory\n");
+			else
+				printf("sfmm lifetime hints (short-lived within %zu ops): peak heap %zu, without hints %zu\n",
+					hint_lifetime, hinted_peak, peak);
+		}
+		printf("heap size over time:\n");
+		printf("%10s  %12s  %12s\n", "op", "sfmm", "system");
+		size_t s;
+		for(s = 0; s < samples; s++)
+			printf("%10zu  %12zu  %12zu\n", s * interval, sfmm_result.heap_samples[s], system_result.heap_samples[s]);
+		printf("%10zu  %12zu  %12zu\n\n", t.num_ops, sfmm_result.final_heap, system_result.final_heap);
+
+		free(sfmm_result.heap_samples);
+		free(system_result.heap_samples);
+		free(t.ops);
+	}
+
+	return status;
+}